@@ -3,10 +3,12 @@
 #include <hyprutils/memory/SharedPtr.hpp>
 #include "../buffer/Buffer.hpp"
 #include <drm_fourcc.h>
+#include <functional>
 
 namespace Aquamarine {
     class CBackend;
     class CSwapchain;
+    class CBufferPool;
 
     struct SAllocatorBufferParams {
         Hyprutils::Math::Vector2D size;
@@ -26,5 +28,17 @@ namespace Aquamarine {
         virtual Hyprutils::Memory::CSharedPointer<CBackend> getBackend()                                                                                           = 0;
         virtual int                                         drmFD()                                                                                                = 0;
         virtual eAllocatorType                              type()                                                                                                 = 0;
+
+        // where swapchains return buffers they're done with, for acquire() to hand out again. nullptr if this allocator doesn't pool.
+        virtual Hyprutils::Memory::CSharedPointer<CBufferPool> getPool() {
+            return nullptr;
+        }
+
+        // like acquire(), but the allocation may happen off the calling thread. onDone gets the buffer, or nullptr on failure,
+        // from the loop dispatching the backend. It may be called before this returns, the default allocates right away.
+        virtual void acquireAsync(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain,
+                                  std::function<void(Hyprutils::Memory::CSharedPointer<IBuffer>)> onDone) {
+            onDone(acquire(params, swapchain));
+        }
     };
 };
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Allocator.hpp"
+#include <functional>
+#include <vector>
+
+namespace Aquamarine {
+    class IBackendImplementation;
+    class IOutput;
+
+    struct SBufferPoolStats {
+        uint64_t hits = 0, misses = 0;
+        size_t   buffers = 0, bytes = 0; // currently held by the pool
+    };
+
+    /*
+        Keeps buffers swapchains dropped on a reconfigure, so that going back to the same size / format
+        (e.g. an interactive resize, or a mode switch) doesn't hit the allocator again.
+        Buffers are only handed out to swapchains of the same backend and scanout output, for the same params.
+        Contents of a recycled buffer are undefined.
+    */
+    class CBufferPool {
+      public:
+        using FAllocate = std::function<Hyprutils::Memory::CSharedPointer<IBuffer>(const SAllocatorBufferParams&, Hyprutils::Memory::CSharedPointer<CSwapchain>)>;
+
+        CBufferPool(FAllocate allocate_);
+
+        // returns a pooled buffer for params, or allocates a new one
+        Hyprutils::Memory::CSharedPointer<IBuffer> acquire(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain);
+
+        // returns a pooled buffer for params, nullptr if there's none
+        Hyprutils::Memory::CSharedPointer<IBuffer> take(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain);
+
+        // takes a buffer the swapchain is done with. Buffers still locked by a backend, or over the cap, are freed instead.
+        void                                       recycle(Hyprutils::Memory::CSharedPointer<IBuffer> buffer, const SAllocatorBufferParams& params,
+                                                           Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain);
+
+        // allocates buffers ahead of time, until the pool holds count of them for params. Returns false if an allocation failed.
+        bool                                       prewarm(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain, size_t count);
+
+        // 0 disables pooling. Defaults to 128MB.
+        void                                       setMaxBytes(size_t bytes);
+        void                                       clear();
+        SBufferPoolStats                           stats();
+
+      private:
+        struct SKey {
+            SAllocatorBufferParams                                  params;
+            Hyprutils::Memory::CWeakPointer<IBackendImplementation> backend;
+            Hyprutils::Memory::CWeakPointer<IOutput>                scanoutOutput;
+
+            bool                                                    matches(const SKey& other) const;
+        };
+
+        struct SEntry {
+            SKey                                       key;
+            Hyprutils::Memory::CSharedPointer<IBuffer> buffer;
+            size_t                                     bytes = 0;
+        };
+
+        SKey                keyFor(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain);
+        void                add(SEntry&& entry);
+        void                trim();
+
+        FAllocate           allocate;
+        std::vector<SEntry> entries; // oldest first
+        size_t              maxBytes = 128 * 1024 * 1024;
+        SBufferPoolStats    counters;
+    };
+};
@@ -1,6 +1,13 @@
 #pragma once
 
 #include "Allocator.hpp"
+#include "BufferPool.hpp"
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 
 struct gbm_device;
 struct gbm_bo;
@@ -24,16 +31,32 @@ namespace Aquamarine {
         virtual void                                   endDataPtr();
 
       private:
-        CGBMBuffer(const SAllocatorBufferParams& params, Hyprutils::Memory::CWeakPointer<CGBMAllocator> allocator_, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain);
+        // with deferBO, the constructor only plans the allocation, createBO() and finishBO() are left to the caller
+        CGBMBuffer(const SAllocatorBufferParams& params, Hyprutils::Memory::CWeakPointer<CGBMAllocator> allocator_, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain,
+                   bool deferBO = false);
+
+        // only calls into gbm, so it can run on the allocation worker
+        bool                                           createBO();
+        void                                           finishBO(Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain);
 
         Hyprutils::Memory::CWeakPointer<CGBMAllocator> allocator;
 
+        struct {
+            std::vector<uint64_t> modifiers;
+            uint32_t              flags  = 0;
+            bool                  cursor = false, scanout = false;
+            bool                  ready  = false; // a format was found
+        } plan;
+
         // gbm stuff
         gbm_bo*      bo         = nullptr;
         void*        boBuffer   = nullptr;
         void*        gboMapping = nullptr;
         SDMABUFAttrs attrs{.success = false};
 
+        // allocated with a ranked modifier KMS hasn't accepted yet, see CGBMAllocator::scanoutModifiers
+        std::optional<uint64_t> probedModifier;
+
         friend class CGBMAllocator;
     };
 
@@ -46,6 +69,13 @@ namespace Aquamarine {
         virtual Hyprutils::Memory::CSharedPointer<CBackend>     getBackend();
         virtual int                                             drmFD();
         virtual eAllocatorType                                  type();
+        virtual Hyprutils::Memory::CSharedPointer<CBufferPool>  getPool();
+        virtual void                                            acquireAsync(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain_,
+                                                                             std::function<void(Hyprutils::Memory::CSharedPointer<IBuffer>)> onDone);
+
+        // for the DRM backend: KMS refused a commit of a swapchain buffer on output. If that was the validated scanout modifier,
+        // it's taken out and later allocations fall back to linear, or gbm's own pick if linear isn't offered.
+        void                                                    rejectScanoutModifier(Hyprutils::Memory::CSharedPointer<IOutput> output, uint32_t format, uint64_t modifier);
 
         //
         Hyprutils::Memory::CWeakPointer<CGBMAllocator> self;
@@ -53,9 +83,63 @@ namespace Aquamarine {
       private:
         CGBMAllocator(int fd_, Hyprutils::Memory::CWeakPointer<CBackend> backend_);
 
+        Hyprutils::Memory::CSharedPointer<IBuffer>               allocate(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain_);
+        // validates the scanout modifier and tracks the buffer. nullptr if it isn't good
+        Hyprutils::Memory::CSharedPointer<IBuffer>               finishAllocation(Hyprutils::Memory::CSharedPointer<CGBMBuffer> newBuffer, const SAllocatorBufferParams& params,
+                                                                                  Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain_);
+
+        // creates the bos of acquireAsync() off the main thread. Started on first use, results come back through the backend's idle queue.
+        // gbm is only entered for bo creation there, mesa's gbm takes its own locks for that.
+        struct SWorker {
+            struct SDone {
+                uint64_t                                      id = 0;
+                std::vector<std::pair<uint32_t, std::string>> logs;
+            };
+
+            std::thread                                  thread;
+            std::mutex                                   mutex;
+            std::condition_variable                      cv;
+            std::deque<std::pair<uint64_t, CGBMBuffer*>> jobs;              // mutex
+            std::vector<SDone>                           done;              // mutex
+            bool                                         exit      = false; // mutex
+            CGBMAllocator*                               allocator = nullptr;
+
+            uint64_t                                     nextID = 1; // main thread only
+        };
+
+        struct SAsyncJob {
+            uint64_t                                                         id = 0;
+            Hyprutils::Memory::CSharedPointer<CGBMBuffer>                    buffer; // the worker has a raw ptr to it until it's done
+            SAllocatorBufferParams                                           params;
+            Hyprutils::Memory::CSharedPointer<CSwapchain>                    swapchain;
+            std::function<void(Hyprutils::Memory::CSharedPointer<IBuffer>)> onDone;
+        };
+
+        std::shared_ptr<SWorker>                                 worker;
+        std::vector<SAsyncJob>                                   asyncJobs;
+
+        bool                                                     startWorker();
+        void                                                     dispatchAsync();
+
         // a vector purely for tracking (debugging) the buffers and nothing more
         std::vector<Hyprutils::Memory::CWeakPointer<CGBMBuffer>> buffers;
 
+        Hyprutils::Memory::CSharedPointer<CBufferPool>           pool;
+
+        // the best modifier KMS takes per scanout output and format. Candidates are tried best first, compressed > tiled > linear.
+        struct SScanoutModifier {
+            Hyprutils::Memory::CWeakPointer<IOutput> output;
+            uint32_t                                 format   = DRM_FORMAT_INVALID;
+            uint64_t                                 modifier = DRM_FORMAT_MOD_INVALID; // once validated
+            std::vector<uint64_t>                    rejected;
+            bool                                     commitRejected = false; // a commit failed on a validated one, don't climb the ranking again
+        };
+        std::vector<SScanoutModifier>                            scanoutModifiers;
+
+        SScanoutModifier&                                        scanoutModifierFor(Hyprutils::Memory::CSharedPointer<IOutput> output, uint32_t format);
+        std::optional<uint64_t>                                  pickScanoutModifier(Hyprutils::Memory::CSharedPointer<IOutput> output, uint32_t format,
+                                                                                     const std::vector<uint64_t>& candidates, bool* validated);
+
         int                                                      fd = -1;
         Hyprutils::Memory::CWeakPointer<CBackend>                backend;
 
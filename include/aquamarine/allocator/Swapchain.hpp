@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Allocator.hpp"
+#include <hyprutils/math/Region.hpp>
+#include <functional>
+#include <optional>
 
 namespace Aquamarine {
 
@@ -15,6 +18,14 @@ namespace Aquamarine {
         Hyprutils::Memory::CWeakPointer<IOutput> scanoutOutput;
     };
 
+    // see CSwapchain::setDepthPolicy
+    struct SSwapchainDepthPolicy {
+        size_t   maxLength   = 3;   // the most it grows to. The length asked for in reconfigure() is the least
+        uint32_t growAfter   = 2;   // late frames within a window that add a buffer
+        uint32_t window      = 120; // frames
+        uint32_t shrinkAfter = 600; // frames in a row on time that drop one again
+    };
+
     class CSwapchain {
       public:
         static Hyprutils::Memory::CSharedPointer<CSwapchain> create(Hyprutils::Memory::CSharedPointer<IAllocator>             allocator_,
@@ -22,11 +33,39 @@ namespace Aquamarine {
 
         bool                                                 reconfigure(const SSwapchainOptions& options_);
 
+        // like reconfigure(), but new buffers are allocated in the background while next() keeps handing out the current ones.
+        // They're swapped in once all of them are ready, then onDone is called. onDone(false) means it failed, or a reconfigure() changed the swapchain first.
+        // Changes that don't need new buffers are done right away.
+        bool                                                 reconfigureAsync(const SSwapchainOptions& options_, std::function<void(bool)> onDone = {});
+
+        // what a reconfigureAsync() is still allocating for, if any
+        std::optional<SSwapchainOptions>                     pendingOptions();
+
+        // allocates buffers for options_ in the background and leaves them in the allocator's pool, for a later reconfigure() to pick up.
+        // The current buffers stay. Does nothing if the allocator doesn't pool.
+        void                                                 prewarm(const SSwapchainOptions& options_);
+
+        /*
+            Opt-in: lets the swapchain grow past the length asked for in reconfigure(), while the backend reports late frames, and shrink back
+            once they're on time again. Only buffers are added or dropped, as with a length change. nullopt goes back to the length asked for.
+        */
+        void                                                 setDepthPolicy(std::optional<SSwapchainDepthPolicy> policy);
+
+        // for backends: whether a frame was late, i.e. it missed its vblank or was rejected for a pending flip. Returns whether the length changed.
+        // Call it from the thread that commits, it does nothing without a policy.
+        bool                                                 onFrameFeedback(bool late);
+
         bool                                                 contains(Hyprutils::Memory::CSharedPointer<IBuffer> buffer);
-        Hyprutils::Memory::CSharedPointer<IBuffer>           next(int* age);
+
+        // age is 0 if the buffer contents are undefined, otherwise the amount of frames since this buffer was last handed out (like EGL_BUFFER_AGE_EXT).
+        // damage, if passed, is set to everything that changed since then, as reported via addDamage(). Unknown damage is the whole buffer.
+        Hyprutils::Memory::CSharedPointer<IBuffer>           next(int* age, Hyprutils::Math::CRegion* damage = nullptr);
         const SSwapchainOptions&                             currentOptions();
         Hyprutils::Memory::CSharedPointer<IAllocator>        getAllocator();
 
+        // reports what was drawn into the buffer last returned by next(). Needed for the damage returned by next().
+        void addDamage(const Hyprutils::Math::CRegion& damage);
+
         // rolls the buffers back, marking the last consumed as the next valid.
         // useful if e.g. a commit fails and we don't wanna write to the previous buffer that is
         // in use.
@@ -35,8 +74,19 @@ namespace Aquamarine {
       private:
         CSwapchain(Hyprutils::Memory::CSharedPointer<IAllocator> allocator_, Hyprutils::Memory::CSharedPointer<IBackendImplementation> backendImpl_);
 
-        bool fullReconfigure(const SSwapchainOptions& options_);
-        bool resize(size_t newSize);
+        bool                     fullReconfigure(const SSwapchainOptions& options_);
+        bool                     resize(size_t newSize);
+        SSwapchainOptions        withDepth(const SSwapchainOptions& options_); // what the depth policy makes of the options asked for
+        bool                     setExtraDepth(size_t extra);
+        void                     resetAge();
+        Hyprutils::Math::CRegion damageSince(int age);
+        SAllocatorBufferParams   bufferParams(const SSwapchainOptions& options_);
+        // drops buffers past keep, handing them to the allocator's pool
+        void                     recycleBuffers(size_t keep);
+        // same for the buffers a pending reconfigure got before it was given up on
+        void                     recyclePendingBuffers(std::vector<Hyprutils::Memory::CSharedPointer<IBuffer>>& ready);
+        void                     onPendingBuffer(uint64_t generation, size_t index, const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<IBuffer> buffer);
+        void                     cancelPending();
 
         //
         Hyprutils::Memory::CWeakPointer<CSwapchain>             self;
@@ -46,6 +96,36 @@ namespace Aquamarine {
         std::vector<Hyprutils::Memory::CSharedPointer<IBuffer>> buffers;
         int                                                     lastAcquired = 0;
 
+        // for buffer age, frames are counted by next()
+        uint64_t              frame = 0;
+        std::vector<uint64_t> bufferFrames; // frame each buffer was last handed out on, 0 if never
+
+        struct SDamageEntry {
+            uint64_t                 frame = 0;
+            Hyprutils::Math::CRegion damage;
+        };
+        std::vector<SDamageEntry> damageRing; // indexed by frame % length
+
+        struct {
+            std::optional<SSwapchainDepthPolicy> policy;
+            size_t                               requested = 0; // the length asked for
+            size_t                               extra     = 0; // buffers the policy added on top
+            uint32_t                             late      = 0, windowFrames = 0, onTime = 0;
+        } depth;
+
+        // a reconfigureAsync() in flight. Buffers arriving for an older generation go to the allocator's pool
+        struct {
+            bool                                                    active     = false;
+            uint64_t                                                generation = 0;
+            SSwapchainOptions                                       options;
+            std::vector<Hyprutils::Memory::CSharedPointer<IBuffer>> buffers;
+            size_t                                                  outstanding = 0;
+            bool                                                    failed      = false;
+            std::function<void(bool)>                               onDone;
+        } pending;
+
         friend class CGBMBuffer;
+        friend class CGBMAllocator;
+        friend class CBufferPool;
     };
 };
@@ -6,6 +6,7 @@
 #include <functional>
 #include <mutex>
 #include <condition_variable>
+#include <unordered_map>
 #include "../allocator/Allocator.hpp"
 #include "Misc.hpp"
 #include "Session.hpp"
@@ -96,6 +97,12 @@ namespace Aquamarine {
         /* Gets all the FDs you have to poll. When any single one fires, call its onPoll */
         std::vector<Hyprutils::Memory::CSharedPointer<SPollFD>> getPollFDs();
 
+        /* Alternatively, a single epoll FD covering all of the above, registered once on start. When it's readable, call dispatch(0) */
+        int getEpollFD();
+
+        /* Waits up to timeoutMs (-1 blocks, 0 doesn't) for the poll FDs and dispatches the ready ones. Returns how many were dispatched, -1 on error */
+        int dispatch(int timeoutMs = -1);
+
         /* Checks if the backend has a session - iow if it's a DRM backend */
         bool hasSession();
 
@@ -108,12 +115,15 @@ namespace Aquamarine {
         /* get a vector of the backend implementations available */
         const std::vector<Hyprutils::Memory::CSharedPointer<IBackendImplementation>>& getImplementations();
 
-        /* push an idle event to the queue */
+        /* push an idle event to the queue. fn is also its cancellation token, adding it again only runs it once */
         void addIdleEvent(Hyprutils::Memory::CSharedPointer<std::function<void(void)>> fn);
 
         /* remove an idle event from the queue */
         void removeIdleEvent(Hyprutils::Memory::CSharedPointer<std::function<void(void)>> pfn);
 
+        /* push an idle event from any thread. It runs on the thread dispatching the backend */
+        void postIdleEvent(std::function<void(void)> fn);
+
         // utils
         int reopenDRMNode(int drmFD, bool allowRenderNode = true);
 
@@ -143,13 +153,28 @@ namespace Aquamarine {
         Hyprutils::Memory::CWeakPointer<CBackend>                              self;
         std::vector<Hyprutils::Memory::CSharedPointer<SPollFD>>                sessionFDs;
 
+        struct SIdleEvent {
+            Hyprutils::Memory::CSharedPointer<std::function<void(void)>> shared; // from addIdleEvent, main thread only
+            std::function<void(void)>                                    owned;  // from postIdleEvent
+            uint64_t                                                     ticket = 0;
+        };
+
         struct {
-            int                                                                       fd = -1;
-            std::vector<Hyprutils::Memory::CSharedPointer<std::function<void(void)>>> pending;
+            int                                                      fd = -1; // eventfd, written when pending stops being empty
+            std::mutex                                               mutex;
+            std::vector<SIdleEvent>                                  pending;
+            std::unordered_map<std::function<void(void)>*, uint64_t> tickets; // latest ticket of every queued fn, dropped on removal
+            uint64_t                                                 nextTicket = 1;
         } idle;
 
+        struct {
+            int                                                     fd = -1;
+            std::vector<Hyprutils::Memory::CSharedPointer<SPollFD>> registered; // epoll events point into these
+        } epoll;
+
         void dispatchIdle();
-        void updateIdleTimer();
+        void wakeIdle();
+        void initEpoll();
 
         //
         struct {
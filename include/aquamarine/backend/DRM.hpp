@@ -7,7 +7,9 @@
 #include <hyprutils/memory/WeakPtr.hpp>
 #include <wayland-client.h>
 #include <xf86drmMode.h>
+#include <sys/types.h>
 #include <optional>
+#include <list>
 
 namespace Aquamarine {
     class CDRMBackend;
@@ -16,6 +18,8 @@ namespace Aquamarine {
     struct SDRMConnector;
     class CDRMRenderer;
     class CDRMDumbAllocator;
+    class IDRMBlitter;
+    struct SDRMBlitResult;
 
     typedef std::function<void(void)> FIdleCallback;
 
@@ -26,9 +30,11 @@ namespace Aquamarine {
             ;
         }
         virtual eAttachmentType type() {
-            return AQ_ATTACHMENT_DRM_BUFFER;
+            return TYPE;
         }
 
+        static constexpr eAttachmentType          TYPE = AQ_ATTACHMENT_DRM_BUFFER;
+
         Hyprutils::Memory::CSharedPointer<CDRMFB> fb;
     };
 
@@ -41,8 +47,10 @@ namespace Aquamarine {
             ;
         }
         virtual eAttachmentType type() {
-            return AQ_ATTACHMENT_DRM_KMS_UNIMPORTABLE;
+            return TYPE;
         }
+
+        static constexpr eAttachmentType TYPE = AQ_ATTACHMENT_DRM_KMS_UNIMPORTABLE;
     };
 
     class CDRMLease {
@@ -96,12 +104,38 @@ namespace Aquamarine {
         CDRMFB(Hyprutils::Memory::CSharedPointer<IBuffer> buffer_, Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_);
         uint32_t submitBuffer();
         void     import();
+        void     listenForDestroy();
+
+        // hands a cached fb to a new IBuffer wrapping the same dmabuf
+        void rebind(Hyprutils::Memory::CSharedPointer<IBuffer> buffer_);
 
-        bool     dropped = false, handlesClosed = false;
+        bool dropped = false, handlesClosed = false;
+        bool cached  = false; // in the backend's fbCache, until it's evicted or its IBuffer is destroyed
 
         struct {
             Hyprutils::Signal::CHyprSignalListener destroyBuffer;
         } listeners;
+
+        friend class CDRMBackend;
+    };
+
+    // a point on a client's drm_syncobj timeline, imported to the backend's gpu
+    class CDRMSyncPoint {
+      public:
+        ~CDRMSyncPoint();
+
+        static Hyprutils::Memory::CSharedPointer<CDRMSyncPoint> create(Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_, int timelineFD, uint64_t point_);
+
+        // a sync file for the point's fence, -1 if it has none yet. Caller owns it.
+        int                                          exportSyncFile();
+        bool                                         signal();
+
+        uint32_t                                     handle = 0;
+        uint64_t                                     point  = 0;
+        Hyprutils::Memory::CWeakPointer<CDRMBackend> backend;
+
+      private:
+        CDRMSyncPoint() = default;
     };
 
     struct SDRMLayer {
@@ -121,7 +155,8 @@ namespace Aquamarine {
         Hyprutils::Memory::CSharedPointer<CDRMFB>    front /* currently displaying */, back /* submitted */, last /* keep just in case */;
         Hyprutils::Memory::CWeakPointer<CDRMBackend> backend;
         Hyprutils::Memory::CWeakPointer<SDRMPlane>   self;
-        std::vector<SDRMFormat>                      formats;
+        CDRMFormatTable                              formats;
+        CDRMFormatTable                              renderable; // formats the renderer can draw to as well, all of them if it reports none
 
         union UDRMPlaneProps {
             struct {
@@ -157,7 +192,8 @@ namespace Aquamarine {
         int32_t                refresh = 0; // unused
 
         struct {
-            int gammaSize = 0;
+            int  gammaSize    = 0;
+            bool cursorHidden = false; // taken off with a null drmModeSetCursor, a move alone doesn't bring it back
         } legacy;
 
         struct {
@@ -167,10 +203,11 @@ namespace Aquamarine {
             uint32_t ctm       = 0;
         } atomic;
 
-        Hyprutils::Memory::CSharedPointer<SDRMPlane> primary;
-        Hyprutils::Memory::CSharedPointer<SDRMPlane> cursor;
-        Hyprutils::Memory::CWeakPointer<CDRMBackend> backend;
-        Hyprutils::Memory::CSharedPointer<CDRMFB>    pendingCursor;
+        Hyprutils::Memory::CSharedPointer<SDRMPlane>              primary;
+        Hyprutils::Memory::CSharedPointer<SDRMPlane>              cursor;
+        std::vector<Hyprutils::Memory::CSharedPointer<SDRMPlane>> overlays; // each overlay plane is owned by exactly one crtc
+        Hyprutils::Memory::CWeakPointer<CDRMBackend>              backend;
+        Hyprutils::Memory::CSharedPointer<CDRMFB>                 pendingCursor;
 
         union UDRMCRTCProps {
             struct {
@@ -204,6 +241,13 @@ namespace Aquamarine {
         virtual Hyprutils::Math::Vector2D                                 cursorPlaneSize();
         virtual size_t                                                    getGammaSize();
         virtual std::vector<SDRMFormat>                                   getRenderFormats();
+        virtual size_t                                                    maxLayers();
+        virtual bool                                                      setFrameDeadline(bool enabled, uint64_t budgetNs = 0);
+        virtual void                                                      reportRenderTime(uint64_t ns);
+        virtual bool                                                      setThreadedCommits(bool enabled);
+        virtual int                                                       threadedEventFD();
+        virtual void                                                      dispatchThreadedEvents();
+        virtual Hyprutils::Memory::CSharedPointer<COutputCapture>         capture(const Hyprutils::Math::Vector2D& scaledSize = {});
 
         int                                                               getConnectorID();
 
@@ -220,45 +264,211 @@ namespace Aquamarine {
 
         bool                                                         commitState(bool onlyTest = false);
 
+        enum eCommitPrepareResult : uint8_t {
+            AQ_COMMIT_PREPARE_FAILED = 0,
+            AQ_COMMIT_PREPARE_DONE, // nothing left to commit, e.g. a test on a secondary gpu, or an async blit
+            AQ_COMMIT_PREPARE_READY,
+        };
+
+        // checks the pending state and builds the commit data for it. Batched commits go straight to KMS.
+        eCommitPrepareResult prepareCommit(bool onlyTest, SDRMConnectorCommitData& data, bool batched = false);
+        // commits prepared data on its own, re-modesetting if needed
+        bool                 commitPrepared(SDRMConnectorCommitData& data);
+        void                 onCommitted(const SDRMConnectorCommitData& data);
+
+        // commits target once blitting buffer into it is done
+        bool commitAsyncBlit(Hyprutils::Memory::CSharedPointer<IBuffer> buffer, Hyprutils::Memory::CSharedPointer<IBuffer> target, const Hyprutils::Math::CRegion& damage,
+                             uint32_t flags, Hyprutils::Memory::CSharedPointer<CDRMSyncPoint> releasePoint);
+
         Hyprutils::Memory::CWeakPointer<CDRMBackend>                 backend;
         Hyprutils::Memory::CSharedPointer<SDRMConnector>             connector;
         Hyprutils::Memory::CSharedPointer<std::function<void(void)>> frameIdle;
 
+        // imports buffer on this gpu if it can be scanned out as-is, validating new format / modifier pairs with a test commit first.
+        // nullptr means it needs a blit.
+        Hyprutils::Memory::CSharedPointer<CDRMFB> importZeroCopy(Hyprutils::Memory::CSharedPointer<IBuffer> buffer, Hyprutils::Memory::CSharedPointer<SOutputMode> mode,
+                                                                 bool modeset);
+
+        // copies a small cpu-mappable cursor into a dumb buffer on this gpu. nullptr means it needs a blit.
+        // A standalone copy gets a buffer of its own instead of the next one from the swapchain, for the cursor cache.
+        Hyprutils::Memory::CSharedPointer<CDRMFB> uploadCursor(Hyprutils::Memory::CSharedPointer<IBuffer> buffer, bool standalone);
+
+        // cursor images prepared for a secondary gpu's plane, by content. Animated cursors cycle through the same few images,
+        // and switching to a cached one is only a new fb id for the plane.
+        struct SCursorCacheKey {
+            size_t                    hash = 0;
+            Hyprutils::Math::Vector2D size;
+            uint32_t                  format = DRM_FORMAT_INVALID;
+            std::vector<uint8_t>      pixels; // packed rows. Compared last, only when the hash matches, so a collision is a miss
+
+            bool                      operator==(const SCursorCacheKey&) const = default;
+        };
+
+        struct SCursorCacheEntry {
+            SCursorCacheKey                            key;
+            Hyprutils::Memory::CSharedPointer<IBuffer> buffer; // the fb only has a weak ref
+            Hyprutils::Memory::CSharedPointer<CDRMFB>  fb;
+        };
+
+        std::optional<SCursorCacheKey>            cursorCacheKey(Hyprutils::Memory::CSharedPointer<IBuffer> buffer); // nullopt if its contents can't be read
+        Hyprutils::Memory::CSharedPointer<CDRMFB> cursorCacheGet(const SCursorCacheKey& key);
+        void                                      cursorCacheAdd(const SCursorCacheKey& key, Hyprutils::Memory::CSharedPointer<CDRMFB> fb);
+
+        std::list<SCursorCacheEntry>              cursorCache; // most recently used first
+
         struct {
             Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain;
             Hyprutils::Memory::CSharedPointer<CSwapchain> cursorSwapchain;
+            Hyprutils::Memory::CSharedPointer<CSwapchain> dumbCursorSwapchain; // for uploadCursor
+
+            // what swapchain was last prewarmed for, while the consumer's swapchain reconfigures in the background
+            SSwapchainOptions                             prewarmed;
+
+            // cached result of importZeroCopy for the last format / modifier
+            struct {
+                uint32_t format   = DRM_FORMAT_INVALID;
+                uint64_t modifier = DRM_FORMAT_MOD_INVALID;
+                bool     tested   = false;
+                bool     works    = false;
+            } zeroCopy;
         } mgpu;
 
-        bool lastCommitNoBuffer = true;
+        bool     lastCommitNoBuffer = true;
+        uint64_t lastCommitNs       = 0;  // CLOCK_MONOTONIC, for the present latency stats. 0 if no flip is expected
+        int      acquireFence       = -1; // sync file exported from the state's acquire point, kept until the next commit
+
+        // for capture(): what was committed since the last capture, and where downscaled copies go
+        struct {
+            Hyprutils::Math::CRegion                      damage;
+            bool                                          full = true; // a commit without damage, or no capture yet
+            Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain;
+        } captured;
+
+        // AQ_OUTPUT_PRESENTATION_MAILBOX: the newest frame committed while a flip was pending, flipped by handlePF once that one lands.
+        // Its fences are taken when it's queued, the compositor's timelines may be gone by then.
+        struct {
+            std::optional<COutputState::SInternalState>      state;
+            Hyprutils::Memory::CSharedPointer<CDRMSyncPoint> releasePoint;
+            int                                              inFence = -1; // sync file, owned
+        } mailbox;
+
+        bool queueMailbox(); // takes the pending state, replacing (and releasing) a queued frame
+        void flushMailbox(); // commits the queued frame, if any
+        void dropMailbox();  // releases the queued frame without showing it
+
+        // frame events fire at the predicted next vblank minus the render budget, instead of right after a page-flip.
+        struct {
+            bool     enabled    = false;
+            uint64_t budget     = 0; // ns, set by the compositor. 0 uses the learned one
+            uint64_t learned    = 0; // ns, slowly decaying max of the reported render times, 0 until one is reported
+            uint64_t period     = 0; // ns, measured from page-flip timestamps. 0 uses the mode's refresh
+            uint64_t lastVblank = 0; // ns, CLOCK_MONOTONIC
+            unsigned lastSeq    = 0;
+            uint64_t fireAt     = 0; // ns, 0 if not armed
+        } deadline;
+
+        // vrr low framerate compensation: content below the panel's range gets its front buffer flipped again, evenly spaced in between new frames
+        struct {
+            bool     enabled     = false;
+            uint64_t lastContent = 0; // ns, CLOCK_MONOTONIC, the last flip of a new frame
+            uint64_t period      = 0; // ns, between new frames, smoothed. 0 if unknown
+            uint64_t interval    = 0; // ns, between flips
+            uint64_t fireAt      = 0; // ns, 0 if not armed
+        } lfc;
+
+        // what a test commit's result depends on. Buffers only matter by their layout.
+        struct STestCacheKey {
+            struct SLayer {
+                uint32_t               format   = 0, width = 0, height = 0;
+                uint64_t               modifier = 0;
+                std::array<int32_t, 8> boxes    = {0}; // src and dst, for overlays
+
+                bool                   operator==(const SLayer&) const = default;
+            };
+
+            std::array<uint32_t, 13> mode = {0}; // drmModeModeInfo timings and flags
+            SLayer                   primary;
+            std::optional<SLayer>    cursor;
+            std::vector<SLayer>      overlays;
+            uint32_t                 flags   = 0;
+            bool                     enabled = false, modeset = false, vrr = false, ctm = false, gamma = false, tainted = false, scaled = false;
+
+            bool                     operator==(const STestCacheKey&) const = default;
+        };
+
+        STestCacheKey                             testCacheKey(const SDRMConnectorCommitData& data);
+        std::optional<bool>                       testCacheGet(const STestCacheKey& key);
+        void                                      testCacheAdd(const STestCacheKey& key, bool result);
+
+        std::list<std::pair<STestCacheKey, bool>> testCache;               // most recently used first
+        uint64_t                                  testCacheGeneration = 0; // CDRMBackend::testCacheGeneration the results are valid for
+
+        // see IOutput::setThreadedCommits
+        struct {
+            std::atomic<bool>                      enabled = false;
+            int                                    fd      = -1; // eventfd, written when pending stops being empty
+            std::mutex                             mutex;
+            std::vector<std::function<void(void)>> pending;
+        } threaded;
+
+        // emit right away, or queue for dispatchThreadedEvents
+        void deliver(std::function<void(void)> fn);
+        void deliverPresent(const SPresentEvent& event);
+        void deliverFrame();
 
         friend struct SDRMConnector;
         friend class CDRMLease;
+        friend class CDRMBackend;
+        friend class CGBMBuffer;
     };
 
     struct SDRMPageFlip {
         Hyprutils::Memory::CWeakPointer<SDRMConnector> connector;
+        bool                                           cursorOnly = false; // a cursor-only commit, not a frame
+        bool                                           zeroCopy   = true;  // the frame is scanned out of the committed buffer, not a blitted copy
+        bool                                           repeated   = false; // the front buffer flipped again by lfc, not a new frame
+    };
+
+    struct SDRMOverlayCommitData {
+        Hyprutils::Memory::CSharedPointer<CDRMFB>    fb;
+        Hyprutils::Memory::CSharedPointer<SDRMPlane> plane; // assigned by the implementation
+        Hyprutils::Math::CBox                        src, dst;
     };
 
     struct SDRMConnectorCommitData {
-        Hyprutils::Memory::CSharedPointer<CDRMFB> mainFB, cursorFB;
-        bool                                      modeset  = false;
-        bool                                      blocking = false;
-        uint32_t                                  flags    = 0;
-        bool                                      test     = false;
-        drmModeModeInfo                           modeInfo;
-        std::optional<Hyprutils::Math::Mat3x3>    ctm;
+        Hyprutils::Memory::CSharedPointer<CDRMFB>        mainFB, cursorFB;
+        std::vector<SDRMOverlayCommitData>               overlays;
+        bool                                             modeset  = false;
+        bool                                             blocking = false;
+        uint32_t                                         flags    = 0;
+        bool                                             test     = false;
+        drmModeModeInfo                                  modeInfo;
+        std::optional<Hyprutils::Math::Mat3x3>           ctm;
+        std::optional<int>                               explicitInFence; // overrides the state's in fence
+        bool                                             blitted = false; // mainFB is a mgpu copy of the committed buffer
+        Hyprutils::Memory::CSharedPointer<CDRMSyncPoint> releasePoint;    // signalled once a later flip replaces mainFB
+        std::optional<COutputState::SInternalState>      state;           // what's committed, for commits made after the consumer moved on (async blits)
 
         struct {
-            uint32_t gammaLut = 0;
-            uint32_t fbDamage = 0;
-            uint32_t modeBlob = 0;
-            uint32_t ctmBlob  = 0;
-            bool     blobbed  = false;
-            bool     gammad   = false;
-            bool     ctmd     = false;
+            uint32_t gammaLut  = 0;
+            uint32_t fbDamage  = 0;
+            uint32_t modeBlob  = 0;
+            uint32_t ctmBlob   = 0;
+            bool     modeTaken = false; // modeBlob is a reference from blobGet(), rollback releases it
+            bool     blobbed   = false; // modeBlob was added to the request
+            bool     gammad    = false;
+            bool     ctmd      = false;
         } atomic;
 
         void calculateMode(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector);
+        // the snapshot in state, or the output's pending state without one
+        const COutputState::SInternalState& outputState(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector) const;
+    };
+
+    struct SDRMBatchCommit {
+        Hyprutils::Memory::CSharedPointer<SDRMConnector> connector;
+        Hyprutils::Memory::CSharedPointer<CDRMOutput>    output;
+        SDRMConnectorCommitData*                         data = nullptr;
     };
 
     struct SDRMConnector {
@@ -270,11 +480,19 @@ namespace Aquamarine {
         Hyprutils::Memory::CSharedPointer<SDRMCRTC>    getCurrentCRTC(const drmModeConnector* connector);
         drmModeModeInfo*                               getCurrentMode();
         void                                           parseEDID(std::vector<uint8_t> data);
+        void                                           fetchEDID(); // reads the EDID blob and parses it into make, model and serial
         bool                                           commitState(SDRMConnectorCommitData& data);
         void                                           applyCommit(const SDRMConnectorCommitData& data);
         void                                           rollbackCommit(const SDRMConnectorCommitData& data);
         void                                           onPresent();
+        void                                           onVblank(const timespec& when, unsigned seq); // page-flip timestamps, for the frame deadline and stats
+        bool                                           deferFrame(); // arms the frame deadline instead of sending a frame now, false if there's none to arm
+        void                                           armLFC(uint64_t flipNs, bool repeated); // after a flip, arms the next repeat if vrr content is too slow for the panel
+        bool                                           repeatFrame(); // flips the front buffer again, false if it can't right now
+        void                                           flushCursor(); // runs a deferred cursor-only commit, if any
+        Hyprutils::Memory::CWeakPointer<SDRMConnector> connectorForCRTC(uint32_t crtcID); // the connector of this backend driving crtcID, if any
         void                                           recheckCRTCProps();
+        void                                           signalReleasePoints(); // nothing committed is scanned out anymore
 
         Hyprutils::Memory::CSharedPointer<CDRMOutput>  output;
         Hyprutils::Memory::CWeakPointer<CDRMBackend>   backend;
@@ -289,6 +507,14 @@ namespace Aquamarine {
         std::string                                    make, serial, model;
         bool                                           canDoVrr = false;
 
+        // from the edid's range limits, 0 if unknown
+        struct {
+            uint32_t minHz = 0, maxHz = 0;
+        } vrrRange;
+
+        // fetchEDID() already ran while probing at startup, the first connectOutputs() uses or drops its result
+        bool                                           edidPrefetched = false;
+
         bool                                           cursorEnabled = false;
         Hyprutils::Math::Vector2D                      cursorPos, cursorSize, cursorHotspot;
         Hyprutils::Memory::CSharedPointer<CDRMFB>      pendingCursorFB;
@@ -297,13 +523,35 @@ namespace Aquamarine {
         SDRMPageFlip                                   pendingPageFlip;
         bool                                           frameEventScheduled = false;
 
+        // a frame is being blitted on the renderer's blit thread, see CDRMOutput::commitAsyncBlit
+        bool                                           isBlitPending = false;
+
+        // cursor-only commits, see IDRMImplementation::commitCursor
+        bool                                           isCursorFlipPending  = false;
+        bool                                           cursorCommitDeferred = false;
+        SDRMPageFlip                                   pendingCursorFlip;
+
+        // release points of the committed buffers, rotated like the primary plane's fbs
+        struct {
+            Hyprutils::Memory::CSharedPointer<CDRMSyncPoint> back, front;
+        } releasePoints;
+
+        // the crtc the last applied commit scanned out on, 0 if it disabled the connector. See IDRMImplementation::restore
+        uint32_t                                       committedCRTC = 0;
+
         // the current state is invalid and won't commit, don't try to modeset.
         bool                                           commitTainted = false;
 
+        // guards the flip state above against the output's own commit thread, see IOutput::setThreadedCommits
+        std::recursive_mutex                           mutex;
+
         Hyprutils::Memory::CSharedPointer<SOutputMode> fallbackMode;
 
         struct {
             bool vrrEnabled = false;
+
+            // last overlay plane assignment that passed a commit, in layer order
+            std::vector<Hyprutils::Memory::CWeakPointer<SDRMPlane>> overlayPlanes;
         } atomic;
 
         union UDRMConnectorProps {
@@ -334,8 +582,19 @@ namespace Aquamarine {
         virtual bool commit(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) = 0;
         virtual bool reset()                                                                                           = 0;
 
+        // puts the last committed state of every connector back in a single blocking commit, e.g. after a vt switch.
+        // False if that state is gone or the kernel refuses it, the caller then has to modeset from scratch.
+        virtual bool restore() = 0;
+
         // moving a cursor IIRC is almost instant on most hardware so we don't have to wait for a commit.
         virtual bool moveCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, bool skipSchedule = false) = 0;
+
+        // commits only the cursor plane (position, visibility and a pending shape), without touching the primary plane or the output state.
+        // If the crtc is busy, the commit is deferred until the next page-flip. Returns false if a full frame is needed instead.
+        virtual bool commitCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector) = 0;
+
+        // commits several connectors in a single request, all or nothing. Connectors are applied, or rolled back, by the caller.
+        virtual bool commitBatch(std::vector<SDRMBatchCommit>& batch) = 0;
     };
 
     class CDRMBackend : public IBackendImplementation {
@@ -365,6 +624,11 @@ namespace Aquamarine {
         std::vector<FIdleCallback>                                         idleCallbacks;
         std::string                                                        gpuName;
 
+        // commits (or tests) the pending states of several outputs of this backend in a single atomic request, so they flip and modeset together.
+        // If a batched commit fails, each output is rolled back and committed on its own. Returns false if any output failed.
+        bool commitOutputs(const std::vector<Hyprutils::Memory::CSharedPointer<IOutput>>& outputs);
+        bool testOutputs(const std::vector<Hyprutils::Memory::CSharedPointer<IOutput>>& outputs);
+
       private:
         CDRMBackend(Hyprutils::Memory::CSharedPointer<CBackend> backend);
 
@@ -374,13 +638,22 @@ namespace Aquamarine {
         bool initResources();
         bool initMgpu();
         bool grabFormats();
+        bool probe(); // the ioctl heavy part of attempt(), only touches this backend so gpus can be probed on their own threads
         bool shouldBlit();
+        // with the copy blitter if it takes the pair, otherwise (or if it fails) with the renderer
+        SDRMBlitResult blit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to, int waitFD = -1,
+                            const Hyprutils::Math::CRegion& damage = {});
         void scanConnectors();
+        void recheckConnector(uint32_t connectorID); // hotplug of a single connector, falls back to recheckOutputs() if it's new or gone
         void scanLeases();
         void restoreAfterVT();
         void recheckOutputs();
+        void connectOutputs(); // recheckOutputs() without the connector scan
         void recheckCRTCs();
         void buildGlFormats(const std::vector<SGLFormat>& fmts);
+        bool commitBatch(const std::vector<Hyprutils::Memory::CSharedPointer<IOutput>>& outputs, bool onlyTest);
+        void updateFrameDeadlines(); // arms the timer for the earliest output frame deadline
+        void dispatchFrameDeadlines();
 
         Hyprutils::Memory::CSharedPointer<CSessionDevice>     gpu;
         Hyprutils::Memory::CSharedPointer<IDRMImplementation> impl;
@@ -388,7 +661,8 @@ namespace Aquamarine {
 
         struct {
             Hyprutils::Memory::CSharedPointer<IAllocator>   allocator;
-            Hyprutils::Memory::CSharedPointer<CDRMRenderer> renderer; // may be null if creation fails
+            Hyprutils::Memory::CSharedPointer<CDRMRenderer> renderer;    // may be null if creation fails
+            Hyprutils::Memory::CSharedPointer<IDRMBlitter>  copyBlitter; // same-size copies on a dedicated copy engine, null if there's none
         } rendererState;
 
         Hyprutils::Memory::CWeakPointer<CBackend>                     backend;
@@ -397,11 +671,45 @@ namespace Aquamarine {
         std::vector<Hyprutils::Memory::CSharedPointer<SDRMPlane>>     planes;
         std::vector<Hyprutils::Memory::CSharedPointer<SDRMConnector>> connectors;
         std::vector<SDRMFormat>                                       formats;
-        std::vector<SDRMFormat>                                       glFormats;
+        CDRMFormatTable                                               glFormats;
 
         Hyprutils::Memory::CSharedPointer<CDRMDumbAllocator>          dumbAllocator;
 
-        bool                                                          atomic = false;
+        bool                                                          atomic              = false;
+        int                                                           frameDeadlineFD     = -1; // timerfd, see CDRMOutput::deadline
+        std::atomic<uint64_t>                                         testCacheGeneration = 0;  // bumped when cached test results may have gone stale
+        std::mutex                                                    cacheMutex;               // fbCache and propertyBlobs, outputs may commit from their own threads
+
+        // identifies a dmabuf and its layout. The inode stays unique while a cached fb keeps the dmabuf alive.
+        struct SFBCacheKey {
+            dev_t                   dev      = 0;
+            ino_t                   ino      = 0;
+            uint32_t                format   = 0, width = 0, height = 0;
+            uint64_t                modifier = 0;
+            std::array<uint32_t, 4> offsets  = {0}, strides = {0};
+
+            bool                    operator==(const SFBCacheKey&) const = default;
+        };
+
+        static std::optional<SFBCacheKey>         fbCacheKey(const SDMABUFAttrs& attrs);
+        Hyprutils::Memory::CSharedPointer<CDRMFB> fbCacheGet(const SFBCacheKey& key);
+        void                                      fbCacheAdd(const SFBCacheKey& key, Hyprutils::Memory::CSharedPointer<CDRMFB> fb);
+        Hyprutils::Memory::CSharedPointer<CDRMFB> fbCacheRemove(CDRMFB* fb); // returns the cache's ref, if it had one
+
+        std::list<std::pair<SFBCacheKey, Hyprutils::Memory::CSharedPointer<CDRMFB>>> fbCache; // most recently used first
+
+        // property blobs by content, so identical modes, luts and ctms share one kernel blob. Unreferenced ones linger a bit for reuse.
+        struct SPropertyBlob {
+            uint32_t             id   = 0;
+            size_t               refs = 0;
+            size_t               hash = 0;
+            std::vector<uint8_t> data;
+        };
+
+        uint32_t                 blobGet(const void* data, size_t len); // takes a ref, 0 on failure
+        void                     blobRelease(uint32_t id);              // blobs not from blobGet are destroyed right away
+
+        std::list<SPropertyBlob> propertyBlobs; // most recently used first
 
         struct {
             Hyprutils::Math::Vector2D cursorSize;
@@ -419,6 +727,7 @@ namespace Aquamarine {
         friend class CBackend;
         friend class CDRMFB;
         friend class CDRMFBAttachment;
+        friend class CDRMSyncPoint;
         friend struct SDRMConnector;
         friend struct SDRMCRTC;
         friend struct SDRMPlane;
@@ -25,10 +25,22 @@ namespace Aquamarine {
       private:
         CHeadlessOutput(const std::string& name_, Hyprutils::Memory::CWeakPointer<CHeadlessBackend> backend_);
 
-        Hyprutils::Memory::CWeakPointer<CHeadlessBackend>        backend;
+        Hyprutils::Memory::CWeakPointer<CHeadlessBackend> backend;
 
-        Hyprutils::Memory::CSharedPointer<std::function<void()>> framecb;
-        bool                                                     frameScheduled = false;
+        bool                                              frameScheduled = false;
+
+        // frames and presents are paced by a virtual vblank at the committed mode's refresh rate
+        struct {
+            std::chrono::steady_clock::time_point last, next;
+            unsigned int                          seq            = 0;
+            unsigned int                          nextSeq        = 0;
+            bool                                  armed          = false;
+            bool                                  presentPending = false; // a buffer was committed since the last vblank
+        } vblank;
+
+        void    armVblank(); // schedules the next virtual vblank, if it isn't already
+        void    onVblank();
+        int64_t refreshPeriodNs();
 
         friend class CHeadlessBackend;
     };
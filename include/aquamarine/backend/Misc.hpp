@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace Aquamarine {
     struct SGLFormat {
@@ -14,4 +16,31 @@ namespace Aquamarine {
         uint32_t              drmFormat = 0; /* DRM_FORMAT_INVALID */
         std::vector<uint64_t> modifiers;
     };
+
+    /* SDRMFormats hashed by format and modifier, for constant time lookups in the long lists planes and renderers report. Built once, then read. */
+    class CDRMFormatTable {
+      public:
+        CDRMFormatTable() = default;
+        CDRMFormatTable(const std::vector<SDRMFormat>& formats_);
+
+        void                           add(uint32_t format, uint64_t modifier); // duplicates are ignored
+
+        bool                           has(uint32_t format) const;
+        bool                           has(uint32_t format, uint64_t modifier) const;
+        const SDRMFormat*              get(uint32_t format) const; // nullptr if missing
+        const std::vector<SDRMFormat>& list() const;               // in the order they were added
+        bool                           empty() const;
+
+        // formats in both, with only the modifiers in both, in this table's order
+        CDRMFormatTable                intersect(const CDRMFormatTable& other) const;
+
+      private:
+        struct SEntry {
+            size_t                       index = 0; // into formats
+            std::unordered_set<uint64_t> modifiers;
+        };
+
+        std::vector<SDRMFormat>              formats;
+        std::unordered_map<uint32_t, SEntry> entries;
+    };
 };
@@ -5,6 +5,7 @@
 #include <hyprutils/memory/SharedPtr.hpp>
 #include "../input/Input.hpp"
 #include <vector>
+#include <optional>
 
 struct udev;
 struct udev_monitor;
@@ -193,6 +194,9 @@ namespace Aquamarine {
         std::vector<Hyprutils::Memory::CSharedPointer<CLibinputTabletTool>> tabletTools;
 
         Hyprutils::Memory::CSharedPointer<CLibinputTabletTool>              toolFrom(libinput_tablet_tool* tool);
+
+        // summed up motion not yet emitted, see CSession::coalescePointerMotion
+        std::optional<IPointer::SMoveEvent>                                 pendingMotion;
     };
 
     class CSession {
@@ -206,6 +210,9 @@ namespace Aquamarine {
         std::string                                                     seatName;
         Hyprutils::Memory::CWeakPointer<CSession>                       self;
 
+        // sum up a device's motion until its next non-motion event or the end of a libinput batch. AQ_COALESCE_POINTER_MOTION sets it.
+        bool                                                            coalescePointerMotion = false;
+
         std::vector<Hyprutils::Memory::CSharedPointer<CSessionDevice>>  sessionDevices;
         std::vector<Hyprutils::Memory::CSharedPointer<CLibinputDevice>> libinputDevices;
 
@@ -237,6 +244,7 @@ namespace Aquamarine {
         void                                                    dispatchLibinputEvents();
         void                                                    dispatchLibseatEvents();
         void                                                    handleLibinputEvent(libinput_event* e);
+        void                                                    flushPointerMotion();
 
         friend class CSessionDevice;
         friend class CLibinputDevice;
@@ -9,7 +9,10 @@
 #include <wayland.hpp>
 #include <xdg-shell.hpp>
 #include <linux-dmabuf-v1.hpp>
+#include <presentation-time.hpp>
 #include <tuple>
+#include <unordered_map>
+#include <ctime>
 
 namespace Aquamarine {
     class CBackend;
@@ -19,6 +22,24 @@ namespace Aquamarine {
 
     typedef std::function<void(void)> FIdleCallback;
 
+    // a zwp_linux_dmabuf_feedback_v1's state, tranches are in the host's order of preference
+    struct SWaylandDmabufFeedback {
+        struct STranche {
+            std::vector<SDRMFormat> formats;
+            bool                    scanout = false; // the host can put these on a plane
+        };
+
+        std::vector<std::pair<uint32_t, uint64_t>> table; // format, modifier
+        std::vector<STranche>                      tranches;
+
+        // before done
+        std::vector<STranche> pendingTranches;
+        STranche              pendingTranche;
+
+        // merged, in order of preference
+        std::vector<SDRMFormat> formats(bool scanoutOnly = false) const;
+    };
+
     class CWaylandBuffer {
       public:
         CWaylandBuffer(Hyprutils::Memory::CSharedPointer<IBuffer> buffer_, Hyprutils::Memory::CWeakPointer<CWaylandBackend> backend_);
@@ -51,6 +72,9 @@ namespace Aquamarine {
         virtual bool                                                      destroy();
         virtual std::vector<SDRMFormat>                                   getRenderFormats();
 
+        // formats the host can scan out for our surface, empty if it can't or hasn't said so
+        std::vector<SDRMFormat>                                           getScanoutFormats();
+
         Hyprutils::Memory::CWeakPointer<CWaylandOutput>                   self;
 
       private:
@@ -63,14 +87,25 @@ namespace Aquamarine {
         void                                              sendFrameAndSetCallback();
         void                                              onFrameDone();
         void                                              onEnter(Hyprutils::Memory::CSharedPointer<CCWlPointer> pointer, uint32_t serial);
+        void                                              sendDamage(const Hyprutils::Math::Vector2D& pixelSize);
+        void                                              requestPresentFeedback();
 
         // frame loop
         bool frameScheduledWhileWaiting = false;
         bool readyForFrameCallback      = false; // true after attaching a buffer
         bool frameScheduled             = false;
 
+        // the host only keeps what's outside the damage if the buffer size stayed the same
+        Hyprutils::Math::Vector2D lastBufferSize;
+
+        struct SBufferEntry {
+            Hyprutils::Memory::CWeakPointer<IBuffer>          buffer; // the key alone could be a reused address
+            Hyprutils::Memory::CSharedPointer<CWaylandBuffer> wlBuffer;
+            Hyprutils::Signal::CHyprSignalListener            destroy;
+        };
+
         struct {
-            std::vector<std::pair<Hyprutils::Memory::CWeakPointer<IBuffer>, Hyprutils::Memory::CSharedPointer<CWaylandBuffer>>> buffers;
+            std::unordered_map<IBuffer*, SBufferEntry> buffers; // evicted when the buffer is destroyed
         } backendState;
 
         struct {
@@ -82,12 +117,16 @@ namespace Aquamarine {
         } cursorState;
 
         struct {
-            Hyprutils::Memory::CSharedPointer<CCWlSurface>   surface;
-            Hyprutils::Memory::CSharedPointer<CCXdgSurface>  xdgSurface;
-            Hyprutils::Memory::CSharedPointer<CCXdgToplevel> xdgToplevel;
-            Hyprutils::Memory::CSharedPointer<CCWlCallback>  frameCallback;
+            Hyprutils::Memory::CSharedPointer<CCWlSurface>                           surface;
+            Hyprutils::Memory::CSharedPointer<CCXdgSurface>                          xdgSurface;
+            Hyprutils::Memory::CSharedPointer<CCXdgToplevel>                         xdgToplevel;
+            Hyprutils::Memory::CSharedPointer<CCWlCallback>                          frameCallback;
+            std::vector<Hyprutils::Memory::CSharedPointer<CCWpPresentationFeedback>> presentFeedbacks; // one per commit, until presented or discarded
+            Hyprutils::Memory::CSharedPointer<CCZwpLinuxDmabufFeedbackV1>            dmabufFeedback;   // for our surface
         } waylandState;
 
+        SWaylandDmabufFeedback dmabufFeedback;
+
         friend class CWaylandBackend;
         friend class CWaylandPointer;
     };
@@ -145,6 +184,7 @@ namespace Aquamarine {
         void initSeat();
         void initShell();
         bool initDmabuf();
+        void listenDmabufFeedback(Hyprutils::Memory::CSharedPointer<CCZwpLinuxDmabufFeedbackV1> feedback, SWaylandDmabufFeedback* state, std::function<void()> onDone);
 
         //
         Hyprutils::Memory::CWeakPointer<CBackend>                        backend;
@@ -162,6 +202,7 @@ namespace Aquamarine {
 
         // dmabuf formats
         std::vector<SDRMFormat> dmabufFormats;
+        SWaylandDmabufFeedback  defaultFeedback;
 
         struct {
             wl_display* display = nullptr;
@@ -174,9 +215,11 @@ namespace Aquamarine {
             Hyprutils::Memory::CSharedPointer<CCWlCompositor>             compositor;
             Hyprutils::Memory::CSharedPointer<CCZwpLinuxDmabufV1>         dmabuf;
             Hyprutils::Memory::CSharedPointer<CCZwpLinuxDmabufFeedbackV1> dmabufFeedback;
+            Hyprutils::Memory::CSharedPointer<CCWpPresentation>           presentation; // optional
 
             // control
-            bool dmabufFailed = false;
+            bool     dmabufFailed = false;
+            uint32_t presentClock = CLOCK_MONOTONIC; // wp_presentation timestamps are only passed on in our clock
         } waylandState;
 
         struct {
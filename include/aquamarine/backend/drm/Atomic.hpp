@@ -8,11 +8,18 @@ namespace Aquamarine {
         CDRMAtomicImpl(Hyprutils::Memory::CSharedPointer<CDRMBackend> backend_);
         virtual bool commit(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
         virtual bool reset();
+        virtual bool restore();
         virtual bool moveCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, bool skipSchedule = false);
+        virtual bool commitCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector);
+        virtual bool commitBatch(std::vector<SDRMBatchCommit>& batch);
 
       private:
         bool                                         prepareConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
 
+        // picks an overlay plane for every layer in data, using TEST_ONLY commits. False if some layer can't be scanned out.
+        bool                                         assignOverlays(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
+        bool                                         testOverlays(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
+
         Hyprutils::Memory::CWeakPointer<CDRMBackend> backend;
 
         friend class CDRMAtomicRequest;
@@ -24,12 +31,17 @@ namespace Aquamarine {
         ~CDRMAtomicRequest();
 
         void addConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
+        void addCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, Hyprutils::Memory::CSharedPointer<CDRMFB> fb);
         bool commit(uint32_t flagssss);
         void add(uint32_t id, uint32_t prop, uint64_t val);
         void planeProps(Hyprutils::Memory::CSharedPointer<SDRMPlane> plane, Hyprutils::Memory::CSharedPointer<CDRMFB> fb, uint32_t crtc, Hyprutils::Math::Vector2D pos);
+        void planeProps(Hyprutils::Memory::CSharedPointer<SDRMPlane> plane, Hyprutils::Memory::CSharedPointer<CDRMFB> fb, uint32_t crtc, const Hyprutils::Math::CBox& src,
+                        const Hyprutils::Math::CBox& dst);
+        // the crtc's primary plane showing fb, scaled to the mode when the state has a render size
+        void primaryPlaneProps(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, Hyprutils::Memory::CSharedPointer<CDRMFB> fb, const COutputState::SInternalState& state);
 
-        void rollback(SDRMConnectorCommitData& data);
-        void apply(SDRMConnectorCommitData& data);
+        void rollback(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
+        void apply(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
 
         bool failed = false;
 
@@ -41,5 +53,6 @@ namespace Aquamarine {
         Hyprutils::Memory::CWeakPointer<CDRMBackend>     backend;
         drmModeAtomicReq*                                req = nullptr;
         Hyprutils::Memory::CSharedPointer<SDRMConnector> conn;
+        bool                                             cursorOnly = false;
     };
 };
@@ -8,11 +8,16 @@ namespace Aquamarine {
         CDRMLegacyImpl(Hyprutils::Memory::CSharedPointer<CDRMBackend> backend_);
         virtual bool commit(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
         virtual bool reset();
+        virtual bool restore();
         virtual bool moveCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, bool skipSchedule = false);
+        virtual bool commitCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector);
+        virtual bool commitBatch(std::vector<SDRMBatchCommit>& batch);
 
       private:
         bool                                         commitInternal(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
         bool                                         testInternal(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data);
+        bool                                         setCursorFB(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, Hyprutils::Memory::CSharedPointer<CDRMFB> fb);
+        bool                                         hideCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector);
 
         Hyprutils::Memory::CWeakPointer<CDRMBackend> backend;
     };
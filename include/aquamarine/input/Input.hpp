@@ -2,6 +2,7 @@
 
 #include <hyprutils/signal/Signal.hpp>
 #include <hyprutils/math/Vector2D.hpp>
+#include "../misc/Signal.hpp"
 
 struct libinput_device;
 
@@ -28,9 +29,9 @@ namespace Aquamarine {
         };
 
         struct {
-            Hyprutils::Signal::CSignal destroy;
-            Hyprutils::Signal::CSignal key;
-            Hyprutils::Signal::CSignal modifiers;
+            Hyprutils::Signal::CSignal    destroy;
+            CTypedSignal<SKeyEvent>       key;
+            CTypedSignal<SModifiersEvent> modifiers;
         } events;
     };
 
@@ -63,6 +64,10 @@ namespace Aquamarine {
         struct SMoveEvent {
             uint32_t                  timeMs = 0;
             Hyprutils::Math::Vector2D delta, unaccel;
+
+            // more than one when coalesced, see CSession::coalescePointerMotion
+            uint32_t samples = 1;
+            uint64_t firstUs = 0, lastUs = 0; // timestamps of the first and the last sample
         };
 
         struct SWarpEvent {
@@ -128,23 +133,23 @@ namespace Aquamarine {
         };
 
         struct {
-            Hyprutils::Signal::CSignal destroy;
-            Hyprutils::Signal::CSignal move;
-            Hyprutils::Signal::CSignal warp;
-            Hyprutils::Signal::CSignal button;
-            Hyprutils::Signal::CSignal axis;
-            Hyprutils::Signal::CSignal frame;
-
-            Hyprutils::Signal::CSignal swipeBegin;
-            Hyprutils::Signal::CSignal swipeUpdate;
-            Hyprutils::Signal::CSignal swipeEnd;
-
-            Hyprutils::Signal::CSignal pinchBegin;
-            Hyprutils::Signal::CSignal pinchUpdate;
-            Hyprutils::Signal::CSignal pinchEnd;
-
-            Hyprutils::Signal::CSignal holdBegin;
-            Hyprutils::Signal::CSignal holdEnd;
+            Hyprutils::Signal::CSignal      destroy;
+            CTypedSignal<SMoveEvent>        move;
+            CTypedSignal<SWarpEvent>        warp;
+            CTypedSignal<SButtonEvent>      button;
+            CTypedSignal<SAxisEvent>        axis;
+            Hyprutils::Signal::CSignal      frame;
+
+            CTypedSignal<SSwipeBeginEvent>  swipeBegin;
+            CTypedSignal<SSwipeUpdateEvent> swipeUpdate;
+            CTypedSignal<SSwipeEndEvent>    swipeEnd;
+
+            CTypedSignal<SPinchBeginEvent>  pinchBegin;
+            CTypedSignal<SPinchUpdateEvent> pinchUpdate;
+            CTypedSignal<SPinchEndEvent>    pinchEnd;
+
+            CTypedSignal<SHoldBeginEvent>   holdBegin;
+            CTypedSignal<SHoldEndEvent>     holdEnd;
         } events;
     };
 
@@ -183,10 +188,10 @@ namespace Aquamarine {
 
         struct {
             Hyprutils::Signal::CSignal destroy;
-            Hyprutils::Signal::CSignal move;
-            Hyprutils::Signal::CSignal down;
-            Hyprutils::Signal::CSignal up;
-            Hyprutils::Signal::CSignal cancel;
+            CTypedSignal<SMotionEvent> move;
+            CTypedSignal<SDownEvent>   down;
+            CTypedSignal<SUpEvent>     up;
+            CTypedSignal<SCancelEvent> cancel;
             Hyprutils::Signal::CSignal frame;
         } events;
     };
@@ -214,7 +219,7 @@ namespace Aquamarine {
 
         struct {
             Hyprutils::Signal::CSignal destroy;
-            Hyprutils::Signal::CSignal fire;
+            CTypedSignal<SFireEvent>   fire;
         } events;
     };
 
@@ -277,11 +282,11 @@ namespace Aquamarine {
         };
 
         struct {
-            Hyprutils::Signal::CSignal axis;
-            Hyprutils::Signal::CSignal proximity;
-            Hyprutils::Signal::CSignal tip;
-            Hyprutils::Signal::CSignal button;
-            Hyprutils::Signal::CSignal destroy;
+            CTypedSignal<SAxisEvent>      axis;
+            CTypedSignal<SProximityEvent> proximity;
+            CTypedSignal<STipEvent>       tip;
+            CTypedSignal<SButtonEvent>    button;
+            Hyprutils::Signal::CSignal    destroy;
         } events;
     };
 
@@ -380,9 +385,9 @@ namespace Aquamarine {
 
         struct {
             Hyprutils::Signal::CSignal destroy;
-            Hyprutils::Signal::CSignal button;
-            Hyprutils::Signal::CSignal ring;
-            Hyprutils::Signal::CSignal strip;
+            CTypedSignal<SButtonEvent> button;
+            CTypedSignal<SRingEvent>   ring;
+            CTypedSignal<SStripEvent>  strip;
             Hyprutils::Signal::CSignal attach;
         } events;
     };
@@ -8,8 +8,17 @@ namespace Aquamarine {
         AQ_ATTACHMENT_DRM_BUFFER = 0,
         AQ_ATTACHMENT_DRM_KMS_UNIMPORTABLE,
         AQ_ATTACHMENT_DRM_RENDERER_DATA,
+        AQ_ATTACHMENT_DRM_VULKAN_DATA,
+
+        // types from CAttachmentManager::registerType() start here
+        AQ_ATTACHMENT_CUSTOM = 16,
     };
 
+    /*
+        An attachment lives in a slot for its type, so a buffer holds at most one of each.
+        For get<T>(), implementations expose their type as a static TYPE member. Consumers can use
+        static inline const eAttachmentType TYPE = CAttachmentManager::registerType();
+    */
     class IAttachment {
       public:
         virtual ~IAttachment() {
@@ -23,12 +32,24 @@ namespace Aquamarine {
       public:
         bool                                           has(eAttachmentType type);
         Hyprutils::Memory::CSharedPointer<IAttachment> get(eAttachmentType type);
+        // replaces an attachment of the same type, if any
         void                                           add(Hyprutils::Memory::CSharedPointer<IAttachment> attachment);
         void                                           remove(Hyprutils::Memory::CSharedPointer<IAttachment> attachment);
         void                                           removeByType(eAttachmentType type);
         void                                           clear();
 
+        // returns a new type for a consumer-defined attachment, unique for the process' lifetime
+        static eAttachmentType registerType();
+
+        // the attachment of T::TYPE, or nullptr. Valid as long as it stays attached.
+        template <typename T>
+        T* get() {
+            return static_cast<T*>(rawGet(T::TYPE));
+        }
+
       private:
-        std::vector<Hyprutils::Memory::CSharedPointer<IAttachment>> attachments;
+        IAttachment*                                                rawGet(eAttachmentType type);
+
+        std::vector<Hyprutils::Memory::CSharedPointer<IAttachment>> attachments; // indexed by type
     };
 };
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <any>
+#include <functional>
+#include <vector>
+#include <hyprutils/signal/Signal.hpp>
+#include <hyprutils/memory/SharedPtr.hpp>
+#include <hyprutils/memory/WeakPtr.hpp>
+
+namespace Aquamarine {
+    template <typename T>
+    class CTypedSignal;
+
+    template <typename T>
+    class CTypedSignalListener {
+      public:
+        CTypedSignalListener(std::function<void(const T&)> handler_) : handler(std::move(handler_)) {
+            ;
+        }
+
+      private:
+        std::function<void(const T&)> handler;
+
+        friend class CTypedSignal<T>;
+    };
+
+    // unregisters itself once the last reference is gone
+    template <typename T>
+    using CTypedListener = Hyprutils::Memory::CSharedPointer<CTypedSignalListener<T>>;
+
+    /*
+        A signal with a T payload. listen() handlers get it by const reference.
+        registerListener() / registerStaticListener() are kept for CSignal users, their handlers get a std::any copy. The copy is only made
+        once one of those was registered, an emit with listen() handlers only doesn't box or allocate.
+    */
+    template <typename T>
+    class CTypedSignal {
+      public:
+        [[nodiscard("Listener is unregistered when the ptr is lost")]] CTypedListener<T> listen(std::function<void(const T&)> handler) {
+            auto listener = Hyprutils::Memory::makeShared<CTypedSignalListener<T>>(std::move(handler));
+            listeners.emplace_back(listener);
+            return listener;
+        }
+
+        void emit(const T& data) {
+            emitting++;
+
+            // by index, a handler may add listeners
+            for (size_t i = 0; i < listeners.size(); ++i) {
+                auto l = listeners[i].lock();
+                if (!l) {
+                    expired = true;
+                    continue;
+                }
+
+                l->handler(data);
+            }
+
+            emitting--;
+
+            if (expired && !emitting) {
+                std::erase_if(listeners, [](const auto& l) { return l.expired(); });
+                expired = false;
+            }
+
+            if (untyped)
+                compat.emit(data);
+        }
+
+        [[nodiscard("Listener is unregistered when the ptr is lost")]] Hyprutils::Signal::CHyprSignalListener registerListener(std::function<void(std::any d)> handler) {
+            untyped = true;
+            return compat.registerListener(std::move(handler));
+        }
+
+        void registerStaticListener(std::function<void(void*, std::any)> handler, void* owner) {
+            untyped = true;
+            compat.registerStaticListener(std::move(handler), owner);
+        }
+
+      private:
+        std::vector<Hyprutils::Memory::CWeakPointer<CTypedSignalListener<T>>> listeners;
+        size_t                                                                emitting = 0;
+        bool                                                                  expired  = false;
+
+        // not a base: CSignal's register methods aren't virtual, a listener made through a CSignal& would go unnoticed
+        Hyprutils::Signal::CSignal compat;
+        bool                       untyped = false; // something registered on compat, emit() boxes for it
+    };
+};
@@ -2,15 +2,19 @@
 
 #include <vector>
 #include <optional>
+#include <array>
+#include <atomic>
 #include <hyprutils/signal/Signal.hpp>
 #include <hyprutils/memory/SharedPtr.hpp>
 #include <hyprutils/math/Region.hpp>
 #include <hyprutils/math/Mat3x3.hpp>
+#include <hyprutils/math/Box.hpp>
 #include <drm_fourcc.h>
 #include <xf86drmMode.h>
 #include "../allocator/Swapchain.hpp"
 #include "../buffer/Buffer.hpp"
 #include "../backend/Misc.hpp"
+#include "../misc/Signal.hpp"
 
 namespace Aquamarine {
 
@@ -26,6 +30,7 @@ namespace Aquamarine {
     enum eOutputPresentationMode : uint32_t {
         AQ_OUTPUT_PRESENTATION_VSYNC = 0,
         AQ_OUTPUT_PRESENTATION_IMMEDIATE, // likely tearing
+        AQ_OUTPUT_PRESENTATION_MAILBOX,   // vsync, but a frame committed while a flip is pending replaces the queued one instead of failing. Like vsync where unsupported
     };
 
     enum eSubpixelMode : uint32_t {
@@ -39,6 +44,17 @@ namespace Aquamarine {
 
     class IOutput;
 
+    struct SOutputLayer {
+        Hyprutils::Memory::CSharedPointer<IBuffer> buffer;
+        Hyprutils::Math::CBox                      src; // in buffer pixels. Empty means the whole buffer
+        Hyprutils::Math::CBox                      dst; // in output pixels
+    };
+
+    struct SOutputTimelinePoint {
+        int32_t  timelineFD = -1; // a drm_syncobj timeline
+        uint64_t point      = 0;
+    };
+
     class COutputState {
       public:
         enum eOutputStateProperties : uint32_t {
@@ -53,6 +69,10 @@ namespace Aquamarine {
             AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE  = (1 << 8),
             AQ_OUTPUT_STATE_EXPLICIT_OUT_FENCE = (1 << 9),
             AQ_OUTPUT_STATE_CTM                = (1 << 10),
+            AQ_OUTPUT_STATE_LAYERS             = (1 << 11),
+            AQ_OUTPUT_STATE_ACQUIRE_POINT      = (1 << 12),
+            AQ_OUTPUT_STATE_RELEASE_POINT      = (1 << 13),
+            AQ_OUTPUT_STATE_RENDER_SIZE        = (1 << 14),
         };
 
         struct SInternalState {
@@ -69,7 +89,10 @@ namespace Aquamarine {
             uint32_t                                       drmFormat = DRM_FORMAT_INVALID;
             Hyprutils::Memory::CSharedPointer<IBuffer>     buffer;
             int32_t                                        explicitInFence = -1, explicitOutFence = -1;
+            SOutputTimelinePoint                           acquirePoint, releasePoint;
             Hyprutils::Math::Mat3x3                        ctm;
+            std::vector<SOutputLayer>                      layers;     // extra layers above the buffer, bottom to top
+            Hyprutils::Math::Vector2D                      renderSize; // size of the buffer, scaled to the mode when scanned out. Empty for the mode's size
         };
 
         const SInternalState& state();
@@ -87,7 +110,11 @@ namespace Aquamarine {
         void                  setExplicitInFence(int32_t fenceFD); // -1 removes
         void                  enableExplicitOutFenceForNextCommit();
         void                  resetExplicitFences();
+        void                  setAcquirePoint(int32_t timelineFD, uint64_t point); // the buffer is ready once this is signalled, -1 removes
+        void                  setReleasePoint(int32_t timelineFD, uint64_t point); // signalled once the buffer is no longer scanned out, -1 removes
         void                  setCTM(const Hyprutils::Math::Mat3x3& ctm);
+        void                  setLayers(const std::vector<SOutputLayer>& layers); // empty removes
+        void                  setRenderSize(const Hyprutils::Math::Vector2D& size); // buffers of size scaled to the mode by the display, empty removes. DRM atomic only
 
       private:
         SInternalState internalState;
@@ -100,6 +127,59 @@ namespace Aquamarine {
         friend class CHeadlessOutput;
     };
 
+    struct SOutputStats {
+        uint64_t                commits = 0, failedCommits = 0, failedTests = 0, modesetRetries = 0;
+        uint64_t                presents = 0, missedVblanks = 0;
+        std::array<uint64_t, 8> presentLatency = {0};                       // commit to present, bucket i counts latencies under 2^i ms, the last one everything slower
+        uint64_t                blits = 0, blitCPUNs = 0, blitGPUNs = 0;    // totals. GPU time is only measured where timer queries are supported
+        uint64_t                testCacheHits = 0, testCacheMisses = 0;     // tests answered without asking the backend, and the ones that weren't
+        uint64_t                repeatedFrames = 0;                         // flips of an unchanged frame, to keep vrr in the panel's range
+        uint64_t                cursorCacheHits = 0, cursorCacheMisses = 0; // cursor images that were already prepared for the plane, and the ones that weren't
+        uint64_t                swapchainGrows = 0, swapchainShrinks = 0;   // length changes made by the swapchain's depth policy
+        uint64_t                swapchainLength = 0;                        // after the last of them, 0 if none yet
+    };
+
+    /* Lock-free counters, cheap to update and safe to sample from any thread. Backends fill in what they can. */
+    class COutputStats {
+      public:
+        SOutputStats snapshot() const;
+
+        void         onCommit(bool test, bool ok);
+        void         onModesetRetry();
+        void         onPresent(uint64_t latencyNs, uint64_t missed);
+        void         onBlit(uint64_t cpuNs, std::optional<uint64_t> gpuNs);
+        void         onTestCache(bool hit);
+        void         onRepeatedFrame();
+        void         onCursorCache(bool hit);
+        void         onSwapchainDepth(size_t oldLength, size_t newLength);
+
+      private:
+        std::atomic<uint64_t>                commits = 0, failedCommits = 0, failedTests = 0, modesetRetries = 0;
+        std::atomic<uint64_t>                presents = 0, missedVblanks = 0;
+        std::array<std::atomic<uint64_t>, 8> presentLatency = {};
+        std::atomic<uint64_t>                blits = 0, blitCPUNs = 0, blitGPUNs = 0;
+        std::atomic<uint64_t>                testCacheHits = 0, testCacheMisses = 0;
+        std::atomic<uint64_t>                repeatedFrames = 0;
+        std::atomic<uint64_t>                cursorCacheHits = 0, cursorCacheMisses = 0;
+        std::atomic<uint64_t>                swapchainGrows = 0, swapchainShrinks = 0, swapchainLength = 0;
+    };
+
+    /*
+        What an output has on screen, see IOutput::capture. No copy is made: the buffers stay locked until this is dropped, which keeps
+        swapchains from handing them out for rendering again.
+    */
+    class COutputCapture {
+      public:
+        COutputCapture(Hyprutils::Memory::CSharedPointer<IBuffer> buffer_);
+        ~COutputCapture();
+
+        Hyprutils::Memory::CSharedPointer<IBuffer> buffer; // scanned out, read only
+        SDMABUFAttrs                               dmabuf;
+        Hyprutils::Math::CRegion                   damage;           // since the previous capture, in buffer coordinates
+        Hyprutils::Memory::CSharedPointer<IBuffer> scaled;           // downscaled copy, if one was asked for and could be made
+        int                                        scaledFence = -1; // sync file signalled once scaled is written, -1 if it already is. Owned
+    };
+
     class IOutput {
       public:
         virtual ~IOutput();
@@ -130,7 +210,28 @@ namespace Aquamarine {
         virtual Hyprutils::Math::Vector2D                                 cursorPlaneSize();              // -1, -1 means no set size, 0, 0 means error
         virtual void                                                      scheduleFrame(const scheduleFrameReason reason = AQ_SCHEDULE_UNKNOWN);
         virtual size_t                                                    getGammaSize();
+        virtual size_t                                                    maxLayers(); // how many extra layers can be scanned out directly, 0 if none
         virtual bool                                                      destroy(); // not all backends allow this!!!
+        virtual bool                                                      setFrameDeadline(bool enabled, uint64_t budgetNs = 0); // frame at next vblank - budget, 0 = learn it
+        virtual void                                                      reportRenderTime(uint64_t ns);                          // feeds the learned budget
+
+        /*
+            Zero-copy access to the presented frame, e.g. for screencasting, nullptr if there's none or the backend can't.
+            A scaledSize also has the backend blit a copy at that size, for encoders that want less. Call it from the thread that commits.
+        */
+        virtual Hyprutils::Memory::CSharedPointer<COutputCapture>         capture(const Hyprutils::Math::Vector2D& scaledSize = {});
+
+        /*
+            Commit this output from a thread of your own. Present and frame events are then queued, and emitted on whichever thread calls
+            dispatchThreadedEvents() once threadedEventFD() is readable. Stop that thread in the destroy handler.
+            Returns false if the backend can't, e.g. for outputs that need a blit.
+        */
+        virtual bool                                                      setThreadedCommits(bool enabled);
+        virtual int                                                       threadedEventFD(); // -1 when not threaded
+        virtual void                                                      dispatchThreadedEvents();
+
+        // for backends: feeds the swapchain's depth policy (see CSwapchain::setDepthPolicy), and counts what it changed in stats
+        void                                                              swapchainFeedback(bool late);
 
         std::string                                                       name, description, make, model, serial;
         Hyprutils::Math::Vector2D                                         physicalSize;
@@ -139,7 +240,7 @@ namespace Aquamarine {
         eSubpixelMode                                                     subpixel   = AQ_SUBPIXEL_NONE;
         bool                                                              vrrCapable = false, vrrActive = false;
         bool                                                              needsFrame       = false;
-        bool                                                              supportsExplicit = false;
+        bool                                                              supportsExplicit = false; // explicit fences and timeline points
 
         //
         std::vector<Hyprutils::Memory::CSharedPointer<SOutputMode>> modes;
@@ -147,6 +248,8 @@ namespace Aquamarine {
 
         Hyprutils::Memory::CSharedPointer<CSwapchain>               swapchain;
 
+        COutputStats                                                stats;
+
         //
 
         enum eOutputPresentFlags : uint32_t {
@@ -168,12 +271,12 @@ namespace Aquamarine {
         };
 
         struct {
-            Hyprutils::Signal::CSignal destroy;
-            Hyprutils::Signal::CSignal frame;
-            Hyprutils::Signal::CSignal needsFrame;
-            Hyprutils::Signal::CSignal present;
-            Hyprutils::Signal::CSignal commit;
-            Hyprutils::Signal::CSignal state;
+            Hyprutils::Signal::CSignal  destroy;
+            Hyprutils::Signal::CSignal  frame;
+            Hyprutils::Signal::CSignal  needsFrame;
+            CTypedSignal<SPresentEvent> present;
+            Hyprutils::Signal::CSignal  commit;
+            Hyprutils::Signal::CSignal  state;
         } events;
     };
 }
@@ -0,0 +1,128 @@
+#include <aquamarine/allocator/BufferPool.hpp>
+#include <aquamarine/allocator/Swapchain.hpp>
+#include <aquamarine/backend/Backend.hpp>
+#include <aquamarine/output/Output.hpp>
+#include <algorithm>
+
+using namespace Aquamarine;
+using namespace Hyprutils::Memory;
+#define SP CSharedPointer
+
+static size_t bufferBytes(SP<IBuffer> buffer) {
+    const auto ATTRS = buffer->dmabuf();
+    if (!ATTRS.success)
+        return 0;
+
+    size_t bytes = 0;
+    for (int i = 0; i < ATTRS.planes; ++i) {
+        bytes += (size_t)ATTRS.strides.at(i) * (size_t)ATTRS.size.y;
+    }
+
+    return bytes;
+}
+
+bool Aquamarine::CBufferPool::SKey::matches(const SKey& other) const {
+    return params.size == other.params.size && params.format == other.params.format && params.scanout == other.params.scanout && params.cursor == other.params.cursor &&
+        params.multigpu == other.params.multigpu && backend == other.backend && scanoutOutput == other.scanoutOutput;
+}
+
+Aquamarine::CBufferPool::CBufferPool(FAllocate allocate_) : allocate(allocate_) {
+    ;
+}
+
+CBufferPool::SKey Aquamarine::CBufferPool::keyFor(const SAllocatorBufferParams& params, SP<CSwapchain> swapchain) {
+    return SKey{
+        .params        = params,
+        .backend       = swapchain ? swapchain->backendImpl : CWeakPointer<IBackendImplementation>{},
+        .scanoutOutput = swapchain ? swapchain->currentOptions().scanoutOutput : CWeakPointer<IOutput>{},
+    };
+}
+
+SP<IBuffer> Aquamarine::CBufferPool::acquire(const SAllocatorBufferParams& params, SP<CSwapchain> swapchain) {
+    if (auto buffer = take(params, swapchain); buffer)
+        return buffer;
+
+    return allocate(params, swapchain);
+}
+
+SP<IBuffer> Aquamarine::CBufferPool::take(const SAllocatorBufferParams& params, SP<CSwapchain> swapchain) {
+    const auto KEY = keyFor(params, swapchain);
+
+    // newest first, those are the most likely to be warm
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        if (!it->key.matches(KEY))
+            continue;
+
+        auto buffer = it->buffer;
+        entries.erase(std::next(it).base());
+
+        counters.hits++;
+        return buffer;
+    }
+
+    counters.misses++;
+    return nullptr;
+}
+
+void Aquamarine::CBufferPool::recycle(SP<IBuffer> buffer, const SAllocatorBufferParams& params, SP<CSwapchain> swapchain) {
+    // a backend still scans it out, it can't be handed out again
+    if (!buffer || !buffer->good() || buffer->lockedByBackend || maxBytes == 0)
+        return;
+
+    add(SEntry{.key = keyFor(params, swapchain), .buffer = buffer, .bytes = bufferBytes(buffer)});
+}
+
+bool Aquamarine::CBufferPool::prewarm(const SAllocatorBufferParams& params, SP<CSwapchain> swapchain, size_t count) {
+    const auto KEY  = keyFor(params, swapchain);
+    size_t     have = std::count_if(entries.begin(), entries.end(), [&KEY](const auto& e) { return e.key.matches(KEY); });
+
+    for (; have < count; ++have) {
+        auto buffer = allocate(params, swapchain);
+        if (!buffer)
+            return false;
+
+        add(SEntry{.key = KEY, .buffer = buffer, .bytes = bufferBytes(buffer)});
+    }
+
+    return true;
+}
+
+void Aquamarine::CBufferPool::add(SEntry&& entry) {
+    entries.emplace_back(std::move(entry));
+    trim();
+}
+
+void Aquamarine::CBufferPool::trim() {
+    size_t bytes = 0;
+    for (auto const& e : entries) {
+        bytes += e.bytes;
+    }
+
+    size_t drop = 0;
+    while (drop < entries.size() && bytes > maxBytes) {
+        bytes -= entries.at(drop).bytes;
+        drop++;
+    }
+
+    if (drop > 0)
+        entries.erase(entries.begin(), entries.begin() + drop);
+}
+
+void Aquamarine::CBufferPool::setMaxBytes(size_t bytes) {
+    maxBytes = bytes;
+    trim();
+}
+
+void Aquamarine::CBufferPool::clear() {
+    entries.clear();
+}
+
+SBufferPoolStats Aquamarine::CBufferPool::stats() {
+    SBufferPoolStats result = counters;
+    result.buffers          = entries.size();
+    for (auto const& e : entries) {
+        result.bytes += e.bytes;
+    }
+
+    return result;
+}
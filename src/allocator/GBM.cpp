@@ -63,8 +63,43 @@ static SDRMFormat guessFormatFrom(std::vector<SDRMFormat> formats, bool cursor,
     return formats.at(0);
 }
 
+static bool isIntelCCS(uint64_t modifier) {
+    switch (modifier) {
+        case I915_FORMAT_MOD_Y_TILED_CCS:
+        case I915_FORMAT_MOD_Yf_TILED_CCS:
+        case I915_FORMAT_MOD_Y_TILED_GEN12_RC_CCS:
+        case I915_FORMAT_MOD_Y_TILED_GEN12_RC_CCS_CC:
+#ifdef I915_FORMAT_MOD_4_TILED_DG2_RC_CCS
+        case I915_FORMAT_MOD_4_TILED_DG2_RC_CCS:
+        case I915_FORMAT_MOD_4_TILED_DG2_RC_CCS_CC:
+#endif
+#ifdef I915_FORMAT_MOD_4_TILED_MTL_RC_CCS
+        case I915_FORMAT_MOD_4_TILED_MTL_RC_CCS:
+        case I915_FORMAT_MOD_4_TILED_MTL_RC_CCS_CC:
+#endif
+            return true;
+        default: return false;
+    }
+}
+
+// higher is less memory bandwidth: compressed > tiled > linear
+static int modifierScore(uint64_t modifier) {
+    if (modifier == DRM_FORMAT_MOD_LINEAR)
+        return 0;
+
+    const uint64_t VENDOR = modifier >> 56;
+
+    if (VENDOR == DRM_FORMAT_MOD_VENDOR_AMD && AMD_FMT_MOD_GET(DCC, modifier))
+        return 2;
+
+    if (VENDOR == DRM_FORMAT_MOD_VENDOR_INTEL && isIntelCCS(modifier))
+        return 2;
+
+    return 1;
+}
+
 Aquamarine::CGBMBuffer::CGBMBuffer(const SAllocatorBufferParams& params, Hyprutils::Memory::CWeakPointer<CGBMAllocator> allocator_,
-                                   Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain) : allocator(allocator_) {
+                                   Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain, bool deferBO) : allocator(allocator_) {
     if (!allocator)
         return;
 
@@ -103,36 +138,54 @@ Aquamarine::CGBMBuffer::CGBMBuffer(const SAllocatorBufferParams& params, Hypruti
         return;
     }
 
+    // drm outputs have their primary plane's formats intersected with the renderer's already
+    SP<SDRMPlane> scanoutPlane;
+    if (EXPLICIT_SCANOUT && !CURSOR && !MULTIGPU && swapchain->backendImpl->type() == AQ_BACKEND_DRM) {
+        if (const auto OUTPUT = (CDRMOutput*)swapchain->currentOptions().scanoutOutput.get(); OUTPUT->connector->crtc)
+            scanoutPlane = OUTPUT->connector->crtc->primary;
+    }
+
     bool foundFormat = false;
-    // check if we can use modifiers. If the requested support has any explicit modifier
-    // supported by the primary backend, we can.
-    for (auto const& f : FORMATS) {
-        if (f.drmFormat != attrs.format)
-            continue;
+    if (scanoutPlane) {
+        foundFormat = scanoutPlane->formats.has(attrs.format);
 
-        foundFormat = true;
-        for (auto const& m : f.modifiers) {
-            if (m == DRM_FORMAT_MOD_INVALID)
+        if (const auto FORMAT = scanoutPlane->renderable.get(attrs.format)) {
+            for (auto const& m : FORMAT->modifiers) {
+                if (m != DRM_FORMAT_MOD_INVALID)
+                    explicitModifiers.push_back(m);
+            }
+        }
+    } else {
+        // check if we can use modifiers. If the requested support has any explicit modifier
+        // supported by the primary backend, we can.
+        for (auto const& f : FORMATS) {
+            if (f.drmFormat != attrs.format)
                 continue;
 
-            if (!RENDERABLE.empty()) {
-                TRACE(allocator->backend->log(AQ_LOG_TRACE, std::format("GBM: Renderable has {} formats, clipping", RENDERABLE.size())));
-                if (params.scanout && !CURSOR && !MULTIGPU) {
-                    // regular scanout plane, check if the format is renderable
-                    auto rformat = std::find_if(RENDERABLE.begin(), RENDERABLE.end(), [f](const auto& e) { return e.drmFormat == f.drmFormat; });
-
-                    if (rformat == RENDERABLE.end()) {
-                        TRACE(allocator->backend->log(AQ_LOG_TRACE, std::format("GBM: Dropping format {} as it's not renderable", fourccToName(f.drmFormat))));
-                        break;
-                    }
-
-                    if (std::find(rformat->modifiers.begin(), rformat->modifiers.end(), m) == rformat->modifiers.end()) {
-                        TRACE(allocator->backend->log(AQ_LOG_TRACE, std::format("GBM: Dropping modifier 0x{:x} as it's not renderable", m)));
-                        continue;
+            foundFormat = true;
+            for (auto const& m : f.modifiers) {
+                if (m == DRM_FORMAT_MOD_INVALID)
+                    continue;
+
+                if (!RENDERABLE.empty()) {
+                    TRACE(allocator->backend->log(AQ_LOG_TRACE, std::format("GBM: Renderable has {} formats, clipping", RENDERABLE.size())));
+                    if (params.scanout && !CURSOR && !MULTIGPU) {
+                        // regular scanout plane, check if the format is renderable
+                        auto rformat = std::find_if(RENDERABLE.begin(), RENDERABLE.end(), [f](const auto& e) { return e.drmFormat == f.drmFormat; });
+
+                        if (rformat == RENDERABLE.end()) {
+                            TRACE(allocator->backend->log(AQ_LOG_TRACE, std::format("GBM: Dropping format {} as it's not renderable", fourccToName(f.drmFormat))));
+                            break;
+                        }
+
+                        if (std::find(rformat->modifiers.begin(), rformat->modifiers.end(), m) == rformat->modifiers.end()) {
+                            TRACE(allocator->backend->log(AQ_LOG_TRACE, std::format("GBM: Dropping modifier 0x{:x} as it's not renderable", m)));
+                            continue;
+                        }
                     }
                 }
+                explicitModifiers.push_back(m);
             }
-            explicitModifiers.push_back(m);
         }
     }
 
@@ -147,11 +200,41 @@ Aquamarine::CGBMBuffer::CGBMBuffer(const SAllocatorBufferParams& params, Hypruti
         explicitModifiers = {DRM_FORMAT_MOD_LINEAR};
     }
 
-    uint32_t flags = GBM_BO_USE_RENDERING;
+    // gbm picks from the list by its own rules, which don't know what the plane takes. For KMS outputs, pick the best one ourselves.
+    if (EXPLICIT_SCANOUT && !CURSOR && !MULTIGPU && explicitModifiers.size() > 1 && swapchain->backendImpl->type() == AQ_BACKEND_DRM) {
+        bool validated = false;
+        if (auto mod = allocator->pickScanoutModifier(swapchain->currentOptions().scanoutOutput.lock(), attrs.format, explicitModifiers, &validated); mod.has_value()) {
+            TRACE(allocator->backend->log(AQ_LOG_TRACE, std::format("GBM: Picked scanout modifier 0x{:x}, validated: {}", *mod, validated)));
+            explicitModifiers = {*mod};
+            if (!validated)
+                probedModifier = *mod;
+        }
+    }
+
+    plan.modifiers = explicitModifiers;
+    plan.flags     = GBM_BO_USE_RENDERING;
+    plan.cursor    = CURSOR;
+    plan.scanout   = params.scanout;
+    plan.ready     = true;
+
     if (params.scanout)
-        flags |= GBM_BO_USE_SCANOUT;
+        plan.flags |= GBM_BO_USE_SCANOUT;
 
-    uint64_t modifier = DRM_FORMAT_MOD_INVALID;
+    if (deferBO)
+        return;
+
+    if (createBO())
+        finishBO(swapchain);
+}
+
+bool Aquamarine::CGBMBuffer::createBO() {
+    if (!plan.ready)
+        return false;
+
+    const auto& explicitModifiers = plan.modifiers;
+    const bool  CURSOR            = plan.cursor;
+    uint32_t    flags             = plan.flags;
+    uint64_t    modifier          = DRM_FORMAT_MOD_INVALID;
 
     if (explicitModifiers.empty()) {
         allocator->backend->log(AQ_LOG_WARNING, "GBM: Using modifier-less allocation");
@@ -187,7 +270,7 @@ Aquamarine::CGBMBuffer::CGBMBuffer(const SAllocatorBufferParams& params, Hypruti
 
     if (!bo) {
         allocator->backend->log(AQ_LOG_ERROR, "GBM: Failed to allocate a GBM buffer: bo null");
-        return;
+        return false;
     }
 
     attrs.planes   = gbm_bo_get_plane_count(bo);
@@ -204,12 +287,16 @@ Aquamarine::CGBMBuffer::CGBMBuffer(const SAllocatorBufferParams& params, Hypruti
                 close(attrs.fds.at(j));
             }
             attrs.planes = 0;
-            return;
+            return false;
         }
     }
 
     attrs.success = true;
 
+    return true;
+}
+
+void Aquamarine::CGBMBuffer::finishBO(Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain) {
     auto modName = drmGetFormatModifierName(attrs.modifier);
 
     allocator->backend->log(AQ_LOG_DEBUG,
@@ -218,7 +305,7 @@ Aquamarine::CGBMBuffer::CGBMBuffer(const SAllocatorBufferParams& params, Hypruti
 
     free(modName);
 
-    if (params.scanout && swapchain->backendImpl->type() == AQ_BACKEND_DRM) {
+    if (plan.scanout && swapchain->backendImpl->type() == AQ_BACKEND_DRM) {
         // clear the buffer using the DRM renderer to avoid uninitialized mem
         auto impl = (CDRMBackend*)swapchain->backendImpl.get();
         if (impl->rendererState.renderer)
@@ -280,6 +367,22 @@ void Aquamarine::CGBMBuffer::endDataPtr() {
 }
 
 CGBMAllocator::~CGBMAllocator() {
+    if (worker) {
+        {
+            std::lock_guard<std::mutex> lk(worker->mutex);
+            worker->exit      = true;
+            worker->allocator = nullptr;
+        }
+        worker->cv.notify_all();
+        worker->thread.join();
+    }
+
+    asyncJobs.clear();
+
+    // pooled bos have to go before the device
+    if (pool)
+        pool->clear();
+
     if (gbmDevice)
         gbm_device_destroy(gbmDevice);
 }
@@ -301,6 +404,9 @@ SP<CGBMAllocator> Aquamarine::CGBMAllocator::create(int drmfd_, Hyprutils::Memor
     backend_->log(AQ_LOG_DEBUG, std::format("Created a GBM allocator with drm fd {}", drmfd_));
 
     allocator->self = allocator;
+    allocator->pool = makeShared<CBufferPool>([weak = allocator->self](const SAllocatorBufferParams& params, SP<CSwapchain> swapchain) -> SP<IBuffer> {
+        return weak ? weak->allocate(params, swapchain) : nullptr;
+    });
 
     return allocator;
 }
@@ -319,12 +425,38 @@ Aquamarine::CGBMAllocator::CGBMAllocator(int fd_, Hyprutils::Memory::CWeakPointe
 }
 
 SP<IBuffer> Aquamarine::CGBMAllocator::acquire(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain_) {
+    return pool->acquire(params, swapchain_);
+}
+
+SP<IBuffer> Aquamarine::CGBMAllocator::allocate(const SAllocatorBufferParams& params, Hyprutils::Memory::CSharedPointer<CSwapchain> swapchain_) {
     if (params.size.x < 1 || params.size.y < 1) {
         backend->log(AQ_LOG_ERROR, std::format("Couldn't allocate a gbm buffer with invalid size {}", params.size));
         return nullptr;
     }
 
-    auto newBuffer = SP<CGBMBuffer>(new CGBMBuffer(params, self, swapchain_));
+    return finishAllocation(SP<CGBMBuffer>(new CGBMBuffer(params, self, swapchain_)), params, swapchain_);
+}
+
+SP<IBuffer> Aquamarine::CGBMAllocator::finishAllocation(SP<CGBMBuffer> newBuffer, const SAllocatorBufferParams& params, SP<CSwapchain> swapchain_) {
+    // a modifier KMS hasn't seen for this output yet: importing it is the check, the fb then stays attached for scanout.
+    // Each rejection takes the candidate out, so this ends at a validated modifier or gbm's own pick.
+    while (newBuffer->good() && newBuffer->probedModifier.has_value()) {
+        auto&      entry = scanoutModifierFor(swapchain_->currentOptions().scanoutOutput.lock(), newBuffer->attrs.format);
+        const auto MOD   = *newBuffer->probedModifier;
+        const bool OK    = newBuffer->attrs.modifier == MOD && CDRMFB::create(newBuffer, ((CDRMBackend*)swapchain_->backendImpl.get())->self);
+
+        newBuffer->probedModifier.reset();
+
+        if (OK) {
+            entry.modifier = MOD;
+            backend->log(AQ_LOG_DEBUG, std::format("GBM: KMS takes modifier 0x{:x} for {} on {}", MOD, fourccToName(newBuffer->attrs.format), entry.output->name));
+            break;
+        }
+
+        TRACE(backend->log(AQ_LOG_TRACE, std::format("GBM: KMS rejected modifier 0x{:x}, trying the next one", MOD)));
+        entry.rejected.emplace_back(MOD);
+        newBuffer = SP<CGBMBuffer>(new CGBMBuffer(params, self, swapchain_));
+    }
 
     if (!newBuffer->good()) {
         backend->log(AQ_LOG_ERROR, std::format("Couldn't allocate a gbm buffer with size {} and format {}", params.size, fourccToName(params.format)));
@@ -336,6 +468,176 @@ SP<IBuffer> Aquamarine::CGBMAllocator::acquire(const SAllocatorBufferParams& par
     return newBuffer;
 }
 
+void Aquamarine::CGBMAllocator::acquireAsync(const SAllocatorBufferParams& params, SP<CSwapchain> swapchain_, std::function<void(SP<IBuffer>)> onDone) {
+    if (auto pooled = pool->take(params, swapchain_); pooled) {
+        onDone(pooled);
+        return;
+    }
+
+    if (params.size.x < 1 || params.size.y < 1 || !startWorker()) {
+        onDone(allocate(params, swapchain_));
+        return;
+    }
+
+    // picking the format and modifiers reads the backend's state, that stays here. The worker only makes the bo
+    auto buffer = SP<CGBMBuffer>(new CGBMBuffer(params, self, swapchain_, true));
+    if (!buffer->plan.ready) {
+        onDone(nullptr);
+        return;
+    }
+
+    const auto ID = worker->nextID++;
+    asyncJobs.emplace_back(SAsyncJob{.id = ID, .buffer = buffer, .params = params, .swapchain = swapchain_, .onDone = std::move(onDone)});
+
+    {
+        std::lock_guard<std::mutex> lk(worker->mutex);
+        worker->jobs.emplace_back(ID, buffer.get());
+    }
+    worker->cv.notify_one();
+}
+
+bool Aquamarine::CGBMAllocator::startWorker() {
+    if (worker)
+        return true;
+
+    const auto BACKEND = backend.lock();
+    if (!BACKEND)
+        return false;
+
+    worker            = std::make_shared<SWorker>();
+    worker->allocator = this;
+
+    // the thread only sees raw pointers and std:: types, our pointers aren't thread-safe to copy
+    worker->thread = std::thread([w = worker.get(), weak = std::weak_ptr<SWorker>(worker), backend = BACKEND.get()]() {
+        while (true) {
+            std::pair<uint64_t, CGBMBuffer*> job;
+
+            {
+                std::unique_lock<std::mutex> lk(w->mutex);
+                w->cv.wait(lk, [w]() { return w->exit || !w->jobs.empty(); });
+
+                if (w->exit)
+                    break;
+
+                job = w->jobs.front();
+                w->jobs.pop_front();
+            }
+
+            SWorker::SDone done{.id = job.first};
+
+            threadLogSink = &done.logs;
+            job.second->createBO();
+            threadLogSink = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lk(w->mutex);
+                w->done.emplace_back(std::move(done));
+            }
+
+            backend->postIdleEvent([weak]() {
+                if (const auto W = weak.lock(); W && W->allocator)
+                    W->allocator->dispatchAsync();
+            });
+        }
+    });
+
+    backend->log(AQ_LOG_DEBUG, "GBM: Started an allocation worker");
+
+    return true;
+}
+
+void Aquamarine::CGBMAllocator::dispatchAsync() {
+    std::vector<SWorker::SDone> done;
+    {
+        std::lock_guard<std::mutex> lk(worker->mutex);
+        done.swap(worker->done);
+    }
+
+    for (auto& d : done) {
+        for (auto const& [level, msg] : d.logs) {
+            backend->log((eBackendLogLevel)level, msg);
+        }
+
+        auto it = std::find_if(asyncJobs.begin(), asyncJobs.end(), [&d](const auto& e) { return e.id == d.id; });
+        if (it == asyncJobs.end())
+            continue;
+
+        auto job = std::move(*it);
+        asyncJobs.erase(it);
+
+        if (job.buffer->good())
+            job.buffer->finishBO(job.swapchain);
+
+        auto result = finishAllocation(job.buffer, job.params, job.swapchain);
+
+        // import it for scanout now as well, instead of on its first commit. Same conditions as the modifier probe in finishAllocation()
+        if (result && job.params.scanout && !job.params.cursor && !job.params.multigpu && job.swapchain->currentOptions().scanoutOutput &&
+            job.swapchain->backendImpl->type() == AQ_BACKEND_DRM)
+            CDRMFB::create(result, ((CDRMBackend*)job.swapchain->backendImpl.get())->self);
+
+        job.onDone(result);
+    }
+}
+
+CGBMAllocator::SScanoutModifier& Aquamarine::CGBMAllocator::scanoutModifierFor(SP<IOutput> output, uint32_t format) {
+    std::erase_if(scanoutModifiers, [](const auto& e) { return e.output.expired(); });
+
+    auto it = std::find_if(scanoutModifiers.begin(), scanoutModifiers.end(), [&](const auto& e) { return e.output == output && e.format == format; });
+    if (it != scanoutModifiers.end())
+        return *it;
+
+    return scanoutModifiers.emplace_back(SScanoutModifier{.output = output, .format = format});
+}
+
+std::optional<uint64_t> Aquamarine::CGBMAllocator::pickScanoutModifier(SP<IOutput> output, uint32_t format, const std::vector<uint64_t>& candidates, bool* validated) {
+    if (!output)
+        return std::nullopt;
+
+    const auto& ENTRY = scanoutModifierFor(output, format);
+
+    if (ENTRY.modifier != DRM_FORMAT_MOD_INVALID && std::find(candidates.begin(), candidates.end(), ENTRY.modifier) != candidates.end()) {
+        *validated = true;
+        return ENTRY.modifier;
+    }
+
+    // the import worked once and the plane still didn't take it, so the ranking can't be trusted here
+    if (ENTRY.commitRejected) {
+        *validated = false;
+        const bool LINEAR = std::find(candidates.begin(), candidates.end(), DRM_FORMAT_MOD_LINEAR) != candidates.end() &&
+            std::find(ENTRY.rejected.begin(), ENTRY.rejected.end(), DRM_FORMAT_MOD_LINEAR) == ENTRY.rejected.end();
+        return LINEAR ? std::optional<uint64_t>{DRM_FORMAT_MOD_LINEAR} : std::nullopt;
+    }
+
+    std::optional<uint64_t> best;
+    for (auto const& m : candidates) {
+        if (std::find(ENTRY.rejected.begin(), ENTRY.rejected.end(), m) != ENTRY.rejected.end())
+            continue;
+
+        // ties keep the order we got, which is the plane's
+        if (!best.has_value() || modifierScore(m) > modifierScore(*best))
+            best = m;
+    }
+
+    *validated = false;
+    return best;
+}
+
+void Aquamarine::CGBMAllocator::rejectScanoutModifier(SP<IOutput> output, uint32_t format, uint64_t modifier) {
+    // linear is what we'd fall back to anyway, a failure there isn't the modifier's fault
+    if (!output || modifier == DRM_FORMAT_MOD_LINEAR || modifier == DRM_FORMAT_MOD_INVALID)
+        return;
+
+    auto& entry = scanoutModifierFor(output, format);
+    if (entry.modifier != modifier)
+        return;
+
+    backend->log(AQ_LOG_DEBUG, std::format("GBM: KMS refused a commit on modifier 0x{:x} for {} on {}, falling back", modifier, fourccToName(format), output->name));
+
+    entry.rejected.emplace_back(modifier);
+    entry.modifier       = DRM_FORMAT_MOD_INVALID;
+    entry.commitRejected = true;
+}
+
 Hyprutils::Memory::CSharedPointer<CBackend> Aquamarine::CGBMAllocator::getBackend() {
     return backend.lock();
 }
@@ -347,3 +649,7 @@ int Aquamarine::CGBMAllocator::drmFD() {
 eAllocatorType Aquamarine::CGBMAllocator::type() {
     return AQ_ALLOCATOR_TYPE_GBM;
 }
+
+SP<CBufferPool> Aquamarine::CGBMAllocator::getPool() {
+    return pool;
+}
@@ -1,6 +1,9 @@
 #include <aquamarine/allocator/Swapchain.hpp>
+#include <aquamarine/allocator/BufferPool.hpp>
 #include <aquamarine/backend/Backend.hpp>
 #include "FormatUtils.hpp"
+#include "Tracepoints.hpp"
+#include <utility>
 
 using namespace Aquamarine;
 using namespace Hyprutils::Memory;
@@ -18,27 +21,35 @@ Aquamarine::CSwapchain::CSwapchain(SP<IAllocator> allocator_, SP<IBackendImpleme
         return;
 }
 
-bool Aquamarine::CSwapchain::reconfigure(const SSwapchainOptions& options_) {
+bool Aquamarine::CSwapchain::reconfigure(const SSwapchainOptions& requested) {
     if (!allocator)
         return false;
 
-    if (options_.size == Vector2D{} || options_.length == 0) {
+    if (requested.size == Vector2D{} || requested.length == 0) {
         // clear the swapchain
         allocator->getBackend()->log(AQ_LOG_DEBUG, "Swapchain: Clearing");
-        buffers.clear();
-        options = options_;
+        cancelPending();
+        recycleBuffers(0);
+        options     = requested;
+        depth.extra = 0;
+        resetAge();
         return true;
     }
 
+    const auto options_ = withDepth(requested);
+
     if ((options_.format == options.format || options_.format == DRM_FORMAT_INVALID) && options_.size == options.size && options_.length == options.length)
         return true; // no need to reconfigure
 
+    cancelPending();
+
     if ((options_.format == options.format || options_.format == DRM_FORMAT_INVALID) && options_.size == options.size) {
         bool ok = resize(options_.length);
         if (!ok)
             return false;
 
         options = options_;
+        resetAge();
 
         allocator->getBackend()->log(AQ_LOG_DEBUG, std::format("Swapchain: Resized a {} {} swapchain to length {}", options.size, fourccToName(options.format), options.length));
         return true;
@@ -52,29 +63,249 @@ bool Aquamarine::CSwapchain::reconfigure(const SSwapchainOptions& options_) {
     if (options.format == DRM_FORMAT_INVALID)
         options.format = buffers.at(0)->dmabuf().format;
 
+    resetAge();
+
     allocator->getBackend()->log(AQ_LOG_DEBUG,
                                  std::format("Swapchain: Reconfigured a swapchain to {} {} of length {}", options.size, fourccToName(options.format), options.length));
     return true;
 }
 
-SP<IBuffer> Aquamarine::CSwapchain::next(int* age) {
+bool Aquamarine::CSwapchain::reconfigureAsync(const SSwapchainOptions& requested, std::function<void(bool)> onDone) {
+    if (!allocator)
+        return false;
+
+    const bool SAME_FORMAT = requested.format == options.format || requested.format == DRM_FORMAT_INVALID;
+
+    // nothing to allocate, or only a buffer or two for the same config
+    if (requested.size == Vector2D{} || requested.length == 0 || (SAME_FORMAT && requested.size == options.size)) {
+        const bool OK = reconfigure(requested);
+        if (onDone)
+            onDone(OK);
+        return OK;
+    }
+
+    const auto options_ = withDepth(requested);
+
+    if (pending.active && pending.options.size == options_.size && pending.options.format == options_.format && pending.options.length == options_.length) {
+        // already on its way, the new caller waits for it instead
+        if (onDone)
+            pending.onDone = [prev = std::exchange(pending.onDone, nullptr), next = std::move(onDone)](bool ok) {
+                if (prev)
+                    prev(ok);
+                next(ok);
+            };
+        return true;
+    }
+
+    cancelPending();
+
+    const auto GENERATION = ++pending.generation;
+
+    pending.active      = true;
+    pending.options     = options_;
+    pending.outstanding = options_.length;
+    pending.failed      = false;
+    pending.onDone      = std::move(onDone);
+    pending.buffers.clear();
+    pending.buffers.resize(options_.length);
+
+    allocator->getBackend()->log(AQ_LOG_DEBUG,
+                                 std::format("Swapchain: Allocating {} {} of length {} in the background", options_.size, fourccToName(options_.format), options_.length));
+
+    const auto PARAMS = bufferParams(options_);
+
+    for (size_t i = 0; i < options_.length && pending.active && pending.generation == GENERATION; ++i) {
+        allocator->acquireAsync(PARAMS, self.lock(), [weak = self, GENERATION, i, PARAMS](SP<IBuffer> buffer) {
+            if (weak)
+                weak->onPendingBuffer(GENERATION, i, PARAMS, buffer);
+        });
+    }
+
+    return true;
+}
+
+std::optional<SSwapchainOptions> Aquamarine::CSwapchain::pendingOptions() {
+    if (!pending.active)
+        return std::nullopt;
+
+    return pending.options;
+}
+
+void Aquamarine::CSwapchain::prewarm(const SSwapchainOptions& options_) {
+    if (!allocator || !allocator->getPool() || options_.size == Vector2D{} || options_.length == 0)
+        return;
+
+    allocator->getBackend()->log(AQ_LOG_DEBUG,
+                                 std::format("Swapchain: Prewarming {} {} of length {} in the background", options_.size, fourccToName(options_.format), options_.length));
+
+    const auto PARAMS = bufferParams(options_);
+
+    for (size_t i = 0; i < options_.length; ++i) {
+        allocator->acquireAsync(PARAMS, self.lock(), [weak = self, PARAMS](SP<IBuffer> buffer) {
+            if (!weak || !buffer)
+                return;
+
+            if (const auto POOL = weak->allocator->getPool(); POOL)
+                POOL->recycle(buffer, PARAMS, weak.lock());
+        });
+    }
+}
+
+void Aquamarine::CSwapchain::onPendingBuffer(uint64_t generation, size_t index, const SAllocatorBufferParams& params, SP<IBuffer> buffer) {
+    // a reconfigure that was given up on. pending.options may be another one's by now, so the buffer goes back with what it was made for
+    if (!pending.active || generation != pending.generation) {
+        if (const auto POOL = allocator->getPool(); POOL && buffer)
+            POOL->recycle(buffer, params, self.lock());
+        return;
+    }
+
+    if (buffer)
+        pending.buffers.at(index) = buffer;
+    else
+        pending.failed = true;
+
+    if (--pending.outstanding > 0)
+        return;
+
+    pending.active = false;
+    auto onDone    = std::exchange(pending.onDone, nullptr);
+    auto ready     = std::exchange(pending.buffers, {});
+
+    if (pending.failed) {
+        allocator->getBackend()->log(AQ_LOG_ERROR, "Swapchain: Failed acquiring a buffer in the background");
+        recyclePendingBuffers(ready);
+        if (onDone)
+            onDone(false);
+        return;
+    }
+
+    recycleBuffers(0);
+    buffers      = std::move(ready);
+    options      = pending.options;
+    lastAcquired = 0;
+    if (options.format == DRM_FORMAT_INVALID)
+        options.format = buffers.at(0)->dmabuf().format;
+
+    resetAge();
+
+    allocator->getBackend()->log(AQ_LOG_DEBUG,
+                                 std::format("Swapchain: Reconfigured a swapchain to {} {} of length {}", options.size, fourccToName(options.format), options.length));
+
+    if (onDone)
+        onDone(true);
+}
+
+void Aquamarine::CSwapchain::cancelPending() {
+    if (!pending.active)
+        return;
+
+    pending.active = false;
+    pending.generation++;
+    auto ready = std::exchange(pending.buffers, {});
+    recyclePendingBuffers(ready);
+
+    if (auto onDone = std::exchange(pending.onDone, nullptr); onDone)
+        onDone(false);
+}
+
+SP<IBuffer> Aquamarine::CSwapchain::next(int* age, CRegion* damage) {
     if (!allocator || options.length <= 0)
         return nullptr;
 
-    lastAcquired = (lastAcquired + 1) % options.length;
+    AQ_TRACE_SCOPE("aq swapchain next {} frame {}", options.size, frame + 1);
+
+    // locked buffers are still being read, e.g. held by an output capture or queued in a mailbox, and the backend's are being scanned out or
+    // waiting to be. Reuse one only if all of them are
+    const auto BUSY = [this](int i) { return buffers.at(i)->locked() || buffers.at(i)->lockedByBackend; };
+
+    int        nextBuffer = (lastAcquired + 1) % options.length;
+    for (size_t i = 0; i < options.length && BUSY(nextBuffer); ++i) {
+        nextBuffer = (nextBuffer + 1) % options.length;
+    }
+
+    lastAcquired = BUSY(nextBuffer) ? (lastAcquired + 1) % options.length : nextBuffer;
+    frame++;
+
+    auto&     lastFrame = bufferFrames.at(lastAcquired);
+    const int AGE       = lastFrame == 0 ? 0 : frame - lastFrame;
 
     if (age)
-        *age = 1;
+        *age = AGE;
+
+    if (damage)
+        *damage = damageSince(AGE);
+
+    lastFrame = frame;
 
     return buffers.at(lastAcquired);
 }
 
+void Aquamarine::CSwapchain::addDamage(const CRegion& damage) {
+    if (frame == 0 || damageRing.empty())
+        return;
+
+    auto& entry = damageRing.at(frame % damageRing.size());
+    if (entry.frame != frame) {
+        entry.frame = frame;
+        entry.damage.clear();
+    }
+
+    entry.damage.add(damage);
+}
+
+CRegion Aquamarine::CSwapchain::damageSince(int age) {
+    const CRegion FULL{CBox{{}, options.size}};
+
+    if (age <= 0 || (size_t)age > damageRing.size())
+        return FULL;
+
+    // the buffer holds the contents of frame - age, so it missed everything after that, up to the current frame.
+    CRegion result;
+    for (uint64_t f = frame - age + 1; f < frame; ++f) {
+        const auto& ENTRY = damageRing.at(f % damageRing.size());
+        if (ENTRY.frame != f)
+            return FULL; // nobody reported damage for that frame
+
+        result.add(ENTRY.damage);
+    }
+
+    return result;
+}
+
+void Aquamarine::CSwapchain::resetAge() {
+    bufferFrames.assign(buffers.size(), 0);
+    damageRing.assign(buffers.size(), SDamageEntry{});
+}
+
+SAllocatorBufferParams Aquamarine::CSwapchain::bufferParams(const SSwapchainOptions& options_) {
+    return SAllocatorBufferParams{.size = options_.size, .format = options_.format, .scanout = options_.scanout, .cursor = options_.cursor, .multigpu = options_.multigpu};
+}
+
+void Aquamarine::CSwapchain::recycleBuffers(size_t keep) {
+    const auto POOL = allocator->getPool();
+
+    while (buffers.size() > keep) {
+        if (POOL)
+            POOL->recycle(buffers.back(), bufferParams(options), self.lock());
+        buffers.pop_back();
+    }
+}
+
+void Aquamarine::CSwapchain::recyclePendingBuffers(std::vector<SP<IBuffer>>& ready) {
+    const auto POOL = allocator->getPool();
+
+    for (auto const& buffer : ready) {
+        if (POOL && buffer)
+            POOL->recycle(buffer, bufferParams(pending.options), self.lock());
+    }
+
+    ready.clear();
+}
+
 bool Aquamarine::CSwapchain::fullReconfigure(const SSwapchainOptions& options_) {
-    buffers.clear();
+    recycleBuffers(0);
     for (size_t i = 0; i < options_.length; ++i) {
-        auto buf = allocator->acquire(
-            SAllocatorBufferParams{.size = options_.size, .format = options_.format, .scanout = options_.scanout, .cursor = options_.cursor, .multigpu = options_.multigpu},
-            self.lock());
+        auto buf = allocator->acquire(bufferParams(options_), self.lock());
         if (!buf) {
             allocator->getBackend()->log(AQ_LOG_ERROR, "Swapchain: Failed acquiring a buffer");
             return false;
@@ -89,14 +320,11 @@ bool Aquamarine::CSwapchain::resize(size_t newSize) {
     if (newSize == buffers.size())
         return true;
 
-    if (newSize < buffers.size()) {
-        while (buffers.size() > newSize) {
-            buffers.pop_back();
-        }
-    } else {
+    if (newSize < buffers.size())
+        recycleBuffers(newSize);
+    else {
         while (buffers.size() < newSize) {
-            auto buf =
-                allocator->acquire(SAllocatorBufferParams{.size = options.size, .format = options.format, .scanout = options.scanout, .cursor = options.cursor}, self.lock());
+            auto buf = allocator->acquire(bufferParams(options), self.lock());
             if (!buf) {
                 allocator->getBackend()->log(AQ_LOG_ERROR, "Swapchain: Failed acquiring a buffer");
                 return false;
@@ -108,6 +336,71 @@ bool Aquamarine::CSwapchain::resize(size_t newSize) {
     return true;
 }
 
+SSwapchainOptions Aquamarine::CSwapchain::withDepth(const SSwapchainOptions& options_) {
+    depth.requested = options_.length;
+
+    auto result = options_;
+    if (depth.policy)
+        result.length = std::max(options_.length, std::min(options_.length + depth.extra, depth.policy->maxLength));
+
+    return result;
+}
+
+void Aquamarine::CSwapchain::setDepthPolicy(std::optional<SSwapchainDepthPolicy> policy) {
+    depth.policy = policy;
+    depth.late   = depth.windowFrames = depth.onTime = 0;
+
+    if (!policy && depth.extra > 0 && !pending.active && options.length > 0)
+        setExtraDepth(0);
+}
+
+bool Aquamarine::CSwapchain::onFrameFeedback(bool late) {
+    // a reconfigureAsync() in flight has its length already
+    if (!depth.policy || !allocator || options.length == 0 || pending.active)
+        return false;
+
+    const auto& POLICY = *depth.policy;
+
+    if (depth.windowFrames++ >= POLICY.window)
+        depth.late = depth.windowFrames = 0;
+
+    if (late) {
+        depth.onTime = 0;
+        if (++depth.late < POLICY.growAfter || options.length >= POLICY.maxLength)
+            return false;
+
+        return setExtraDepth(depth.extra + 1);
+    }
+
+    if (++depth.onTime < POLICY.shrinkAfter || depth.extra == 0)
+        return false;
+
+    return setExtraDepth(depth.extra - 1);
+}
+
+bool Aquamarine::CSwapchain::setExtraDepth(size_t extra) {
+    const size_t LENGTH = depth.requested + extra;
+
+    depth.late = depth.windowFrames = depth.onTime = 0;
+
+    if (!resize(LENGTH)) {
+        // don't leave it half grown
+        recycleBuffers(options.length);
+        return false;
+    }
+
+    allocator->getBackend()->log(AQ_LOG_DEBUG, std::format("Swapchain: Depth policy {} a {} {} swapchain to length {}", LENGTH > options.length ? "grew" : "shrank",
+                                                           options.size, fourccToName(options.format), LENGTH));
+
+    options.length = LENGTH;
+    depth.extra    = extra;
+    if (lastAcquired >= (int)LENGTH)
+        lastAcquired = LENGTH - 1;
+
+    resetAge();
+    return true;
+}
+
 bool Aquamarine::CSwapchain::contains(SP<IBuffer> buffer) {
     return std::find(buffers.begin(), buffers.end(), buffer) != buffers.end();
 }
@@ -117,6 +410,16 @@ const SSwapchainOptions& Aquamarine::CSwapchain::currentOptions() {
 }
 
 void Aquamarine::CSwapchain::rollback() {
+    if (options.length <= 0 || bufferFrames.empty())
+        return;
+
+    // the buffer may have been drawn into, its contents are undefined now. Hand its frame out again.
+    bufferFrames.at(lastAcquired) = 0;
+    if (frame > 0) {
+        damageRing.at(frame % damageRing.size()).frame = 0;
+        frame--;
+    }
+
     lastAcquired--;
     if (lastAcquired < 0)
         lastAcquired = options.length - 1;
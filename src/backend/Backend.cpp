@@ -4,34 +4,22 @@
 #include <aquamarine/backend/DRM.hpp>
 #include <aquamarine/allocator/GBM.hpp>
 #include <sys/poll.h>
+#include <sys/epoll.h>
 #include <thread>
 #include <chrono>
-#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <time.h>
 #include <string.h>
 #include <xf86drm.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <array>
+#include "Shared.hpp"
 
 using namespace Hyprutils::Memory;
 using namespace Aquamarine;
 #define SP CSharedPointer
 
-#define TIMESPEC_NSEC_PER_SEC 1000000000LL
-
-static void timespecAddNs(timespec* pTimespec, int64_t delta) {
-    int delta_ns_low = delta % TIMESPEC_NSEC_PER_SEC;
-    int delta_s_high = delta / TIMESPEC_NSEC_PER_SEC;
-
-    pTimespec->tv_sec += delta_s_high;
-
-    pTimespec->tv_nsec += (long)delta_ns_low;
-    if (pTimespec->tv_nsec >= TIMESPEC_NSEC_PER_SEC) {
-        pTimespec->tv_nsec -= TIMESPEC_NSEC_PER_SEC;
-        ++pTimespec->tv_sec;
-    }
-}
-
 static const char* backendTypeToName(eBackendType type) {
     switch (type) {
         case AQ_BACKEND_DRM: return "drm";
@@ -92,14 +80,15 @@ Hyprutils::Memory::CSharedPointer<CBackend> Aquamarine::CBackend::create(const s
         }
     }
 
-    // create a timerfd for idle events
-    backend->idle.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    // idle events wake the loop through an eventfd
+    backend->idle.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
 
     return backend;
 }
 
 Aquamarine::CBackend::~CBackend() {
-    ;
+    if (epoll.fd >= 0)
+        close(epoll.fd);
 }
 
 bool Aquamarine::CBackend::start() {
@@ -171,6 +160,8 @@ bool Aquamarine::CBackend::start() {
 
     sessionFDs = session ? session->pollFDs() : std::vector<Hyprutils::Memory::CSharedPointer<SPollFD>>{};
 
+    initEpoll();
+
     return true;
 }
 
@@ -178,6 +169,11 @@ void Aquamarine::CBackend::log(eBackendLogLevel level, const std::string& msg) {
     if (!options.logFunction)
         return;
 
+    if (threadLogSink) {
+        threadLogSink->emplace_back(level, msg);
+        return;
+    }
+
     options.logFunction(level, msg);
 }
 
@@ -186,22 +182,69 @@ std::vector<Hyprutils::Memory::CSharedPointer<SPollFD>> Aquamarine::CBackend::ge
     for (auto const& i : implementations) {
         auto pollfds = i->pollFDs();
         for (auto const& p : pollfds) {
-            log(AQ_LOG_DEBUG, std::format("backend: poll fd {} for implementation {}", p->fd, backendTypeToName(i->type())));
+            TRACE(log(AQ_LOG_TRACE, std::format("backend: poll fd {} for implementation {}", p->fd, backendTypeToName(i->type()))));
             result.emplace_back(p);
         }
     }
 
     for (auto const& sfd : sessionFDs) {
-        log(AQ_LOG_DEBUG, std::format("backend: poll fd {} for session", sfd->fd));
+        TRACE(log(AQ_LOG_TRACE, std::format("backend: poll fd {} for session", sfd->fd)));
         result.emplace_back(sfd);
     }
 
-    log(AQ_LOG_DEBUG, std::format("backend: poll fd {} for idle", idle.fd));
+    TRACE(log(AQ_LOG_TRACE, std::format("backend: poll fd {} for idle", idle.fd)));
     result.emplace_back(makeShared<SPollFD>(idle.fd, [this]() { dispatchIdle(); }));
 
     return result;
 }
 
+void Aquamarine::CBackend::initEpoll() {
+    epoll.fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll.fd < 0) {
+        log(AQ_LOG_ERROR, std::format("backend: failed to create an epoll instance: {}", strerror(errno)));
+        return;
+    }
+
+    epoll.registered = getPollFDs();
+
+    for (auto const& p : epoll.registered) {
+        epoll_event ev = {.events = EPOLLIN, .data = {.ptr = p.get()}};
+        if (epoll_ctl(epoll.fd, EPOLL_CTL_ADD, p->fd, &ev))
+            log(AQ_LOG_ERROR, std::format("backend: failed to add poll fd {} to epoll: {}", p->fd, strerror(errno)));
+        else
+            log(AQ_LOG_DEBUG, std::format("backend: poll fd {} added to epoll", p->fd));
+    }
+}
+
+int Aquamarine::CBackend::getEpollFD() {
+    return epoll.fd;
+}
+
+int Aquamarine::CBackend::dispatch(int timeoutMs) {
+    if (epoll.fd < 0)
+        return -1;
+
+    std::array<epoll_event, 16> events;
+
+    const int                   READY = epoll_wait(epoll.fd, events.data(), events.size(), timeoutMs);
+    if (READY < 0) {
+        if (errno == EINTR)
+            return 0;
+
+        log(AQ_LOG_ERROR, std::format("backend: epoll_wait failed: {}", strerror(errno)));
+        return -1;
+    }
+
+    // level-triggered, whatever doesn't fit in this batch is reported by the next call
+    for (int i = 0; i < READY; ++i) {
+        const auto POLLFD = (SPollFD*)events.at(i).data.ptr;
+        if (POLLFD->onSignal)
+            POLLFD->onSignal();
+    }
+
+    return READY;
+}
+
 int Aquamarine::CBackend::drmFD() {
     for (auto const& i : implementations) {
         int fd = i->drmFD();
@@ -237,38 +280,79 @@ const std::vector<SP<IBackendImplementation>>& Aquamarine::CBackend::getImplemen
 }
 
 void Aquamarine::CBackend::addIdleEvent(SP<std::function<void(void)>> fn) {
-    auto r = idle.pending.emplace_back(fn);
+    bool wake = false;
+
+    {
+        std::lock_guard<std::mutex> lk(idle.mutex);
+        wake = idle.pending.empty();
+
+        // a newer add supersedes older queued ones of the same fn
+        const auto TICKET = idle.nextTicket++;
+        idle.tickets[fn.get()] = TICKET;
+        idle.pending.emplace_back(SIdleEvent{.shared = fn, .ticket = TICKET});
+    }
 
-    updateIdleTimer();
+    if (wake)
+        wakeIdle();
 }
 
-void Aquamarine::CBackend::updateIdleTimer() {
-    uint64_t ADD_NS = idle.pending.empty() ? TIMESPEC_NSEC_PER_SEC * 240ULL /* 240s, 4 mins */ : 0;
+void Aquamarine::CBackend::postIdleEvent(std::function<void(void)> fn) {
+    bool wake = false;
 
-    timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    timespecAddNs(&now, ADD_NS);
+    {
+        std::lock_guard<std::mutex> lk(idle.mutex);
+        wake = idle.pending.empty();
+        idle.pending.emplace_back(SIdleEvent{.owned = std::move(fn)});
+    }
 
-    itimerspec ts = {.it_value = now};
+    if (wake)
+        wakeIdle();
+}
 
-    if (timerfd_settime(idle.fd, TFD_TIMER_ABSTIME, &ts, nullptr))
-        log(AQ_LOG_ERROR, std::format("backend: failed to arm timerfd: {}", strerror(errno)));
+void Aquamarine::CBackend::wakeIdle() {
+    // only the empty -> non-empty transition gets here, later adds ride along
+    const uint64_t ONE = 1;
+    if (write(idle.fd, &ONE, sizeof(ONE)) != sizeof(ONE))
+        log(AQ_LOG_ERROR, std::format("backend: failed to signal the idle eventfd: {}", strerror(errno)));
 }
 
 void Aquamarine::CBackend::removeIdleEvent(SP<std::function<void(void)>> pfn) {
-    std::erase(idle.pending, pfn);
+    std::lock_guard<std::mutex> lk(idle.mutex);
+    idle.tickets.erase(pfn.get());
 }
 
 void Aquamarine::CBackend::dispatchIdle() {
-    auto cpy = idle.pending;
-    idle.pending.clear();
+    // clear the eventfd first, anything queued after the swap below wakes us up again
+    uint64_t count = 0;
+    if (read(idle.fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        log(AQ_LOG_ERROR, std::format("backend: failed to read the idle eventfd: {}", strerror(errno)));
 
-    for (auto const& i : cpy) {
-        if (i && *i)
-            (*i)();
+    std::vector<SIdleEvent> batch;
+
+    {
+        std::lock_guard<std::mutex> lk(idle.mutex);
+        batch.swap(idle.pending);
     }
 
-    updateIdleTimer();
+    for (auto const& e : batch) {
+        if (!e.shared) {
+            if (e.owned)
+                e.owned();
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(idle.mutex);
+            auto                        it = idle.tickets.find(e.shared.get());
+            if (it == idle.tickets.end() || it->second != e.ticket)
+                continue; // removed, or re-added further down the queue
+
+            idle.tickets.erase(it);
+        }
+
+        if (*e.shared)
+            (*e.shared)();
+    }
 }
 
 // Yoinked from wlroots, render/allocator/allocator.c
@@ -27,22 +27,25 @@ static void timespecAddNs(timespec* pTimespec, int64_t delta) {
 
 Aquamarine::CHeadlessOutput::CHeadlessOutput(const std::string& name_, Hyprutils::Memory::CWeakPointer<CHeadlessBackend> backend_) : backend(backend_) {
     name = name_;
-
-    framecb = makeShared<std::function<void()>>([this]() {
-        frameScheduled = false;
-        events.frame.emit();
-    });
 }
 
 Aquamarine::CHeadlessOutput::~CHeadlessOutput() {
-    backend->backend->removeIdleEvent(framecb);
     events.destroy.emit();
 }
 
 bool Aquamarine::CHeadlessOutput::commit() {
+    const bool HAS_BUFFER = (state->state().committed & COutputState::AQ_OUTPUT_STATE_BUFFER) && state->state().buffer;
+
     events.commit.emit();
     state->onCommit();
     needsFrame = false;
+
+    // "scanned out" at the next vblank, like a page-flip
+    if (HAS_BUFFER) {
+        vblank.presentPending = true;
+        armVblank();
+    }
+
     return true;
 }
 
@@ -62,14 +65,76 @@ Hyprutils::Memory::CSharedPointer<IBackendImplementation> Aquamarine::CHeadlessO
 void Aquamarine::CHeadlessOutput::scheduleFrame(const scheduleFrameReason reason) {
     TRACE(backend->backend->log(AQ_LOG_TRACE,
                                 std::format("CHeadlessOutput::scheduleFrame: reason {}, needsFrame {}, frameScheduled {}", (uint32_t)reason, needsFrame, frameScheduled)));
-    // FIXME: limit fps to the committed framerate.
     needsFrame = true;
 
     if (frameScheduled)
         return;
 
     frameScheduled = true;
-    backend->backend->addIdleEvent(framecb);
+    armVblank();
+}
+
+int64_t Aquamarine::CHeadlessOutput::refreshPeriodNs() {
+    auto mode = state->state().customMode ? state->state().customMode : state->state().mode;
+    if (!mode)
+        mode = preferredMode();
+
+    const unsigned int REFRESH = mode && mode->refreshRate ? mode->refreshRate : 60000 /* mHz */;
+
+    return 1000000000000LL / REFRESH;
+}
+
+void Aquamarine::CHeadlessOutput::armVblank() {
+    if (vblank.armed)
+        return;
+
+    const auto now    = std::chrono::steady_clock::now();
+    const auto PERIOD = std::chrono::nanoseconds(refreshPeriodNs());
+
+    // the first vblank is right away, later ones stay on the last vblank's grid
+    int64_t periods = 0;
+    if (vblank.last.time_since_epoch().count() != 0)
+        periods = now <= vblank.last + PERIOD ? 1 : (now - vblank.last) / PERIOD + 1;
+
+    vblank.next    = vblank.last.time_since_epoch().count() != 0 ? vblank.last + PERIOD * periods : now;
+    vblank.nextSeq = vblank.seq + (periods ? periods : 1);
+    vblank.armed   = true;
+
+    backend->timers.timers.emplace_back(CHeadlessBackend::CTimer{.when = vblank.next, .what = [w = self]() {
+                                                                      if (auto o = w.lock(); o)
+                                                                          o->onVblank();
+                                                                  }});
+    backend->updateTimerFD();
+}
+
+void Aquamarine::CHeadlessOutput::onVblank() {
+    vblank.armed = false;
+    vblank.last  = vblank.next;
+    vblank.seq   = vblank.nextSeq;
+
+    const bool PRESENTED = vblank.presentPending;
+
+    if (PRESENTED) {
+        vblank.presentPending = false;
+
+        // steady_clock is CLOCK_MONOTONIC
+        const auto NS   = std::chrono::duration_cast<std::chrono::nanoseconds>(vblank.last.time_since_epoch()).count();
+        timespec   when = {.tv_sec = (time_t)(NS / TIMESPEC_NSEC_PER_SEC), .tv_nsec = (long)(NS % TIMESPEC_NSEC_PER_SEC)};
+
+        events.present.emit(IOutput::SPresentEvent{
+            .presented = true,
+            .when      = &when,
+            .seq       = vblank.seq,
+            .refresh   = (int)refreshPeriodNs(),
+            .flags     = IOutput::AQ_OUTPUT_PRESENT_VSYNC,
+        });
+    }
+
+    if (!PRESENTED && !frameScheduled)
+        return;
+
+    frameScheduled = false;
+    events.frame.emit();
 }
 
 bool Aquamarine::CHeadlessOutput::destroy() {
@@ -131,7 +196,7 @@ std::vector<SDRMFormat> Aquamarine::CHeadlessBackend::getCursorFormats() {
 bool Aquamarine::CHeadlessBackend::createOutput(const std::string& name) {
     auto output = SP<CHeadlessOutput>(new CHeadlessOutput(name.empty() ? std::format("HEADLESS-{}", ++outputIDCounter) : name, self.lock()));
     outputs.emplace_back(output);
-    output->modes.emplace_back(SP<SOutputMode>(new SOutputMode(Vector2D{1920, 1080}, 60, true)));
+    output->modes.emplace_back(SP<SOutputMode>(new SOutputMode(Vector2D{1920, 1080}, 60000, true)));
     output->swapchain = CSwapchain::create(backend->primaryAllocator, self.lock());
     output->self      = output;
     backend->events.newOutput.emit(SP<IOutput>(output));
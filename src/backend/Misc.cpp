@@ -0,0 +1,61 @@
+#include <aquamarine/backend/Misc.hpp>
+
+using namespace Aquamarine;
+
+Aquamarine::CDRMFormatTable::CDRMFormatTable(const std::vector<SDRMFormat>& formats_) {
+    for (auto const& f : formats_) {
+        for (auto const& m : f.modifiers) {
+            add(f.drmFormat, m);
+        }
+    }
+}
+
+void Aquamarine::CDRMFormatTable::add(uint32_t format, uint64_t modifier) {
+    auto [it, inserted] = entries.try_emplace(format);
+    if (inserted) {
+        it->second.index = formats.size();
+        formats.emplace_back(SDRMFormat{.drmFormat = format});
+    }
+
+    if (it->second.modifiers.emplace(modifier).second)
+        formats.at(it->second.index).modifiers.emplace_back(modifier);
+}
+
+bool Aquamarine::CDRMFormatTable::has(uint32_t format) const {
+    return entries.contains(format);
+}
+
+bool Aquamarine::CDRMFormatTable::has(uint32_t format, uint64_t modifier) const {
+    auto it = entries.find(format);
+    return it != entries.end() && it->second.modifiers.contains(modifier);
+}
+
+const SDRMFormat* Aquamarine::CDRMFormatTable::get(uint32_t format) const {
+    auto it = entries.find(format);
+    return it == entries.end() ? nullptr : &formats.at(it->second.index);
+}
+
+const std::vector<SDRMFormat>& Aquamarine::CDRMFormatTable::list() const {
+    return formats;
+}
+
+bool Aquamarine::CDRMFormatTable::empty() const {
+    return formats.empty();
+}
+
+CDRMFormatTable Aquamarine::CDRMFormatTable::intersect(const CDRMFormatTable& other) const {
+    CDRMFormatTable result;
+
+    for (auto const& f : formats) {
+        auto it = other.entries.find(f.drmFormat);
+        if (it == other.entries.end())
+            continue;
+
+        for (auto const& m : f.modifiers) {
+            if (it->second.modifiers.contains(m))
+                result.add(f.drmFormat, m);
+        }
+    }
+
+    return result;
+}
@@ -12,6 +12,9 @@ extern "C" {
 #include <unistd.h>
 }
 
+#include "Shared.hpp"
+#include "Tracepoints.hpp"
+
 using namespace Aquamarine;
 using namespace Hyprutils::Memory;
 #define SP CSharedPointer
@@ -173,6 +176,8 @@ SP<CSession> Aquamarine::CSession::attempt(Hyprutils::Memory::CSharedPointer<CBa
     session->self    = session;
     backendInUse     = backend_;
 
+    session->coalescePointerMotion = envEnabled("AQ_COALESCE_POINTER_MOTION");
+
     // ------------ Libseat
 
     libseat_set_log_handler(libseatLog);
@@ -340,6 +345,8 @@ void Aquamarine::CSession::dispatchLibinputEvents() {
     if (!libinputHandle)
         return;
 
+    AQ_TRACE_SCOPE("aq libinput dispatch");
+
     if (int ret = libinput_dispatch(libinputHandle); ret) {
         backend->log(AQ_LOG_ERROR, std::format("Couldn't dispatch libinput events: {}", strerror(-ret)));
         return;
@@ -351,6 +358,29 @@ void Aquamarine::CSession::dispatchLibinputEvents() {
         libinput_event_destroy(event);
         event = libinput_get_event(libinputHandle);
     }
+
+    flushPointerMotion();
+}
+
+void Aquamarine::CSession::flushPointerMotion() {
+    if (!coalescePointerMotion)
+        return;
+
+    // copy, a handler may remove devices
+    auto cpy = libinputDevices;
+    for (auto const& d : cpy) {
+        if (!d->pendingMotion)
+            continue;
+
+        const auto EVENT = *d->pendingMotion;
+        d->pendingMotion.reset();
+
+        if (!d->mouse)
+            continue;
+
+        d->mouse->events.move.emit(EVENT);
+        d->mouse->events.frame.emit();
+    }
 }
 
 void Aquamarine::CSession::dispatchLibseatEvents() {
@@ -390,6 +420,10 @@ void Aquamarine::CSession::handleLibinputEvent(libinput_event* e) {
 
     backend->log(AQ_LOG_TRACE, std::format("libinput: Event {}", (int)eventType));
 
+    // anything else goes out after the motion that came before it
+    if (eventType != LIBINPUT_EVENT_POINTER_MOTION)
+        flushPointerMotion();
+
     if (!data && eventType != LIBINPUT_EVENT_DEVICE_ADDED) {
         backend->log(AQ_LOG_ERROR, "libinput: No aq device in event and not added");
         return;
@@ -428,11 +462,30 @@ void Aquamarine::CSession::handleLibinputEvent(libinput_event* e) {
             // --------- pointer
 
         case LIBINPUT_EVENT_POINTER_MOTION: {
-            auto pe = libinput_event_get_pointer_event(e);
+            auto                            pe      = libinput_event_get_pointer_event(e);
+            const uint64_t                  TIMEUS  = libinput_event_pointer_get_time_usec(pe);
+            const Hyprutils::Math::Vector2D DELTA   = {libinput_event_pointer_get_dx(pe), libinput_event_pointer_get_dy(pe)};
+            const Hyprutils::Math::Vector2D UNACCEL = {libinput_event_pointer_get_dx_unaccelerated(pe), libinput_event_pointer_get_dy_unaccelerated(pe)};
+
+            if (coalescePointerMotion) {
+                if (!hlDevice->pendingMotion)
+                    hlDevice->pendingMotion = IPointer::SMoveEvent{.samples = 0, .firstUs = TIMEUS};
+
+                auto& motion   = *hlDevice->pendingMotion;
+                motion.timeMs  = (uint32_t)(TIMEUS / 1000);
+                motion.delta   = motion.delta + DELTA;
+                motion.unaccel = motion.unaccel + UNACCEL;
+                motion.lastUs  = TIMEUS;
+                motion.samples++;
+                break;
+            }
+
             hlDevice->mouse->events.move.emit(IPointer::SMoveEvent{
-                .timeMs  = (uint32_t)(libinput_event_pointer_get_time_usec(pe) / 1000),
-                .delta   = {libinput_event_pointer_get_dx(pe), libinput_event_pointer_get_dy(pe)},
-                .unaccel = {libinput_event_pointer_get_dx_unaccelerated(pe), libinput_event_pointer_get_dy_unaccelerated(pe)},
+                .timeMs  = (uint32_t)(TIMEUS / 1000),
+                .delta   = DELTA,
+                .unaccel = UNACCEL,
+                .firstUs = TIMEUS,
+                .lastUs  = TIMEUS,
             });
             hlDevice->mouse->events.frame.emit();
             break;
@@ -116,6 +116,15 @@ bool Aquamarine::CWaylandBackend::start() {
                 backend->log(AQ_LOG_ERROR, "Wayland backend cannot start: zwp_linux_dmabuf_v1 init failed");
                 waylandState.dmabufFailed = true;
             }
+        } else if (NAME == "wp_presentation") {
+            TRACE(backend->log(AQ_LOG_TRACE, std::format("  > binding to global: {} (version {}) with id {}", name, 1, id)));
+            waylandState.presentation =
+                makeShared<CCWpPresentation>((wl_proxy*)wl_registry_bind((wl_registry*)waylandState.registry->resource(), id, &wp_presentation_interface, 1));
+            waylandState.presentation->setClockId([this](CCWpPresentation* r, uint32_t clock) {
+                waylandState.presentClock = clock;
+                if (clock != CLOCK_MONOTONIC)
+                    backend->log(AQ_LOG_WARNING, std::format("wp_presentation: host clock {} isn't CLOCK_MONOTONIC, present events won't carry timestamps", clock));
+            });
         }
     });
     waylandState.registry->setGlobalRemove([this](CCWlRegistry* r, uint32_t id) { backend->log(AQ_LOG_DEBUG, std::format("Global {} removed", id)); });
@@ -337,11 +346,6 @@ bool Aquamarine::CWaylandBackend::initDmabuf() {
         return false;
     }
 
-    waylandState.dmabufFeedback->setDone([this](CCZwpLinuxDmabufFeedbackV1* r) {
-        // no-op
-        backend->log(AQ_LOG_DEBUG, "zwp_linux_dmabuf_v1: Got done");
-    });
-
     waylandState.dmabufFeedback->setMainDevice([this](CCZwpLinuxDmabufFeedbackV1* r, wl_array* deviceArr) {
         backend->log(AQ_LOG_DEBUG, "zwp_linux_dmabuf_v1: Got main device");
 
@@ -378,7 +382,40 @@ bool Aquamarine::CWaylandBackend::initDmabuf() {
         backend->log(AQ_LOG_DEBUG, std::format("zwp_linux_dmabuf_v1: Got node {}", drmState.nodeName));
     });
 
-    waylandState.dmabufFeedback->setFormatTable([this](CCZwpLinuxDmabufFeedbackV1* r, int32_t fd, uint32_t size) {
+    listenDmabufFeedback(waylandState.dmabufFeedback, &defaultFeedback, [this]() {
+        dmabufFormats = defaultFeedback.formats();
+
+        // hosts without tranches only gave us the table
+        if (defaultFeedback.tranches.empty()) {
+            for (auto const& [format, modifier] : defaultFeedback.table) {
+                auto it = std::find_if(dmabufFormats.begin(), dmabufFormats.end(), [format](const auto& e) { return e.drmFormat == format; });
+                if (it == dmabufFormats.end())
+                    dmabufFormats.emplace_back(SDRMFormat{.drmFormat = format, .modifiers = {modifier}});
+                else
+                    it->modifiers.emplace_back(modifier);
+            }
+        }
+
+        backend->log(AQ_LOG_DEBUG, std::format("zwp_linux_dmabuf_v1: Got {} formats in {} tranches", dmabufFormats.size(), defaultFeedback.tranches.size()));
+    });
+
+    wl_display_roundtrip(waylandState.display);
+
+    if (!drmState.nodeName.empty()) {
+        drmState.fd = open(drmState.nodeName.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (drmState.fd < 0) {
+            backend->log(AQ_LOG_ERROR, std::format("zwp_linux_dmabuf_v1: Failed to open node {}", drmState.nodeName));
+            return false;
+        }
+
+        backend->log(AQ_LOG_DEBUG, std::format("zwp_linux_dmabuf_v1: opened node {} with fd {}", drmState.nodeName, drmState.fd));
+    }
+
+    return true;
+}
+
+void Aquamarine::CWaylandBackend::listenDmabufFeedback(SP<CCZwpLinuxDmabufFeedbackV1> feedback, SWaylandDmabufFeedback* state, std::function<void()> onDone) {
+    feedback->setFormatTable([this, state](CCZwpLinuxDmabufFeedbackV1* r, int32_t fd, uint32_t size) {
 #pragma pack(push, 1)
         struct wlDrmFormatMarshalled {
             uint32_t drmFormat;
@@ -389,6 +426,7 @@ bool Aquamarine::CWaylandBackend::initDmabuf() {
         static_assert(sizeof(wlDrmFormatMarshalled) == 16);
 
         auto formatTable = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
         if (formatTable == MAP_FAILED) {
             backend->log(AQ_LOG_ERROR, std::format("zwp_linux_dmabuf_v1: Failed to mmap the format table"));
             return;
@@ -396,38 +434,76 @@ bool Aquamarine::CWaylandBackend::initDmabuf() {
 
         const auto FORMATS = (wlDrmFormatMarshalled*)formatTable;
 
+        TRACE(backend->log(AQ_LOG_TRACE, std::format("zwp_linux_dmabuf_v1: Got a format table with {} entries", size / 16)));
+
+        state->table.clear();
         for (size_t i = 0; i < size / 16; ++i) {
-            auto& fmt = FORMATS[i];
+            state->table.emplace_back(FORMATS[i].drmFormat, FORMATS[i].modifier);
+        }
+
+        munmap(formatTable, size);
+    });
 
-            auto  modName = drmGetFormatModifierName(fmt.modifier);
-            backend->log(AQ_LOG_DEBUG, std::format("zwp_linux_dmabuf_v1: Got format {} with modifier {}", fourccToName(fmt.drmFormat), modName ? modName : "UNKNOWN"));
-            free(modName);
+    feedback->setTrancheFormats([this, state](CCZwpLinuxDmabufFeedbackV1* r, wl_array* indices) {
+        auto& formats = state->pendingTranche.formats;
 
-            auto it = std::find_if(dmabufFormats.begin(), dmabufFormats.end(), [&fmt](const auto& e) { return e.drmFormat == fmt.drmFormat; });
-            if (it == dmabufFormats.end()) {
-                dmabufFormats.emplace_back(SDRMFormat{.drmFormat = fmt.drmFormat, .modifiers = {fmt.modifier}});
+        for (size_t i = 0; i < indices->size / sizeof(uint16_t); ++i) {
+            const uint16_t IDX = ((uint16_t*)indices->data)[i];
+            if (IDX >= state->table.size()) {
+                backend->log(AQ_LOG_ERROR, std::format("zwp_linux_dmabuf_v1: Tranche format index {} is past the table", IDX));
                 continue;
             }
 
-            it->modifiers.emplace_back(fmt.modifier);
+            const auto& [format, modifier] = state->table.at(IDX);
+
+            auto it = std::find_if(formats.begin(), formats.end(), [format](const auto& e) { return e.drmFormat == format; });
+            if (it == formats.end())
+                formats.emplace_back(SDRMFormat{.drmFormat = format, .modifiers = {modifier}});
+            else
+                it->modifiers.emplace_back(modifier);
         }
+    });
 
-        munmap(formatTable, size);
+    feedback->setTrancheFlags([state](CCZwpLinuxDmabufFeedbackV1* r, zwpLinuxDmabufFeedbackV1TrancheFlags flags) {
+        state->pendingTranche.scanout = flags & ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_SCANOUT;
     });
 
-    wl_display_roundtrip(waylandState.display);
+    feedback->setTrancheDone([state](CCZwpLinuxDmabufFeedbackV1* r) {
+        state->pendingTranches.emplace_back(std::move(state->pendingTranche));
+        state->pendingTranche = {};
+    });
 
-    if (!drmState.nodeName.empty()) {
-        drmState.fd = open(drmState.nodeName.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
-        if (drmState.fd < 0) {
-            backend->log(AQ_LOG_ERROR, std::format("zwp_linux_dmabuf_v1: Failed to open node {}", drmState.nodeName));
-            return false;
-        }
+    // the host resends all tranches whenever the feedback changes
+    feedback->setDone([state, onDone](CCZwpLinuxDmabufFeedbackV1* r) {
+        state->tranches = std::move(state->pendingTranches);
+        state->pendingTranches.clear();
+        if (onDone)
+            onDone();
+    });
+}
 
-        backend->log(AQ_LOG_DEBUG, std::format("zwp_linux_dmabuf_v1: opened node {} with fd {}", drmState.nodeName, drmState.fd));
+std::vector<SDRMFormat> Aquamarine::SWaylandDmabufFeedback::formats(bool scanoutOnly) const {
+    std::vector<SDRMFormat> result;
+
+    for (auto const& t : tranches) {
+        if (scanoutOnly && !t.scanout)
+            continue;
+
+        for (auto const& f : t.formats) {
+            auto it = std::find_if(result.begin(), result.end(), [&f](const auto& e) { return e.drmFormat == f.drmFormat; });
+            if (it == result.end()) {
+                result.emplace_back(f);
+                continue;
+            }
+
+            for (auto const& m : f.modifiers) {
+                if (std::find(it->modifiers.begin(), it->modifiers.end(), m) == it->modifiers.end())
+                    it->modifiers.emplace_back(m);
+            }
+        }
     }
 
-    return true;
+    return result;
 }
 
 std::vector<SDRMFormat> Aquamarine::CWaylandBackend::getRenderFormats() {
@@ -456,6 +532,14 @@ Aquamarine::CWaylandOutput::CWaylandOutput(const std::string& name_, Hyprutils::
         return;
     }
 
+    waylandState.dmabufFeedback = makeShared<CCZwpLinuxDmabufFeedbackV1>(backend->waylandState.dmabuf->sendGetSurfaceFeedback(waylandState.surface->resource()));
+    if (waylandState.dmabufFeedback->resource()) {
+        backend->listenDmabufFeedback(waylandState.dmabufFeedback, &dmabufFeedback, [this]() {
+            backend->backend->log(AQ_LOG_DEBUG,
+                                  std::format("Output {}: dmabuf feedback has {} tranches, {} scanout formats", name, dmabufFeedback.tranches.size(), getScanoutFormats().size()));
+        });
+    }
+
     waylandState.xdgSurface = makeShared<CCXdgSurface>(backend->waylandState.xdg->sendGetXdgSurface(waylandState.surface->resource()));
 
     if (!waylandState.xdgSurface->resource()) {
@@ -509,6 +593,8 @@ Aquamarine::CWaylandOutput::CWaylandOutput(const std::string& name_, Hyprutils::
 Aquamarine::CWaylandOutput::~CWaylandOutput() {
     backend->idleCallbacks.clear(); // FIXME: mega hack to avoid a UAF in frame events
     events.destroy.emit();
+    if (waylandState.dmabufFeedback)
+        waylandState.dmabufFeedback->sendDestroy();
     if (waylandState.xdgToplevel)
         waylandState.xdgToplevel->sendDestroy();
     if (waylandState.xdgSurface)
@@ -518,10 +604,21 @@ Aquamarine::CWaylandOutput::~CWaylandOutput() {
 }
 
 std::vector<SDRMFormat> Aquamarine::CWaylandOutput::getRenderFormats() {
-    // TODO
-    // this is technically wrong because this returns the format table formats
-    // the actually supported formats are given by tranche formats
-    return backend->getRenderFormats();
+    if (dmabufFeedback.tranches.empty())
+        return backend->getRenderFormats();
+
+    // a format the host can scan out only gets its scanout modifiers, so the swapchain picks one of those
+    auto formats = dmabufFeedback.formats(true);
+    for (auto const& f : dmabufFeedback.formats()) {
+        if (std::find_if(formats.begin(), formats.end(), [&f](const auto& e) { return e.drmFormat == f.drmFormat; }) == formats.end())
+            formats.emplace_back(f);
+    }
+
+    return formats;
+}
+
+std::vector<SDRMFormat> Aquamarine::CWaylandOutput::getScanoutFormats() {
+    return dmabufFeedback.formats(true);
 }
 
 bool Aquamarine::CWaylandOutput::destroy() {
@@ -529,6 +626,7 @@ bool Aquamarine::CWaylandOutput::destroy() {
     waylandState.surface->sendAttach(nullptr, 0, 0);
     waylandState.surface->sendCommit();
     waylandState.frameCallback.reset();
+    waylandState.presentFeedbacks.clear();
     std::erase(backend->outputs, self.lock());
     return true;
 }
@@ -562,7 +660,16 @@ bool Aquamarine::CWaylandOutput::commit() {
         return true;
     }
 
-    if (!swapchain->reconfigure(SSwapchainOptions{.length = 2, .size = pixelSize, .format = format})) {
+    // the least it needs, a depth policy set on the swapchain adds a buffer while the host holds on to them
+    SSwapchainOptions options = {.length = 2, .size = pixelSize, .format = format};
+
+    // the host can put a buffer from its scanout tranche straight on a plane, allocate from it
+    if (!getScanoutFormats().empty()) {
+        options.scanout       = true;
+        options.scanoutOutput = self.lock();
+    }
+
+    if (!swapchain->reconfigure(options)) {
         backend->backend->log(AQ_LOG_ERROR, std::format("Output {}: pending state rejected: swapchain failed reconfiguring", name));
         return false;
     }
@@ -586,13 +693,16 @@ bool Aquamarine::CWaylandOutput::commit() {
         return false;
     }
 
-    if (wlBuffer->pendingRelease)
+    if (wlBuffer->pendingRelease) {
         backend->backend->log(AQ_LOG_WARNING, std::format("Output {}: pending state has a non-released buffer??", name));
+        swapchainFeedback(true); // the host still has it, the swapchain is too short
+    }
 
     wlBuffer->pendingRelease = true;
 
     waylandState.surface->sendAttach(wlBuffer->waylandState.buffer.get(), 0, 0);
-    waylandState.surface->sendDamageBuffer(0, 0, INT32_MAX, INT32_MAX);
+    sendDamage(pixelSize);
+    requestPresentFeedback();
     waylandState.surface->sendCommit();
 
     readyForFrameCallback = true;
@@ -604,27 +714,95 @@ bool Aquamarine::CWaylandOutput::commit() {
     return true;
 }
 
+void Aquamarine::CWaylandOutput::sendDamage(const Vector2D& pixelSize) {
+    // past a handful of rects the host is better off with the bounding box
+    constexpr size_t MAX_DAMAGE_RECTS = 16;
+
+    const bool       SIZECHANGED = pixelSize != lastBufferSize;
+    lastBufferSize               = pixelSize;
+
+    // no damage means the consumer doesn't track it
+    if (SIZECHANGED || !(state->internalState.committed & COutputState::AQ_OUTPUT_STATE_DAMAGE) || state->internalState.damage.empty()) {
+        waylandState.surface->sendDamageBuffer(0, 0, INT32_MAX, INT32_MAX);
+        return;
+    }
+
+    auto damage = state->internalState.damage.copy().intersect(CBox{{}, pixelSize});
+    if (damage.empty())
+        return;
+
+    const auto RECTS = damage.getRects();
+    if (RECTS.size() > MAX_DAMAGE_RECTS) {
+        const auto EXTENTS = damage.getExtents();
+        waylandState.surface->sendDamageBuffer(EXTENTS.x, EXTENTS.y, EXTENTS.w, EXTENTS.h);
+        return;
+    }
+
+    for (auto const& r : RECTS) {
+        waylandState.surface->sendDamageBuffer(r.x1, r.y1, r.x2 - r.x1, r.y2 - r.y1);
+    }
+}
+
+void Aquamarine::CWaylandOutput::requestPresentFeedback() {
+    if (!backend->waylandState.presentation)
+        return;
+
+    auto feedback = makeShared<CCWpPresentationFeedback>(backend->waylandState.presentation->sendFeedback(waylandState.surface->resource()));
+    if (!feedback->resource()) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("Output {}: Failed to request presentation feedback", name));
+        return;
+    }
+
+    feedback->setPresented([this](CCWpPresentationFeedback* r, uint32_t secHi, uint32_t secLo, uint32_t nsec, uint32_t refresh, uint32_t seqHi, uint32_t seqLo, uint32_t flags) {
+        timespec when = {.tv_sec = (time_t)(((uint64_t)secHi << 32) | secLo), .tv_nsec = (long)nsec};
+
+        // the feedback kinds are the same bits as AQ_OUTPUT_PRESENT_*
+        events.present.emit(SPresentEvent{
+            .presented = true,
+            .when      = backend->waylandState.presentClock == CLOCK_MONOTONIC ? &when : nullptr,
+            .seq       = (unsigned int)(((uint64_t)seqHi << 32) | seqLo),
+            .refresh   = (int)refresh,
+            .flags     = flags,
+        });
+
+        std::erase_if(waylandState.presentFeedbacks, [r](const auto& f) { return f.get() == r; });
+        swapchainFeedback(false);
+    });
+
+    feedback->setDiscarded([this](CCWpPresentationFeedback* r) {
+        events.present.emit(SPresentEvent{.presented = false});
+        swapchainFeedback(true);
+        std::erase_if(waylandState.presentFeedbacks, [r](const auto& f) { return f.get() == r; });
+    });
+
+    waylandState.presentFeedbacks.emplace_back(feedback);
+}
+
 SP<IBackendImplementation> Aquamarine::CWaylandOutput::getBackend() {
     return SP<IBackendImplementation>(backend.lock());
 }
 
 SP<CWaylandBuffer> Aquamarine::CWaylandOutput::wlBufferFromBuffer(SP<IBuffer> buffer) {
-    std::erase_if(backendState.buffers, [this](const auto& el) { return el.first.expired() || !swapchain->contains(el.first.lock()); });
+    if (auto it = backendState.buffers.find(buffer.get()); it != backendState.buffers.end()) {
+        if (it->second.buffer == buffer)
+            return it->second.wlBuffer;
 
-    for (auto const& [k, v] : backendState.buffers) {
-        if (k != buffer)
-            continue;
-
-        return v;
+        backendState.buffers.erase(it);
     }
 
-    // create a new one
+    // buffers not emitting destroy leave expired entries behind, drop those before adding one
+    std::erase_if(backendState.buffers, [](const auto& e) { return e.second.buffer.expired(); });
+
     auto wlBuffer = makeShared<CWaylandBuffer>(buffer, backend);
 
     if (!wlBuffer->good())
         return nullptr;
 
-    backendState.buffers.emplace_back(std::make_pair<>(buffer, wlBuffer));
+    backendState.buffers[buffer.get()] = SBufferEntry{
+        .buffer   = buffer,
+        .wlBuffer = wlBuffer,
+        .destroy  = buffer->events.destroy.registerListener([this, key = buffer.get()](std::any d) { backendState.buffers.erase(key); }),
+    };
 
     return wlBuffer;
 }
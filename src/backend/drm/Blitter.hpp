@@ -0,0 +1,34 @@
+#pragma once
+
+#include <aquamarine/buffer/Buffer.hpp>
+#include <hyprutils/math/Region.hpp>
+#include <optional>
+#include <string>
+
+namespace Aquamarine {
+    struct SDRMBlitResult {
+        bool                    success = false;
+        std::optional<int>      syncFD;    // owned by the blitter, valid until its next blit. blitAsync() hands it over instead
+        uint64_t                cpuNs = 0; // time spent submitting the blit
+        std::optional<uint64_t> gpuNs;     // GPU time of an earlier blit whose timer query finished since, if supported
+    };
+
+    /*
+        Copies buffers for a drm backend that blits: secondary gpu frames, cursors and scaled captures.
+        Each says in canBlit() which pairs it takes. CDRMBackend::blit() leaves the rest, and failures, to the GLES CDRMRenderer, which also scales
+        and converts, as long as it can render to the destination.
+    */
+    class IDRMBlitter {
+      public:
+        virtual ~IDRMBlitter() = default;
+
+        // whether blit() can do this pair at all
+        virtual bool           canBlit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to) = 0;
+
+        // damage is in from's coordinates, an empty region blits the whole buffer
+        virtual SDRMBlitResult blit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to, int waitFD = -1,
+                                    const Hyprutils::Math::CRegion& damage = {}) = 0;
+
+        virtual std::string    name() = 0;
+    };
+};
@@ -9,10 +9,18 @@
 #include <thread>
 #include <deque>
 #include <cstring>
+#include <string_view>
+#include <utility>
+#include <functional>
 #include <filesystem>
 #include <system_error>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <fcntl.h>
+#include <algorithm>
 
 extern "C" {
 #include <libseat.h>
@@ -27,14 +35,22 @@ extern "C" {
 #include "Props.hpp"
 #include "FormatUtils.hpp"
 #include "Shared.hpp"
+#include "Tracepoints.hpp"
 #include "hwdata.hpp"
 #include "Renderer.hpp"
+#include "VulkanBlitter.hpp"
 
 using namespace Aquamarine;
 using namespace Hyprutils::Memory;
 using namespace Hyprutils::Math;
 #define SP CSharedPointer
 
+static uint64_t monotonicNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
 Aquamarine::CDRMBackend::CDRMBackend(SP<CBackend> backend_) : backend(backend_) {
     listeners.sessionActivate = backend->session->events.changeActive.registerListener([this](std::any d) {
         if (backend->session->active) {
@@ -42,6 +58,8 @@ Aquamarine::CDRMBackend::CDRMBackend(SP<CBackend> backend_) : backend(backend_)
             restoreAfterVT();
         }
     });
+
+    frameDeadlineFD = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
 }
 
 static udev_enumerate* enumDRMCards(udev* udev) {
@@ -214,12 +232,61 @@ std::vector<SP<CDRMBackend>> Aquamarine::CDRMBackend::attempt(SP<CBackend> backe
 
     backend->log(AQ_LOG_DEBUG, std::format("drm: Found {} GPUs", gpus.size()));
 
+    using Clock = std::chrono::steady_clock;
+
+    const auto startedAt = Clock::now();
+
+    struct SProbe {
+        SP<CDRMBackend>                                backend;
+        bool                                           ok = false;
+        std::vector<std::pair<uint32_t, std::string>> logs;
+        float                                          probeMs = 0;
+    };
+
+    std::vector<SProbe> probes;
+    probes.reserve(gpus.size());
+
+    for (auto const& gpu : gpus) {
+        auto& probe         = probes.emplace_back();
+        probe.backend       = SP<CDRMBackend>(new CDRMBackend(backend));
+        probe.backend->self = probe.backend;
+        probe.backend->gpu  = gpu;
+    }
+
+    // the probing is ioctls (and edid reads for connected ones) on each gpu's own fd, and only touches that gpu's backend.
+    // Run it concurrently, and keep everything that talks to the compositor or other gpus below, in order, on this thread.
+    const auto runProbe = [](SProbe& probe) {
+        const auto probeStarted = Clock::now();
+
+        threadLogSink = &probe.logs;
+        probe.ok      = probe.backend->probe();
+        probe.probeMs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - probeStarted).count() / 1000.F;
+        threadLogSink = nullptr;
+    };
+
+    if (probes.size() == 1)
+        runProbe(probes.front());
+    else {
+        std::vector<std::thread> threads;
+        threads.reserve(probes.size());
+
+        for (auto& probe : probes) {
+            threads.emplace_back(runProbe, std::ref(probe));
+        }
+
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    const auto probedAt = Clock::now();
+
     std::vector<SP<CDRMBackend>> backends;
     SP<CDRMBackend>              newPrimary;
 
-    for (auto const& gpu : gpus) {
-        auto drmBackend  = SP<CDRMBackend>(new CDRMBackend(backend));
-        drmBackend->self = drmBackend;
+    for (auto& probe : probes) {
+        auto& drmBackend = probe.backend;
+        auto  gpu        = drmBackend->gpu;
 
         if (!drmBackend->registerGPU(gpu, newPrimary)) {
             backend->log(AQ_LOG_ERROR, std::format("drm: Failed to register gpu {}", gpu->path));
@@ -227,24 +294,25 @@ std::vector<SP<CDRMBackend>> Aquamarine::CDRMBackend::attempt(SP<CBackend> backe
         } else
             backend->log(AQ_LOG_DEBUG, std::format("drm: Registered gpu {}", gpu->path));
 
+        for (auto const& [level, msg] : probe.logs) {
+            backend->log((eBackendLogLevel)level, msg);
+        }
+
         // TODO: consider listening for new devices
         // But if you expect me to handle gpu hotswaps you are probably insane LOL
 
-        if (!drmBackend->checkFeatures()) {
-            backend->log(AQ_LOG_ERROR, "drm: Failed checking features");
-            continue;
-        }
-
-        if (!drmBackend->initResources()) {
-            backend->log(AQ_LOG_ERROR, "drm: Failed initializing resources");
+        if (!probe.ok)
             continue;
-        }
 
         backend->log(AQ_LOG_DEBUG, std::format("drm: Basic init pass for gpu {}", gpu->path));
 
-        drmBackend->grabFormats();
+        const auto outputsStarted = Clock::now();
+
+        drmBackend->connectOutputs();
 
-        drmBackend->recheckOutputs();
+        backend->log(AQ_LOG_DEBUG,
+                     std::format("drm: gpu {} took {:.2f}ms to probe and {:.2f}ms to connect outputs", gpu->path, probe.probeMs,
+                                 std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - outputsStarted).count() / 1000.F));
 
         if (!newPrimary) {
             backend->log(AQ_LOG_DEBUG, std::format("drm: gpu {} becomes primary drm", gpu->path));
@@ -259,11 +327,304 @@ std::vector<SP<CDRMBackend>> Aquamarine::CDRMBackend::attempt(SP<CBackend> backe
         backend->session->sessionDevices.push_back(gpu);
     }
 
+    backend->log(AQ_LOG_DEBUG,
+                 std::format("drm: Started {} of {} gpus in {:.2f}ms, {:.2f}ms of it probing", backends.size(), gpus.size(),
+                             std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startedAt).count() / 1000.F,
+                             std::chrono::duration_cast<std::chrono::microseconds>(probedAt - startedAt).count() / 1000.F));
+
     return backends;
 }
 
 Aquamarine::CDRMBackend::~CDRMBackend() {
-    ;
+    if (frameDeadlineFD >= 0)
+        close(frameDeadlineFD);
+}
+
+void Aquamarine::CDRMBackend::updateFrameDeadlines() {
+    if (frameDeadlineFD < 0)
+        return;
+
+    uint64_t earliest = 0;
+    for (auto const& c : connectors) {
+        if (!c->output)
+            continue;
+
+        for (const auto AT : {c->output->deadline.fireAt, c->output->lfc.fireAt}) {
+            if (AT && (!earliest || AT < earliest))
+                earliest = AT;
+        }
+    }
+
+    // a zeroed it_value disarms the timer
+    itimerspec ts = {.it_value = {.tv_sec = (time_t)(earliest / 1000000000ULL), .tv_nsec = (long)(earliest % 1000000000ULL)}};
+
+    if (timerfd_settime(frameDeadlineFD, TFD_TIMER_ABSTIME, &ts, nullptr))
+        backend->log(AQ_LOG_ERROR, std::format("drm: failed to arm the frame deadline timerfd: {}", strerror(errno)));
+}
+
+void Aquamarine::CDRMBackend::dispatchFrameDeadlines() {
+    uint64_t expirations = 0;
+    if (read(frameDeadlineFD, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return; // re-armed before we got here
+
+    const uint64_t NOW = monotonicNs();
+
+    // copy, a frame handler may hotplug / destroy outputs
+    auto cpy = connectors;
+    for (auto const& c : cpy) {
+        // no new frame in time for the panel's minimum refresh, show the last one again. Its flip arms the next repeat
+        if (c->output && c->output->lfc.fireAt && c->output->lfc.fireAt <= NOW) {
+            c->output->lfc.fireAt = 0;
+            c->repeatFrame();
+        }
+
+        if (!c->output || !c->output->deadline.fireAt || c->output->deadline.fireAt > NOW)
+            continue;
+
+        c->output->deadline.fireAt = 0;
+        c->frameEventScheduled     = false;
+
+        // the compositor committed in the meantime, handlePF will send the frame
+        if (c->isPageFlipPending || c->isBlitPending || !c->output->enabledState || !sessionActive())
+            continue;
+
+        c->output->deliverFrame();
+    }
+
+    updateFrameDeadlines();
+}
+
+bool Aquamarine::CDRMBackend::commitOutputs(const std::vector<SP<IOutput>>& outputs) {
+    return commitBatch(outputs, false);
+}
+
+bool Aquamarine::CDRMBackend::testOutputs(const std::vector<SP<IOutput>>& outputs) {
+    return commitBatch(outputs, true);
+}
+
+bool Aquamarine::CDRMBackend::commitBatch(const std::vector<SP<IOutput>>& outputs, bool onlyTest) {
+    std::vector<SP<CDRMOutput>> drmOutputs;
+
+    for (auto const& o : outputs) {
+        auto it = std::find_if(connectors.begin(), connectors.end(), [&o](const auto& c) { return c->output && c->output.get() == o.get(); });
+        if (it == connectors.end()) {
+            backend->log(AQ_LOG_ERROR, std::format("drm: Cannot batch output {}, it doesn't belong to this backend", o ? o->name : "null"));
+            return false;
+        }
+
+        drmOutputs.emplace_back((*it)->output);
+    }
+
+    // nothing to merge
+    if (!atomic || drmOutputs.size() < 2) {
+        bool ok = true;
+        for (auto const& o : drmOutputs) {
+            ok = (onlyTest ? o->test() : o->commit()) && ok;
+        }
+        return ok;
+    }
+
+    // in connector order, so two batches sharing outputs can't deadlock each other
+    std::vector<std::unique_lock<std::recursive_mutex>> locks;
+    for (auto const& c : connectors) {
+        if (std::find(drmOutputs.begin(), drmOutputs.end(), c->output) != drmOutputs.end())
+            locks.emplace_back(c->mutex);
+    }
+
+    bool                                 ok = true;
+    std::vector<SDRMConnectorCommitData> datas(drmOutputs.size());
+    std::vector<SDRMBatchCommit>         batch;
+    std::vector<size_t>                  single; // can't be merged, e.g. tearing
+
+    for (size_t i = 0; i < drmOutputs.size(); ++i) {
+        switch (drmOutputs.at(i)->prepareCommit(onlyTest, datas.at(i), true)) {
+            case CDRMOutput::AQ_COMMIT_PREPARE_FAILED: ok = false; break;
+            case CDRMOutput::AQ_COMMIT_PREPARE_DONE: break;
+            case CDRMOutput::AQ_COMMIT_PREPARE_READY:
+                if (datas.at(i).flags & DRM_MODE_PAGE_FLIP_ASYNC)
+                    single.emplace_back(i);
+                else
+                    batch.emplace_back(SDRMBatchCommit{.connector = drmOutputs.at(i)->connector, .output = drmOutputs.at(i), .data = &datas.at(i)});
+                break;
+        }
+    }
+
+    for (auto const& i : single) {
+        ok = drmOutputs.at(i)->commitPrepared(datas.at(i)) && ok;
+    }
+
+    if (batch.size() == 1)
+        return batch.at(0).output->commitPrepared(*batch.at(0).data) && ok;
+
+    if (batch.empty())
+        return ok;
+
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: Committing {} outputs in one request", batch.size())));
+
+    if (impl->commitBatch(batch)) {
+        for (auto const& b : batch) {
+            b.output->stats.onCommit(onlyTest, true);
+
+            if (onlyTest)
+                continue;
+
+            b.connector->applyCommit(*b.data);
+            b.output->onCommitted(*b.data);
+        }
+
+        return ok;
+    }
+
+    for (auto const& b : batch) {
+        b.connector->rollbackCommit(*b.data);
+    }
+
+    // a test tells about all of them together, nothing to retry
+    if (onlyTest) {
+        for (auto const& b : batch) {
+            b.output->stats.onCommit(true, false);
+        }
+
+        return false;
+    }
+
+    backend->log(AQ_LOG_DEBUG, "drm: Batched commit failed, committing outputs one by one");
+
+    for (auto const& b : batch) {
+        ok = b.output->commitPrepared(*b.data) && ok;
+    }
+
+    return ok;
+}
+
+std::optional<CDRMBackend::SFBCacheKey> Aquamarine::CDRMBackend::fbCacheKey(const SDMABUFAttrs& attrs) {
+    if (!attrs.success)
+        return std::nullopt;
+
+    SFBCacheKey key = {
+        .format   = attrs.format,
+        .width    = (uint32_t)attrs.size.x,
+        .height   = (uint32_t)attrs.size.y,
+        .modifier = attrs.modifier,
+        .offsets  = attrs.offsets,
+        .strides  = attrs.strides,
+    };
+
+    // all planes have to live in the same dmabuf for the inode to identify the buffer
+    for (int i = 0; i < attrs.planes; ++i) {
+        struct stat st;
+        if (fstat(attrs.fds.at(i), &st))
+            return std::nullopt;
+
+        if (i == 0) {
+            key.dev = st.st_dev;
+            key.ino = st.st_ino;
+        } else if (key.dev != st.st_dev || key.ino != st.st_ino)
+            return std::nullopt;
+    }
+
+    return key;
+}
+
+SP<CDRMFB> Aquamarine::CDRMBackend::fbCacheGet(const SFBCacheKey& key) {
+    std::lock_guard<std::mutex> lg(cacheMutex);
+
+    auto it = std::find_if(fbCache.begin(), fbCache.end(), [&key](const auto& e) { return e.first == key; });
+    if (it == fbCache.end())
+        return nullptr;
+
+    if (it->second->dead || !it->second->id) {
+        it->second->cached = false;
+        fbCache.erase(it);
+        return nullptr;
+    }
+
+    fbCache.splice(fbCache.begin(), fbCache, it);
+
+    return fbCache.front().second;
+}
+
+SP<CDRMFB> Aquamarine::CDRMBackend::fbCacheRemove(CDRMFB* fb) {
+    std::lock_guard<std::mutex> lg(cacheMutex);
+
+    auto it = std::find_if(fbCache.begin(), fbCache.end(), [fb](const auto& e) { return e.second.get() == fb; });
+    if (it == fbCache.end())
+        return nullptr;
+
+    auto removed    = it->second;
+    removed->cached = false;
+    fbCache.erase(it);
+
+    return removed;
+}
+
+void Aquamarine::CDRMBackend::fbCacheAdd(const SFBCacheKey& key, SP<CDRMFB> fb) {
+    constexpr size_t MAX_CACHED_FBS = 32;
+
+    std::lock_guard<std::mutex> lg(cacheMutex);
+
+    fb->cached = true;
+    fbCache.emplace_front(key, fb);
+
+    while (fbCache.size() > MAX_CACHED_FBS) {
+        // an fb without a buffer goes away once nothing scans it out anymore, otherwise the buffer takes it from here
+        fbCache.back().second->cached = false;
+        fbCache.pop_back();
+    }
+}
+
+uint32_t Aquamarine::CDRMBackend::blobGet(const void* data, size_t len) {
+    const auto BYTES = std::string_view{(const char*)data, len};
+    const auto HASH  = std::hash<std::string_view>{}(BYTES);
+
+    std::lock_guard<std::mutex> lg(cacheMutex);
+
+    auto       it = std::find_if(propertyBlobs.begin(), propertyBlobs.end(),
+                                 [&](const auto& e) { return e.hash == HASH && std::string_view{(const char*)e.data.data(), e.data.size()} == BYTES; });
+    if (it != propertyBlobs.end()) {
+        it->refs++;
+        propertyBlobs.splice(propertyBlobs.begin(), propertyBlobs, it);
+        return propertyBlobs.front().id;
+    }
+
+    uint32_t id = 0;
+    if (drmModeCreatePropertyBlob(gpu->fd, data, len, &id))
+        return 0;
+
+    propertyBlobs.emplace_front(SPropertyBlob{.id = id, .refs = 1, .hash = HASH, .data = {BYTES.begin(), BYTES.end()}});
+
+    return id;
+}
+
+void Aquamarine::CDRMBackend::blobRelease(uint32_t id) {
+    constexpr size_t MAX_IDLE_BLOBS = 8;
+
+    if (!id)
+        return;
+
+    std::lock_guard<std::mutex> lg(cacheMutex);
+
+    auto it = std::find_if(propertyBlobs.begin(), propertyBlobs.end(), [id](const auto& e) { return e.id == id; });
+    if (it == propertyBlobs.end()) {
+        if (drmModeDestroyPropertyBlob(gpu->fd, id))
+            backend->log(AQ_LOG_ERROR, "drm: failed to destroy a blob");
+        return;
+    }
+
+    if (it->refs > 0)
+        it->refs--;
+
+    size_t idle = 0;
+    for (auto b = propertyBlobs.begin(); b != propertyBlobs.end();) {
+        if (b->refs || ++idle <= MAX_IDLE_BLOBS) {
+            ++b;
+            continue;
+        }
+
+        if (drmModeDestroyPropertyBlob(gpu->fd, b->id))
+            backend->log(AQ_LOG_ERROR, "drm: failed to destroy a blob");
+        b = propertyBlobs.erase(b);
+    }
 }
 
 void Aquamarine::CDRMBackend::log(eBackendLogLevel l, const std::string& s) {
@@ -281,6 +642,14 @@ void Aquamarine::CDRMBackend::restoreAfterVT() {
 
     backend->log(AQ_LOG_DEBUG, "drm: Rescanned connectors");
 
+    // nothing changed while we were away, put the last frames straight back instead of blanking and modesetting every crtc
+    if (impl->restore()) {
+        backend->log(AQ_LOG_DEBUG, "drm: Restored the last committed state in one commit");
+        return;
+    }
+
+    backend->log(AQ_LOG_DEBUG, "drm: Couldn't restore the last committed state as-is, modesetting");
+
     if (!impl->reset())
         backend->log(AQ_LOG_ERROR, "drm: failed reset");
 
@@ -519,30 +888,47 @@ bool Aquamarine::CDRMBackend::initMgpu() {
 
     rendererState.renderer->self = rendererState.renderer;
 
+    if (envEnabled("AQ_MGPU_ASYNC_BLIT") && primary)
+        rendererState.renderer->startBlitThread();
+
+#ifdef AQUAMARINE_VULKAN
+    if (primary && !envEnabled("AQ_MGPU_NO_COPY_BLIT"))
+        rendererState.copyBlitter = CDRMVulkanBlitter::create(gpu->fd, backend.lock());
+#endif
+
     buildGlFormats(rendererState.renderer->formats);
 
     return true;
 }
 
+SDRMBlitResult Aquamarine::CDRMBackend::blit(SP<IBuffer> from, SP<IBuffer> to, int waitFD, const CRegion& damage) {
+    if (rendererState.copyBlitter && rendererState.copyBlitter->canBlit(from, to)) {
+        auto result = rendererState.copyBlitter->blit(from, to, waitFD, damage);
+        if (result.success)
+            return result;
+
+        backend->log(AQ_LOG_DEBUG, std::format("drm: {} blit failed, falling back to {}", rendererState.copyBlitter->name(), rendererState.renderer->name()));
+    }
+
+    return rendererState.renderer->blit(from, to, waitFD, damage);
+}
+
 void Aquamarine::CDRMBackend::buildGlFormats(const std::vector<SGLFormat>& fmts) {
-    std::vector<SDRMFormat> result;
+    CDRMFormatTable result;
 
     for (auto const& fmt : fmts) {
         if (fmt.external && fmt.modifier != DRM_FORMAT_MOD_INVALID)
             continue;
 
-        if (auto it = std::find_if(result.begin(), result.end(), [fmt](const auto& e) { return fmt.drmFormat == e.drmFormat; }); it != result.end()) {
-            it->modifiers.emplace_back(fmt.modifier);
-            continue;
-        }
-
-        result.emplace_back(SDRMFormat{
-            fmt.drmFormat,
-            {fmt.modifier},
-        });
+        result.add(fmt.drmFormat, fmt.modifier);
     }
 
     glFormats = result;
+
+    // allocations for scanout clip to these, intersect once instead of per buffer
+    for (auto const& p : planes) {
+        p->renderable = glFormats.empty() ? p->formats : p->formats.intersect(glFormats);
+    }
 }
 
 void Aquamarine::CDRMBackend::recheckCRTCs() {
@@ -627,6 +1013,33 @@ bool Aquamarine::CDRMBackend::grabFormats() {
     return true;
 }
 
+bool Aquamarine::CDRMBackend::probe() {
+    if (!checkFeatures()) {
+        backend->log(AQ_LOG_ERROR, "drm: Failed checking features");
+        return false;
+    }
+
+    if (!initResources()) {
+        backend->log(AQ_LOG_ERROR, "drm: Failed initializing resources");
+        return false;
+    }
+
+    grabFormats();
+
+    scanConnectors();
+
+    // reading the edid is the slow part of connecting, get it done here
+    for (auto const& c : connectors) {
+        if (c->status != DRM_MODE_CONNECTED)
+            continue;
+
+        c->fetchEDID();
+        c->edidPrefetched = true;
+    }
+
+    return true;
+}
+
 bool Aquamarine::CDRMBackend::registerGPU(SP<CSessionDevice> gpu_, SP<CDRMBackend> primary_) {
     gpu     = gpu_;
     primary = primary_;
@@ -649,8 +1062,12 @@ bool Aquamarine::CDRMBackend::registerGPU(SP<CSessionDevice> gpu_, SP<CDRMBacken
     listeners.gpuChange = gpu->events.change.registerListener([this](std::any d) {
         auto E = std::any_cast<CSessionDevice::SChangeEvent>(d);
         if (E.type == CSessionDevice::AQ_SESSION_EVENT_CHANGE_HOTPLUG) {
-            backend->log(AQ_LOG_DEBUG, std::format("drm: Got a hotplug event for {}", gpuName));
-            recheckOutputs();
+            backend->log(AQ_LOG_DEBUG,
+                         std::format("drm: Got a hotplug event for {}{}", gpuName, E.hotplug.connectorID ? std::format(", connector id {}", E.hotplug.connectorID) : ""));
+            if (E.hotplug.connectorID)
+                recheckConnector(E.hotplug.connectorID);
+            else
+                recheckOutputs();
         } else if (E.type == CSessionDevice::AQ_SESSION_EVENT_CHANGE_LEASE) {
             backend->log(AQ_LOG_DEBUG, std::format("drm: Got a lease event for {}", gpuName));
             scanLeases();
@@ -669,7 +1086,10 @@ eBackendType Aquamarine::CDRMBackend::type() {
 
 void Aquamarine::CDRMBackend::recheckOutputs() {
     scanConnectors();
+    connectOutputs();
+}
 
+void Aquamarine::CDRMBackend::connectOutputs() {
     // disconnect now to possibly free up crtcs
     for (const auto& conn : connectors) {
         if (conn->status != DRM_MODE_CONNECTED && conn->output) {
@@ -685,7 +1105,8 @@ void Aquamarine::CDRMBackend::recheckOutputs() {
         if (conn->status == DRM_MODE_CONNECTED && !conn->output) {
             backend->log(AQ_LOG_DEBUG, std::format("drm: Connector {} connected", conn->szName));
 
-            auto drmConn = drmModeGetConnector(gpu->fd, conn->id);
+            // scanConnectors() just probed it, don't make the kernel probe it again
+            auto drmConn = drmModeGetConnectorCurrent(gpu->fd, conn->id);
 
             // ??? was valid 5 sec ago...
             if (!drmConn) {
@@ -697,11 +1118,19 @@ void Aquamarine::CDRMBackend::recheckOutputs() {
             drmModeFreeConnector(drmConn);
         }
     }
+
+    // a prefetch nothing consumed is stale by the next scan, whatever is plugged in then gets its own edid read
+    for (const auto& conn : connectors) {
+        conn->edidPrefetched = false;
+    }
 }
 
 void Aquamarine::CDRMBackend::scanConnectors() {
     backend->log(AQ_LOG_DEBUG, std::format("drm: Scanning connectors for {}", gpu->path));
 
+    // hotplugs and vt switches, connectors and crtcs may have changed under us
+    testCacheGeneration++;
+
     auto resources = drmModeGetResources(gpu->fd);
     if (!resources) {
         backend->log(AQ_LOG_ERROR, std::format("drm: Scanning connectors for {} failed", gpu->path));
@@ -761,7 +1190,61 @@ void Aquamarine::CDRMBackend::scanConnectors() {
     drmModeFreeResources(resources);
 }
 
+void Aquamarine::CDRMBackend::recheckConnector(uint32_t connectorID) {
+    auto it = std::find_if(connectors.begin(), connectors.end(), [connectorID](const auto& e) { return e->id == connectorID; });
+    if (it == connectors.end()) {
+        // a new one, e.g. a mst branch, needs a full scan
+        backend->log(AQ_LOG_DEBUG, std::format("drm: Hotplug for unknown connector id {}, rescanning all", connectorID));
+        recheckOutputs();
+        return;
+    }
+
+    auto conn    = *it;
+    auto drmConn = drmModeGetConnector(gpu->fd, connectorID);
+    if (!drmConn) {
+        backend->log(AQ_LOG_DEBUG, std::format("drm: Hotplug for connector {}, but it's gone, rescanning all", conn->szName));
+        recheckOutputs();
+        return;
+    }
+
+    // hotplugs may have changed the connector under us
+    testCacheGeneration++;
+
+    conn->status = drmConn->connection;
+
+    if (conn->crtc)
+        conn->recheckCRTCProps();
+
+    backend->log(AQ_LOG_DEBUG, std::format("drm: Connector {} connection state: {}", conn->szName, (int)drmConn->connection));
+
+    const bool connecting    = conn->status == DRM_MODE_CONNECTED && !conn->output;
+    const bool disconnecting = conn->status != DRM_MODE_CONNECTED && conn->output;
+
+    // e.g. a property or link-status change, crtcs and other outputs stay as they are
+    if (!connecting && !disconnecting) {
+        drmModeFreeConnector(drmConn);
+        return;
+    }
+
+    if (disconnecting) {
+        backend->log(AQ_LOG_DEBUG, std::format("drm: Connector {} disconnected", conn->szName));
+        conn->disconnect();
+    }
+
+    // a freed crtc may go to another connector waiting for one
+    recheckCRTCs();
+
+    if (connecting) {
+        backend->log(AQ_LOG_DEBUG, std::format("drm: Connector {} connected", conn->szName));
+        conn->connect(drmConn);
+    }
+
+    drmModeFreeConnector(drmConn);
+}
+
 void Aquamarine::CDRMBackend::scanLeases() {
+    testCacheGeneration++;
+
     auto lessees = drmModeListLessees(gpu->fd);
     if (!lessees) {
         backend->log(AQ_LOG_ERROR, "drmModeListLessees failed");
@@ -809,7 +1292,15 @@ bool Aquamarine::CDRMBackend::start() {
 }
 
 std::vector<Hyprutils::Memory::CSharedPointer<SPollFD>> Aquamarine::CDRMBackend::pollFDs() {
-    return {makeShared<SPollFD>(gpu->fd, [this]() { dispatchEvents(); })};
+    std::vector<SP<SPollFD>> result = {makeShared<SPollFD>(gpu->fd, [this]() { dispatchEvents(); })};
+
+    if (rendererState.renderer && rendererState.renderer->asyncBlitFD() >= 0)
+        result.emplace_back(makeShared<SPollFD>(rendererState.renderer->asyncBlitFD(), [this]() { rendererState.renderer->dispatchAsyncBlits(); }));
+
+    if (frameDeadlineFD >= 0)
+        result.emplace_back(makeShared<SPollFD>(frameDeadlineFD, [this]() { dispatchFrameDeadlines(); }));
+
+    return result;
 }
 
 int Aquamarine::CDRMBackend::drmFD() {
@@ -822,45 +1313,100 @@ static void handlePF(int fd, unsigned seq, unsigned tv_sec, unsigned tv_usec, un
     if (!pageFlip->connector)
         return;
 
-    pageFlip->connector->isPageFlipPending = false;
+    auto        connector = pageFlip->connector.lock();
+    const auto& BACKEND   = connector->backend;
+
+    if (pageFlip->cursorOnly) {
+        std::lock_guard<std::recursive_mutex> lg(connector->mutex);
+        connector->isCursorFlipPending = false;
+
+        TRACE(BACKEND->log(AQ_LOG_TRACE, std::format("drm: cursor pf event seq {} crtc {}", seq, crtc_id)));
+
+        // a cursor-only commit makes the new fb front and back right away, the one it replaced is off the plane now
+        if (auto cursor = connector->crtc ? connector->crtc->cursor : nullptr; cursor && cursor->last && cursor->last != cursor->front) {
+            if (cursor->last->buffer) {
+                cursor->last->buffer->lockedByBackend = false;
+                cursor->last->buffer->events.backendRelease.emit();
+            }
+            cursor->last.reset();
+        }
+
+        if (connector->status == DRM_MODE_CONNECTED && connector->crtc)
+            connector->flushCursor();
+
+        return;
+    }
+
+    // a batched commit passes one connector's data for every crtc in it
+    if (connector->crtc && connector->crtc->id != crtc_id) {
+        connector = connector->connectorForCRTC(crtc_id).lock();
+        if (!connector) {
+            BACKEND->log(AQ_LOG_DEBUG, std::format("drm: Ignoring a pf event for unknown crtc {}", crtc_id));
+            return;
+        }
+    }
+
+    // threaded outputs commit from their own thread, the lock keeps the flip state consistent with it.
+    // Events are queued by deliver*() for those, so nothing here calls back into the consumer with the lock held.
+    std::lock_guard<std::recursive_mutex> lg(connector->mutex);
 
-    const auto& BACKEND = pageFlip->connector->backend;
+    AQ_TRACE_SCOPE("aq page flip conn {} seq {}", connector->id, seq);
+    AQ_TRACE_ASYNC_END(connector->id, "aq flip conn {}", connector->id);
+
+    connector->isPageFlipPending = false;
 
     TRACE(BACKEND->log(AQ_LOG_TRACE, std::format("drm: pf event seq {} sec {} usec {} crtc {}", seq, tv_sec, tv_usec, crtc_id)));
 
-    if (pageFlip->connector->status != DRM_MODE_CONNECTED || !pageFlip->connector->crtc) {
+    if (connector->status != DRM_MODE_CONNECTED || !connector->crtc) {
         BACKEND->log(AQ_LOG_DEBUG, "drm: Ignoring a pf event from a disabled crtc / connector");
         return;
     }
 
-    pageFlip->connector->onPresent();
-
-    uint32_t flags = IOutput::AQ_OUTPUT_PRESENT_VSYNC | IOutput::AQ_OUTPUT_PRESENT_HW_CLOCK | IOutput::AQ_OUTPUT_PRESENT_HW_COMPLETION | IOutput::AQ_OUTPUT_PRESENT_ZEROCOPY;
+    connector->onPresent();
 
     timespec presented = {.tv_sec = (time_t)tv_sec, .tv_nsec = (long)(tv_usec * 1000)};
 
-    pageFlip->connector->output->events.present.emit(IOutput::SPresentEvent{
-        .presented = BACKEND->sessionActive(),
-        .when      = &presented,
-        .seq       = seq,
-        .refresh   = (int)(pageFlip->connector->refresh ? (1000000000000LL / pageFlip->connector->refresh) : 0),
-        .flags     = flags,
-    });
+    connector->onVblank(presented, seq);
 
-    if (BACKEND->sessionActive() && !pageFlip->connector->frameEventScheduled && pageFlip->connector->output->enabledState)
-        pageFlip->connector->output->events.frame.emit();
-}
+    const bool REPEATED = std::exchange(connector->pendingPageFlip.repeated, false);
 
-bool Aquamarine::CDRMBackend::dispatchEvents() {
-    drmEventContext event = {
-        .version            = 3,
-        .page_flip_handler2 = ::handlePF,
-    };
+    connector->armLFC((uint64_t)presented.tv_sec * 1000000000ULL + presented.tv_nsec, REPEATED);
 
-    if (drmHandleEvent(gpu->fd, &event) != 0)
-        backend->log(AQ_LOG_ERROR, std::format("drm: Failed to handle event on fd {}", gpu->fd));
+    uint32_t flags = IOutput::AQ_OUTPUT_PRESENT_VSYNC | IOutput::AQ_OUTPUT_PRESENT_HW_CLOCK | IOutput::AQ_OUTPUT_PRESENT_HW_COMPLETION;
+    if (connector->pendingPageFlip.zeroCopy)
+        flags |= IOutput::AQ_OUTPUT_PRESENT_ZEROCOPY;
 
-    return true;
+    // right at the flip, and before the present event so a compositor committing from it doesn't get queued behind an older frame
+    if (BACKEND->sessionActive())
+        connector->output->flushMailbox();
+
+    // nothing the compositor committed was presented by a repeat
+    if (!REPEATED)
+        connector->output->deliverPresent(IOutput::SPresentEvent{
+            .presented = BACKEND->sessionActive(),
+            .when      = &presented,
+            .seq       = seq,
+            .refresh   = (int)(connector->refresh ? (1000000000000LL / connector->refresh) : 0),
+            .flags     = flags,
+        });
+
+    if (BACKEND->sessionActive() && !connector->frameEventScheduled && connector->output->enabledState && !connector->deferFrame())
+        connector->output->deliverFrame();
+
+    // the cursor moved while the flip was in flight, and the frame (if any) didn't carry it.
+    connector->flushCursor();
+}
+
+bool Aquamarine::CDRMBackend::dispatchEvents() {
+    drmEventContext event = {
+        .version            = 3,
+        .page_flip_handler2 = ::handlePF,
+    };
+
+    if (drmHandleEvent(gpu->fd, &event) != 0)
+        backend->log(AQ_LOG_ERROR, std::format("drm: Failed to handle event on fd {}", gpu->fd));
+
+    return true;
 }
 
 uint32_t Aquamarine::CDRMBackend::capabilities() {
@@ -921,14 +1467,14 @@ std::vector<SDRMFormat> Aquamarine::CDRMBackend::getRenderFormats() {
         if (p->type != DRM_PLANE_TYPE_PRIMARY)
             continue;
 
-        return p->formats;
+        return p->formats.list();
     }
 
     return {};
 }
 
 std::vector<SDRMFormat> Aquamarine::CDRMBackend::getRenderableFormats() {
-    return glFormats;
+    return glFormats.list();
 }
 
 std::vector<SDRMFormat> Aquamarine::CDRMBackend::getCursorFormats() {
@@ -942,14 +1488,14 @@ std::vector<SDRMFormat> Aquamarine::CDRMBackend::getCursorFormats() {
             // this is a secondary GPU renderer. In order to receive buffers,
             // we'll force linear modifiers.
             // TODO: don't. Find a common maybe?
-            auto fmts = p->formats;
+            auto fmts = p->formats.list();
             for (auto& fmt : fmts) {
                 fmt.modifiers = {DRM_FORMAT_MOD_LINEAR};
             }
             return fmts;
         }
 
-        return p->formats;
+        return p->formats.list();
     }
 
     return {};
@@ -999,10 +1545,9 @@ bool Aquamarine::SDRMPlane::init(drmModePlane* plane) {
     backend->backend->log(AQ_LOG_DEBUG, std::format("drm: Plane {} has {} formats", id, plane->count_formats));
 
     for (size_t i = 0; i < plane->count_formats; ++i) {
+        formats.add(plane->formats[i], DRM_FORMAT_MOD_LINEAR);
         if (type != DRM_PLANE_TYPE_CURSOR)
-            formats.emplace_back(SDRMFormat{.drmFormat = plane->formats[i], .modifiers = {DRM_FORMAT_MOD_LINEAR, DRM_FORMAT_MOD_INVALID}});
-        else
-            formats.emplace_back(SDRMFormat{.drmFormat = plane->formats[i], .modifiers = {DRM_FORMAT_MOD_LINEAR}});
+            formats.add(plane->formats[i], DRM_FORMAT_MOD_INVALID);
 
         TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: | Format {}", fourccToName(plane->formats[i]))));
     }
@@ -1024,19 +1569,37 @@ bool Aquamarine::SDRMPlane::init(drmModePlane* plane) {
 
         drmModeFormatModifierIterator iter = {0};
         while (drmModeFormatModifierBlobIterNext(blob, &iter)) {
-            auto it = std::find_if(formats.begin(), formats.end(), [iter](const auto& e) { return e.drmFormat == iter.fmt; });
-
             TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: | Modifier {} with format {}", iter.mod, fourccToName(iter.fmt))));
 
-            if (it == formats.end())
-                formats.emplace_back(SDRMFormat{.drmFormat = iter.fmt, .modifiers = {iter.mod}});
-            else
-                it->modifiers.emplace_back(iter.mod);
+            formats.add(iter.fmt, iter.mod);
         }
 
         drmModeFreePropertyBlob(blob);
     }
 
+    renderable = backend->glFormats.empty() ? formats : formats.intersect(backend->glFormats);
+
+    if (type == DRM_PLANE_TYPE_OVERLAY) {
+        // overlays can usually go on more than one crtc. Give each to the possible crtc with the least overlays so far,
+        // so that no two crtcs ever fight over a plane.
+        SP<SDRMCRTC> owner;
+        for (size_t i = 0; i < backend->crtcs.size(); ++i) {
+            if (!(plane->possible_crtcs & (1 << i)))
+                continue;
+
+            auto CRTC = backend->crtcs.at(i);
+            if (!owner || CRTC->overlays.size() < owner->overlays.size())
+                owner = CRTC;
+        }
+
+        if (owner) {
+            owner->overlays.emplace_back(self.lock());
+            backend->backend->log(AQ_LOG_DEBUG, std::format("drm: Overlay plane {} bound to crtc {}", id, owner->id));
+        }
+
+        return true;
+    }
+
     for (size_t i = 0; i < backend->crtcs.size(); ++i) {
         uint32_t crtcBit = (1 << i);
         if (!(plane->possible_crtcs & crtcBit))
@@ -1097,7 +1660,9 @@ SP<SDRMCRTC> Aquamarine::SDRMConnector::getCurrentCRTC(const drmModeConnector* c
 }
 
 bool Aquamarine::SDRMConnector::init(drmModeConnector* connector) {
-    pendingPageFlip.connector = self.lock();
+    pendingPageFlip.connector    = self.lock();
+    pendingCursorFlip.connector  = self.lock();
+    pendingCursorFlip.cursorOnly = true;
 
     if (!getDRMConnectorProps(backend->gpu->fd, id, &props))
         return false;
@@ -1187,9 +1752,30 @@ void Aquamarine::SDRMConnector::parseEDID(std::vector<uint8_t> data) {
     model  = mod ? mod : "";
     serial = ser ? ser : "";
 
+    vrrRange = {};
+    for (auto desc = di_edid_get_display_descriptors(edid); desc && *desc; ++desc) {
+        if (di_edid_display_descriptor_get_tag(*desc) != DI_EDID_DISPLAY_DESCRIPTOR_RANGE_LIMITS)
+            continue;
+
+        if (const auto LIMITS = di_edid_display_descriptor_get_range_limits(*desc); LIMITS && LIMITS->min_vert_rate_hz > 0) {
+            vrrRange.minHz = LIMITS->min_vert_rate_hz;
+            vrrRange.maxHz = LIMITS->max_vert_rate_hz;
+        }
+    }
+
     di_info_destroy(info);
 }
 
+void Aquamarine::SDRMConnector::fetchEDID() {
+    size_t               edidLen  = 0;
+    uint8_t*             edidData = (uint8_t*)getDRMPropBlob(backend->gpu->fd, id, props.edid, &edidLen);
+
+    std::vector<uint8_t> edid{edidData, edidData + edidLen};
+    parseEDID(edid);
+
+    free(edidData);
+}
+
 void Aquamarine::SDRMConnector::recheckCRTCProps() {
     if (!crtc || !output)
         return;
@@ -1285,14 +1871,8 @@ void Aquamarine::SDRMConnector::connect(drmModeConnector* connector) {
     if (props.max_bpc && !introspectDRMPropRange(backend->gpu->fd, props.max_bpc, maxBpcBounds.data(), &maxBpcBounds[1]))
         backend->backend->log(AQ_LOG_ERROR, "drm: Failed to check max_bpc");
 
-    size_t               edidLen  = 0;
-    uint8_t*             edidData = (uint8_t*)getDRMPropBlob(backend->gpu->fd, id, props.edid, &edidLen);
-
-    std::vector<uint8_t> edid{edidData, edidData + edidLen};
-    parseEDID(edid);
-
-    free(edidData);
-    edid = {};
+    if (!std::exchange(edidPrefetched, false))
+        fetchEDID();
 
     // TODO: subconnectors
 
@@ -1304,6 +1884,9 @@ void Aquamarine::SDRMConnector::connect(drmModeConnector* connector) {
 
     backend->backend->log(AQ_LOG_DEBUG, std::format("drm: Description {}", output->description));
 
+    if (vrrRange.minHz)
+        backend->backend->log(AQ_LOG_DEBUG, std::format("drm: Refresh range {}-{}Hz", vrrRange.minHz, vrrRange.maxHz));
+
     status = DRM_MODE_CONNECTED;
 
     recheckCRTCProps();
@@ -1324,10 +1907,13 @@ void Aquamarine::SDRMConnector::disconnect() {
         return;
     }
 
+    signalReleasePoints();
+
     output->events.destroy.emit();
     output.reset();
 
-    status = DRM_MODE_DISCONNECTED;
+    status        = DRM_MODE_DISCONNECTED;
+    committedCRTC = 0;
 }
 
 bool Aquamarine::SDRMConnector::commitState(SDRMConnectorCommitData& data) {
@@ -1343,6 +1929,7 @@ bool Aquamarine::SDRMConnector::commitState(SDRMConnectorCommitData& data) {
 
 void Aquamarine::SDRMConnector::applyCommit(const SDRMConnectorCommitData& data) {
     crtc->primary->back = data.mainFB;
+    releasePoints.back  = data.releasePoint;
     if (crtc->cursor && data.cursorFB)
         crtc->cursor->back = data.cursorFB;
 
@@ -1351,12 +1938,27 @@ void Aquamarine::SDRMConnector::applyCommit(const SDRMConnectorCommitData& data)
     if (crtc->cursor && data.cursorFB)
         data.cursorFB->buffer->lockedByBackend = true;
 
+    // overlays without a layer were disabled in this commit
+    for (auto const& plane : crtc->overlays) {
+        plane->back = nullptr;
+    }
+
+    for (auto const& o : data.overlays) {
+        o.plane->back                 = o.fb;
+        o.fb->buffer->lockedByBackend = true;
+    }
+
     pendingCursorFB.reset();
+    cursorCommitDeferred     = false; // the frame carried the cursor
+    pendingPageFlip.zeroCopy = !data.blitted;
+
+    const auto& STATE = data.outputState(self.lock());
 
-    if (output->state->state().committed & COutputState::AQ_OUTPUT_STATE_MODE)
+    if (STATE.committed & COutputState::AQ_OUTPUT_STATE_MODE)
         refresh = calculateRefresh(data.modeInfo);
 
-    output->enabledState = output->state->state().enabled;
+    output->enabledState = STATE.enabled;
+    committedCRTC        = output->enabledState && data.mainFB ? crtc->id : 0;
 }
 
 void Aquamarine::SDRMConnector::rollbackCommit(const SDRMConnectorCommitData& data) {
@@ -1374,25 +1976,253 @@ void Aquamarine::SDRMConnector::rollbackCommit(const SDRMConnectorCommitData& da
 void Aquamarine::SDRMConnector::onPresent() {
     crtc->primary->last  = crtc->primary->front;
     crtc->primary->front = crtc->primary->back;
-    if (crtc->primary->last && crtc->primary->last->buffer) {
+    if (crtc->primary->last && crtc->primary->last->buffer && crtc->primary->last != crtc->primary->front) {
         crtc->primary->last->buffer->lockedByBackend = false;
         crtc->primary->last->buffer->events.backendRelease.emit();
     }
 
+    if (releasePoints.front != releasePoints.back) {
+        if (releasePoints.front)
+            releasePoints.front->signal();
+        releasePoints.front = releasePoints.back;
+    }
+
     if (crtc->cursor) {
         crtc->cursor->last  = crtc->cursor->front;
         crtc->cursor->front = crtc->cursor->back;
-        if (crtc->cursor->last && crtc->cursor->last->buffer) {
+        if (crtc->cursor->last && crtc->cursor->last->buffer && crtc->cursor->last != crtc->cursor->front) {
             crtc->cursor->last->buffer->lockedByBackend = false;
             crtc->cursor->last->buffer->events.backendRelease.emit();
         }
     }
+
+    for (auto const& plane : crtc->overlays) {
+        plane->last  = plane->front;
+        plane->front = plane->back;
+        if (plane->last && plane->last->buffer && plane->last != plane->front) {
+            plane->last->buffer->lockedByBackend = false;
+            plane->last->buffer->events.backendRelease.emit();
+        }
+    }
+}
+
+void Aquamarine::SDRMConnector::signalReleasePoints() {
+    if (releasePoints.front)
+        releasePoints.front->signal();
+    if (releasePoints.back && releasePoints.back != releasePoints.front)
+        releasePoints.back->signal();
+
+    releasePoints.front.reset();
+    releasePoints.back.reset();
+}
+
+void Aquamarine::SDRMConnector::onVblank(const timespec& when, unsigned seq) {
+    if (!output)
+        return;
+
+    auto&          deadline = output->deadline;
+    const uint64_t NS       = (uint64_t)when.tv_sec * 1000000000ULL + when.tv_nsec;
+
+    if (output->lastCommitNs && NS >= output->lastCommitNs) {
+        const uint64_t PERIOD = deadline.period ? deadline.period : (refresh > 0 ? 1000000000000ULL / refresh : 0);
+        uint64_t       missed = 0;
+
+        // the flip should've landed on the vblank right after the one preceding the commit. Vrr has no fixed vblanks to miss.
+        if (PERIOD && deadline.lastVblank && output->lastCommitNs >= deadline.lastVblank && seq > deadline.lastSeq && !output->vrrActive) {
+            const uint64_t COMMIT_SEQ = deadline.lastSeq + (output->lastCommitNs - deadline.lastVblank) / PERIOD;
+            if (seq > COMMIT_SEQ + 1)
+                missed = seq - COMMIT_SEQ - 1;
+        }
+
+        output->stats.onPresent(NS - output->lastCommitNs, missed);
+        output->lastCommitNs = 0;
+
+        // the swapchain belongs to the committing thread
+        if (!output->threaded.enabled)
+            output->swapchainFeedback(missed > 0);
+    }
+
+    if (deadline.lastVblank && seq > deadline.lastSeq && NS > deadline.lastVblank) {
+        const uint64_t PERIOD = (NS - deadline.lastVblank) / (seq - deadline.lastSeq);
+        deadline.period       = deadline.period ? (deadline.period * 7 + PERIOD) / 8 : PERIOD;
+    }
+
+    deadline.lastVblank = NS;
+    deadline.lastSeq    = seq;
+}
+
+bool Aquamarine::SDRMConnector::deferFrame() {
+    // kernel and commit latency the learned budget doesn't see
+    constexpr uint64_t SLACK_NS = 1000000;
+
+    if (!output)
+        return false;
+
+    auto& deadline = output->deadline;
+
+    // with vrr, the vblank follows the commit
+    if (!deadline.enabled || !deadline.lastVblank || output->vrrActive)
+        return false;
+
+    const uint64_t BUDGET = deadline.budget ? deadline.budget : (deadline.learned ? deadline.learned + SLACK_NS : 0);
+    const uint64_t PERIOD = deadline.period ? deadline.period : (refresh > 0 ? 1000000000000ULL / refresh : 0);
+
+    if (!BUDGET || !PERIOD || BUDGET >= PERIOD)
+        return false;
+
+    const uint64_t NOW = monotonicNs();
+
+    // the prediction drifts, don't trust a stale one
+    if (NOW > deadline.lastVblank + PERIOD * 60)
+        return false;
+
+    uint64_t nextVblank = deadline.lastVblank + PERIOD;
+    if (nextVblank <= NOW)
+        nextVblank += ((NOW - nextVblank) / PERIOD + 1) * PERIOD;
+
+    // too late for the next vblank, a frame rendered now would land on the one after anyways
+    if (nextVblank - BUDGET <= NOW)
+        nextVblank += PERIOD;
+
+    deadline.fireAt     = nextVblank - BUDGET;
+    frameEventScheduled = true;
+
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: connector {} frame deadline in {}us, budget {}us", szName, (deadline.fireAt - NOW) / 1000, BUDGET / 1000)));
+
+    backend->updateFrameDeadlines();
+
+    return true;
+}
+
+void Aquamarine::SDRMConnector::armLFC(uint64_t flipNs, bool repeated) {
+    // kernel and commit latency, the repeat has to land before the floor
+    constexpr uint64_t SLACK_NS = 1000000;
+
+    if (!output)
+        return;
+
+    auto& lfc  = output->lfc;
+    lfc.fireAt = 0;
+
+    if (!lfc.enabled || output->threaded.enabled || !output->vrrActive || vrrRange.minHz == 0 || 1000000000ULL / vrrRange.minHz <= SLACK_NS * 2) {
+        lfc.lastContent = 0;
+        lfc.period      = 0;
+        backend->updateFrameDeadlines();
+        return;
+    }
+
+    const uint64_t FLOOR = 1000000000ULL / vrrRange.minHz - SLACK_NS; // the longest we can wait for a flip
+    const uint64_t CEIL  = vrrRange.maxHz ? 1000000000ULL / vrrRange.maxHz : 0;
+
+    if (!repeated) {
+        const uint64_t PERIOD = lfc.lastContent && flipNs > lfc.lastContent ? flipNs - lfc.lastContent : 0;
+
+        // a pause isn't a frame rate
+        if (!PERIOD || PERIOD > 1000000000ULL)
+            lfc.period = 0;
+        else
+            lfc.period = lfc.period ? (lfc.period * 3 + PERIOD) / 4 : PERIOD;
+
+        lfc.lastContent = flipNs;
+
+        // split the frame period in even flips that fit the range, e.g. 24fps on a 48Hz floor flips at 72Hz. Without a known period, flip at the floor
+        lfc.interval = FLOOR;
+        if (lfc.period > FLOOR) {
+            const uint64_t FLIPS = (lfc.period + FLOOR - 1) / FLOOR;
+            if (lfc.period / FLIPS >= CEIL)
+                lfc.interval = lfc.period / FLIPS;
+        }
+    }
+
+    lfc.fireAt = flipNs + lfc.interval;
+
+    backend->updateFrameDeadlines();
+}
+
+bool Aquamarine::SDRMConnector::repeatFrame() {
+    std::lock_guard<std::recursive_mutex> lg(mutex);
+
+    if (!output || !crtc || !output->enabledState || !output->vrrActive || output->threaded.enabled)
+        return false;
+
+    // a frame or a repeat is on its way, its flip re-arms lfc. A deferred cursor commit goes out with the next frame instead
+    if (isPageFlipPending || isBlitPending || isCursorFlipPending || cursorCommitDeferred)
+        return false;
+
+    const auto FRONT = crtc->primary->front;
+    if (!FRONT || FRONT->dead)
+        return false;
+
+    // a staged state would go out half-committed
+    if (output->state->state().committed)
+        return false;
+
+    // overlay placements aren't kept around, the panel repeats on its own then
+    for (auto const& plane : crtc->overlays) {
+        if (plane->front)
+            return false;
+    }
+
+    SDRMConnectorCommitData data = {
+        .mainFB   = FRONT,
+        .cursorFB = crtc->cursor ? crtc->cursor->front : nullptr,
+        .modeset  = false,
+        .blocking = false,
+        .flags    = DRM_MODE_PAGE_FLIP_EVENT,
+        .test     = false,
+    };
+
+    // the fence was waited on when the frame went out
+    data.explicitInFence = -1;
+    data.releasePoint    = releasePoints.back;
+
+    if (!commitState(data)) {
+        TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: connector {} failed to repeat a frame", szName)));
+        return false;
+    }
+
+    pendingPageFlip.repeated = true;
+    output->stats.onRepeatedFrame();
+
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("drm: connector {} repeated a frame for lfc", szName)));
+
+    return true;
+}
+
+CWeakPointer<SDRMConnector> Aquamarine::SDRMConnector::connectorForCRTC(uint32_t crtcID) {
+    for (auto const& c : backend->connectors) {
+        if (c->crtc && c->crtc->id == crtcID)
+            return c;
+    }
+
+    return {};
+}
+
+void Aquamarine::SDRMConnector::flushCursor() {
+    std::lock_guard<std::recursive_mutex> lg(mutex);
+
+    if (!cursorCommitDeferred || !output)
+        return;
+
+    if (!backend->impl->commitCursor(self.lock()))
+        output->scheduleFrame(IOutput::AQ_SCHEDULE_CURSOR_MOVE);
 }
 
 Aquamarine::CDRMOutput::~CDRMOutput() {
     backend->backend->removeIdleEvent(frameIdle);
-    connector->isPageFlipPending   = false;
-    connector->frameEventScheduled = false;
+    connector->isPageFlipPending    = false;
+    connector->frameEventScheduled  = false;
+    connector->isCursorFlipPending  = false;
+    connector->cursorCommitDeferred = false;
+    connector->isBlitPending        = false;
+
+    dropMailbox();
+
+    if (acquireFence >= 0)
+        close(acquireFence);
+
+    if (threaded.fd >= 0)
+        close(threaded.fd);
 }
 
 bool Aquamarine::CDRMOutput::commit() {
@@ -1404,19 +2234,23 @@ bool Aquamarine::CDRMOutput::test() {
 }
 
 void Aquamarine::CDRMOutput::setCursorVisible(bool visible) {
+    std::lock_guard<std::recursive_mutex> lg(connector->mutex);
+
     cursorVisible = visible;
-    scheduleFrame(AQ_SCHEDULE_CURSOR_VISIBLE);
+
+    if (!backend->impl->commitCursor(connector))
+        scheduleFrame(AQ_SCHEDULE_CURSOR_VISIBLE);
 }
 
-bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
+CDRMOutput::eCommitPrepareResult Aquamarine::CDRMOutput::prepareCommit(bool onlyTest, SDRMConnectorCommitData& data, bool batched) {
     if (!backend->backend->session->active) {
         backend->backend->log(AQ_LOG_ERROR, "drm: Session inactive");
-        return false;
+        return AQ_COMMIT_PREPARE_FAILED;
     }
 
     if (!connector->crtc) {
         backend->backend->log(AQ_LOG_ERROR, "drm: No CRTC attached to output");
-        return false;
+        return AQ_COMMIT_PREPARE_FAILED;
     }
 
     const auto&    STATE     = state->state();
@@ -1425,49 +2259,52 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
     if ((COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_ENABLED) && STATE.enabled) {
         if (!STATE.mode && !STATE.customMode) {
             backend->backend->log(AQ_LOG_ERROR, "drm: No mode on enable commit");
-            return false;
+            return AQ_COMMIT_PREPARE_FAILED;
         }
     }
 
     if (STATE.drmFormat == DRM_FORMAT_INVALID) {
         backend->backend->log(AQ_LOG_ERROR, "drm: No format for output");
-        return false;
+        return AQ_COMMIT_PREPARE_FAILED;
     }
 
     if (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_FORMAT) {
         // verify the format is valid for the primary plane
-        bool ok = false;
-        for (auto const& f : getRenderFormats()) {
-            if (f.drmFormat == STATE.drmFormat) {
-                ok = true;
-                break;
-            }
-        }
-
-        if (!ok) {
+        if (!connector->crtc->primary || !connector->crtc->primary->formats.has(STATE.drmFormat)) {
             backend->backend->log(AQ_LOG_ERROR, "drm: Selected format is not supported by the primary KMS plane");
-            return false;
+            return AQ_COMMIT_PREPARE_FAILED;
         }
     }
 
     if (STATE.adaptiveSync && !connector->canDoVrr) {
         backend->backend->log(AQ_LOG_ERROR, "drm: No Adaptive sync support for output");
-        return false;
+        return AQ_COMMIT_PREPARE_FAILED;
+    }
+
+    if (STATE.renderSize.x > 0 && STATE.renderSize.y > 0 && !backend->atomic) {
+        backend->backend->log(AQ_LOG_ERROR, "drm: A render size requires atomic modesetting");
+        return AQ_COMMIT_PREPARE_FAILED;
     }
 
     if (STATE.presentationMode == AQ_OUTPUT_PRESENTATION_IMMEDIATE && !backend->drmProps.supportsAsyncCommit) {
         backend->backend->log(AQ_LOG_ERROR, "drm: No Immediate presentation support in the backend");
-        return false;
+        return AQ_COMMIT_PREPARE_FAILED;
     }
 
     if ((COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_BUFFER) && !STATE.buffer) {
         backend->backend->log(AQ_LOG_ERROR, "drm: No buffer committed");
-        return false;
+        return AQ_COMMIT_PREPARE_FAILED;
     }
 
     if ((COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_BUFFER) && STATE.buffer->attachments.has(AQ_ATTACHMENT_DRM_KMS_UNIMPORTABLE)) {
         TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Cannot commit a KMS-unimportable buffer."));
-        return false;
+        return AQ_COMMIT_PREPARE_FAILED;
+    }
+
+    if ((COMMITTED & (COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_ACQUIRE_POINT | COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_RELEASE_POINT)) &&
+        !supportsExplicit) {
+        backend->backend->log(AQ_LOG_ERROR, "drm: Timeline points committed, but explicit sync is unsupported");
+        return AQ_COMMIT_PREPARE_FAILED;
     }
 
     // If we are changing the rendering format, we may need to reconfigure the output (aka modeset)
@@ -1481,7 +2318,7 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
     const auto MODE = STATE.mode ? STATE.mode : STATE.customMode;
 
     if (!MODE) // modeless commits are invalid
-        return false;
+        return AQ_COMMIT_PREPARE_FAILED;
 
     uint32_t flags = 0;
 
@@ -1495,8 +2332,24 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
         }
 
         if (STATE.enabled && (NEEDS_RECONFIG || (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_BUFFER)) && connector->isPageFlipPending) {
+            // handlePF swaps the state to flip a queued frame, which can't be done under a compositor committing from its own thread
+            if (!NEEDS_RECONFIG && STATE.presentationMode == AQ_OUTPUT_PRESENTATION_MAILBOX && !threaded.enabled)
+                return queueMailbox() ? AQ_COMMIT_PREPARE_DONE : AQ_COMMIT_PREPARE_FAILED;
+
             backend->backend->log(AQ_LOG_ERROR, "drm: Cannot commit when a page-flip is awaiting");
-            return false;
+            swapchainFeedback(true);
+            return AQ_COMMIT_PREPARE_FAILED;
+        }
+
+        if (connector->isBlitPending) {
+            backend->backend->log(AQ_LOG_ERROR, "drm: Cannot commit when a blit is awaiting");
+            return AQ_COMMIT_PREPARE_FAILED;
+        }
+
+        // kms or the blitter is done with the last commit's acquire fence
+        if (acquireFence >= 0) {
+            close(acquireFence);
+            acquireFence = -1;
         }
 
         if (STATE.enabled && (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_BUFFER))
@@ -1507,19 +2360,52 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
 
     // we can't go further without a blit
     if (backend->primary && onlyTest)
-        return true;
+        return AQ_COMMIT_PREPARE_DONE;
 
-    SDRMConnectorCommitData data;
+    SP<CDRMSyncPoint> releasePoint;
+
+    if (!onlyTest && STATE.buffer) {
+        // kms only takes sync files. An explicit in fence, if any, wins.
+        if ((COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_ACQUIRE_POINT) &&
+            !(COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE)) {
+            auto acquire = CDRMSyncPoint::create(backend, STATE.acquirePoint.timelineFD, STATE.acquirePoint.point);
+            acquireFence = acquire ? acquire->exportSyncFile() : -1;
+
+            if (acquireFence < 0) {
+                backend->backend->log(AQ_LOG_ERROR, std::format("drm: Acquire point {} has no fence to wait on", STATE.acquirePoint.point));
+                return AQ_COMMIT_PREPARE_FAILED;
+            }
+        }
+
+        // a commit without a new buffer keeps scanning out the old one
+        if (!(COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_BUFFER))
+            releasePoint = connector->releasePoints.back;
+        else if (mailbox.releasePoint)
+            releasePoint = mailbox.releasePoint; // a queued mailbox frame, taken when it was queued
+        else if (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_RELEASE_POINT) {
+            releasePoint = CDRMSyncPoint::create(backend, STATE.releasePoint.timelineFD, STATE.releasePoint.point);
+            if (!releasePoint)
+                return AQ_COMMIT_PREPARE_FAILED;
+        }
+    }
+
+    const bool IN_FENCE    = (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE) || acquireFence >= 0;
+    const int  IN_FENCE_FD = acquireFence >= 0 ? acquireFence : STATE.explicitInFence;
 
     if (STATE.buffer) {
         TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Committed a buffer, updating state"));
 
         SP<CDRMFB> drmFB;
 
-        if (backend->shouldBlit()) {
+        if (backend->shouldBlit())
+            drmFB = importZeroCopy(STATE.buffer, MODE, NEEDS_RECONFIG || lastCommitNoBuffer);
+
+        if (drmFB) {
+            TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Backend can scan out the buffer directly, skipping the blit"));
+        } else if (backend->shouldBlit()) {
             if (!backend->rendererState.renderer) {
                 backend->backend->log(AQ_LOG_ERROR, "drm: No renderer attached to backend when required for blitting");
-                return false;
+                return AQ_COMMIT_PREPARE_FAILED;
             }
 
             TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Backend requires blit, blitting"));
@@ -1539,40 +2425,89 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
             OPTIONS.scanout  = true;
             if (!mgpu.swapchain->reconfigure(OPTIONS)) {
                 backend->backend->log(AQ_LOG_ERROR, "drm: Backend requires blit, but the mgpu swapchain failed reconfiguring");
-                return false;
+                return AQ_COMMIT_PREPARE_FAILED;
+            }
+
+            // the consumer's swapchain is allocating for a new mode or format in the background. Allocate ours alongside it,
+            // so that its first frame finds them in the pool instead of stalling. Ours keeps the current buffers until then.
+            if (const auto PENDING = swapchain->pendingOptions(); PENDING.has_value() && !onlyTest) {
+                auto NEXT   = OPTIONS;
+                NEXT.size   = PENDING->size;
+                NEXT.length = PENDING->length;
+                if (PENDING->format != DRM_FORMAT_INVALID)
+                    NEXT.format = PENDING->format;
+
+                if ((NEXT.size != OPTIONS.size || NEXT.format != OPTIONS.format) && (NEXT.size != mgpu.prewarmed.size || NEXT.format != mgpu.prewarmed.format)) {
+                    mgpu.swapchain->prewarm(NEXT);
+                    mgpu.prewarmed = NEXT;
+                }
+            }
+
+            // only blit this frame's damage, plus whatever NEWAQBUF missed since it was last blitted to.
+            // An empty region is a full blit.
+            CRegion    blitDamage;
+            auto       NEWAQBUF   = mgpu.swapchain->next(nullptr, &blitDamage);
+            const bool HAS_DAMAGE = (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_DAMAGE) && !STATE.damage.empty();
+
+            if (HAS_DAMAGE) {
+                mgpu.swapchain->addDamage(STATE.damage);
+                blitDamage.add(STATE.damage);
+            } else {
+                mgpu.swapchain->addDamage(CRegion{CBox{{}, NEWAQBUF->size}});
+                blitDamage.clear();
             }
 
-            auto NEWAQBUF   = mgpu.swapchain->next(nullptr);
-            auto blitResult = backend->rendererState.renderer->blit(
-                STATE.buffer, NEWAQBUF, (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE) ? STATE.explicitInFence : -1);
+            // plain frames can be blitted off the main thread, and committed once the blit is done.
+            // Presentation-affecting state still goes the synchronous route, so failures surface here.
+            // a copy engine blit is only a submission, no point in a thread for it
+            const bool COPY_BLIT  = backend->rendererState.copyBlitter && backend->rendererState.copyBlitter->canBlit(STATE.buffer, NEWAQBUF);
+            const bool ASYNC_BLIT = !batched && !COPY_BLIT && backend->rendererState.renderer->asyncBlits() && !onlyTest && !NEEDS_RECONFIG && !lastCommitNoBuffer &&
+                STATE.enabled && STATE.presentationMode != AQ_OUTPUT_PRESENTATION_IMMEDIATE && STATE.layers.empty() && NEWAQBUF->dmabuf().format == STATE.drmFormat &&
+                !(COMMITTED &
+                  (COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_GAMMA_LUT | COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_CTM |
+                   COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_OUT_FENCE));
+
+            if (ASYNC_BLIT)
+                return commitAsyncBlit(STATE.buffer, NEWAQBUF, blitDamage, flags, releasePoint) ? AQ_COMMIT_PREPARE_DONE : AQ_COMMIT_PREPARE_FAILED;
+
+            auto blitResult = backend->blit(STATE.buffer, NEWAQBUF, IN_FENCE ? IN_FENCE_FD : -1, blitDamage);
+            stats.onBlit(blitResult.cpuNs, blitResult.gpuNs);
+
             if (!blitResult.success) {
                 backend->backend->log(AQ_LOG_ERROR, "drm: Backend requires blit, but blit failed");
-                return false;
+                mgpu.swapchain->rollback();
+                return AQ_COMMIT_PREPARE_FAILED;
             }
 
             // replace the explicit in fence if the blitting backend returned one, otherwise discard old. Passed fence from the client is wrong.
             // if the commit doesn't have an explicit fence, don't use the one we created, just fallback to implicit
             static auto NO_EXPLICIT = envEnabled("AQ_MGPU_NO_EXPLICIT");
-            if (blitResult.syncFD.has_value() && !NO_EXPLICIT && (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE))
+            if (blitResult.syncFD.has_value() && !NO_EXPLICIT && IN_FENCE)
                 state->setExplicitInFence(blitResult.syncFD.value());
             else
                 state->setExplicitInFence(-1);
 
-            drmFB = CDRMFB::create(NEWAQBUF, backend, nullptr); // will return attachment if present
+            drmFB        = CDRMFB::create(NEWAQBUF, backend, nullptr); // will return attachment if present
+            data.blitted = true;
         } else
             drmFB = CDRMFB::create(STATE.buffer, backend, nullptr); // will return attachment if present
 
         if (!drmFB) {
             backend->backend->log(AQ_LOG_ERROR, "drm: Buffer failed to import to KMS");
-            return false;
+            return AQ_COMMIT_PREPARE_FAILED;
         }
 
         if (drmFB->dead) {
             backend->backend->log(AQ_LOG_ERROR, "drm: KMS buffer is dead?!");
-            return false;
+            return AQ_COMMIT_PREPARE_FAILED;
         }
 
-        data.mainFB = drmFB;
+        data.mainFB       = drmFB;
+        data.releasePoint = releasePoint;
+
+        // the blit already waited on it
+        if (acquireFence >= 0 && !data.blitted)
+            data.explicitInFence = acquireFence;
     }
 
     // sometimes, our consumer could f up the swapchain format and change it without the state changing
@@ -1606,6 +2541,37 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
         }
     }
 
+    if (!STATE.layers.empty()) {
+        if (!backend->atomic) {
+            backend->backend->log(AQ_LOG_ERROR, "drm: Extra layers require atomic modesetting");
+            return AQ_COMMIT_PREPARE_FAILED;
+        }
+
+        if (backend->primary) {
+            TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Cannot scan out extra layers on a secondary gpu"));
+            return AQ_COMMIT_PREPARE_FAILED;
+        }
+
+        if (STATE.layers.size() > connector->crtc->overlays.size()) {
+            TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: {} layers requested, but only {} overlay planes available", STATE.layers.size(),
+                                                                  connector->crtc->overlays.size())));
+            return AQ_COMMIT_PREPARE_FAILED;
+        }
+
+        for (auto const& l : STATE.layers) {
+            if (!l.buffer || l.buffer->attachments.has(AQ_ATTACHMENT_DRM_KMS_UNIMPORTABLE))
+                return AQ_COMMIT_PREPARE_FAILED;
+
+            auto fb = CDRMFB::create(l.buffer, backend, nullptr); // will return attachment if present
+            if (!fb || fb->dead) {
+                backend->backend->log(AQ_LOG_ERROR, "drm: Layer buffer failed to import to KMS");
+                return AQ_COMMIT_PREPARE_FAILED;
+            }
+
+            data.overlays.emplace_back(SDRMOverlayCommitData{.fb = fb, .src = l.src.empty() ? CBox{{}, l.buffer->size} : l.src, .dst = l.dst});
+        }
+    }
+
     if (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_CTM)
         data.ctm = STATE.ctm;
 
@@ -1618,55 +2584,473 @@ bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
     else
         data.calculateMode(connector);
 
-    bool ok = connector->commitState(data);
+    return AQ_COMMIT_PREPARE_READY;
+}
 
-    if (!ok && !data.modeset && !connector->commitTainted) {
-        // attempt to re-modeset, however, flip a tainted flag if the modesetting fails
-        // to avoid doing this over and over.
-        data.modeset  = true;
-        data.blocking = true;
-        data.flags    = onlyTest ? 0 : DRM_MODE_PAGE_FLIP_EVENT;
-        ok            = connector->commitState(data);
+bool Aquamarine::CDRMOutput::commitState(bool onlyTest) {
+    std::lock_guard<std::recursive_mutex> lg(connector->mutex);
 
-        if (!ok)
-            connector->commitTainted = true;
-    }
+    AQ_TRACE_SCOPE("aq commit {} conn {}{}", name, connector->id, onlyTest ? " test" : "");
 
-    if (onlyTest || !ok)
-        return ok;
+    SDRMConnectorCommitData data;
 
-    events.commit.emit();
-    state->onCommit();
+    if (const auto RESULT = prepareCommit(onlyTest, data); RESULT != AQ_COMMIT_PREPARE_READY)
+        return RESULT == AQ_COMMIT_PREPARE_DONE;
 
-    lastCommitNoBuffer = !data.mainFB;
-    needsFrame         = false;
+    return commitPrepared(data);
+}
 
-    if (ok)
-        connector->commitTainted = false;
+bool Aquamarine::CDRMOutput::queueMailbox() {
+    const auto& STATE = state->state();
 
-    if (data.flags & DRM_MODE_PAGE_FLIP_ASYNC) {
-        // for tearing commits, we will send presentation feedback instantly, and rotate
-        // drm framebuffers to properly send backendRelease events.
-        // the last FB should already be gone from KMS because it's been immediately replaced
+    // a superseded frame's props still have to reach kms, only its buffer and fences are replaced
+    const uint32_t FENCES  = COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_ACQUIRE_POINT | COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_RELEASE_POINT |
+        COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE;
+    uint32_t       carried = 0;
+    CRegion        damage;
 
-        // no completion and no vsync, because tearing
-        uint32_t flags = IOutput::AQ_OUTPUT_PRESENT_HW_CLOCK | IOutput::AQ_OUTPUT_PRESENT_ZEROCOPY;
+    if (mailbox.state) {
+        carried = mailbox.state->committed & ~FENCES;
+        damage  = mailbox.state->damage;
+    }
 
-        timespec presented;
-        clock_gettime(CLOCK_MONOTONIC, &presented);
+    dropMailbox();
 
-        connector->output->events.present.emit(IOutput::SPresentEvent{
-            .presented = backend->sessionActive(),
-            .when      = &presented,
-            .seq       = 0, /* unknown sequence for tearing */
-            .refresh   = (int)(connector->refresh ? (1000000000000LL / connector->refresh) : 0),
-            .flags     = flags,
-        });
+    if ((STATE.committed & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE) && STATE.explicitInFence >= 0)
+        mailbox.inFence = fcntl(STATE.explicitInFence, F_DUPFD_CLOEXEC, 0);
+    else if (STATE.committed & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_ACQUIRE_POINT) {
+        auto acquire    = CDRMSyncPoint::create(backend, STATE.acquirePoint.timelineFD, STATE.acquirePoint.point);
+        mailbox.inFence = acquire ? acquire->exportSyncFile() : -1;
+
+        if (mailbox.inFence < 0) {
+            backend->backend->log(AQ_LOG_ERROR, std::format("drm: Acquire point {} has no fence to wait on", STATE.acquirePoint.point));
+            return false;
+        }
+    }
+
+    if (STATE.committed & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_RELEASE_POINT) {
+        mailbox.releasePoint = CDRMSyncPoint::create(backend, STATE.releasePoint.timelineFD, STATE.releasePoint.point);
+        if (!mailbox.releasePoint) {
+            dropMailbox();
+            return false;
+        }
+    }
+
+    mailbox.state            = STATE;
+    mailbox.state->committed = (STATE.committed | carried) & ~FENCES;
+    mailbox.state->damage.add(damage);
+
+    // not the backend's yet, but the swapchain mustn't hand it out to be drawn into while it waits
+    if (mailbox.state->buffer)
+        mailbox.state->buffer->lock();
+
+    if (mailbox.inFence >= 0) {
+        mailbox.state->committed |= COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE;
+        mailbox.state->explicitInFence = mailbox.inFence;
+    }
+
+    TRACE(backend->backend->log(AQ_LOG_TRACE, std::format("drm: Queued a mailbox frame for {}", name)));
+
+    // for the compositor, it's committed
+    state->onCommit();
+    needsFrame = false;
+
+    return true;
+}
+
+void Aquamarine::CDRMOutput::flushMailbox() {
+    if (!mailbox.state)
+        return;
+
+    // whatever the compositor staged in the meantime stays staged
+    const auto staged       = state->internalState;
+    const auto releasePoint = mailbox.releasePoint;
+    const int  inFence      = std::exchange(mailbox.inFence, -1);
+    const auto buffer       = mailbox.state->buffer;
+
+    state->internalState = *mailbox.state;
+    mailbox.state.reset();
+
+    const bool ok = commitState();
+
+    // flipping now, lockedByBackend keeps it out of the swapchain from here on
+    if (buffer)
+        buffer->unlock();
+
+    mailbox.releasePoint.reset();
+
+    // kms or the blitter is done with it by the next commit, same as the acquire fence
+    if (inFence >= 0) {
+        if (acquireFence >= 0)
+            close(acquireFence);
+        acquireFence = inFence;
+    }
+
+    if (!ok) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("drm: Failed to commit the queued mailbox frame for {}, dropping it", name));
+
+        if (state->internalState.buffer && !state->internalState.buffer->lockedByBackend)
+            state->internalState.buffer->events.backendRelease.emit();
+        if (releasePoint)
+            releasePoint->signal();
+    }
+
+    state->internalState = staged;
+}
+
+void Aquamarine::CDRMOutput::dropMailbox() {
+    if (mailbox.state && mailbox.state->buffer) {
+        mailbox.state->buffer->unlock();
+        if (!mailbox.state->buffer->lockedByBackend)
+            mailbox.state->buffer->events.backendRelease.emit();
+    }
+
+    // never scanned out
+    if (mailbox.releasePoint)
+        mailbox.releasePoint->signal();
+
+    if (mailbox.inFence >= 0)
+        close(mailbox.inFence);
+
+    mailbox.state.reset();
+    mailbox.releasePoint.reset();
+    mailbox.inFence = -1;
+}
+
+bool Aquamarine::CDRMOutput::commitPrepared(SDRMConnectorCommitData& data) {
+    const bool                   onlyTest = data.test;
+
+    std::optional<STestCacheKey> testKey;
+    if (onlyTest) {
+        testKey = testCacheKey(data);
+
+        const auto CACHED = testCacheGet(*testKey);
+        stats.onTestCache(CACHED.has_value());
+
+        if (CACHED.has_value()) {
+            stats.onCommit(true, *CACHED);
+            return *CACHED;
+        }
+    }
+
+    bool ok = connector->commitState(data);
+
+    if (!ok && !data.modeset && !connector->commitTainted) {
+        // attempt to re-modeset, however, flip a tainted flag if the modesetting fails
+        // to avoid doing this over and over.
+        stats.onModesetRetry();
+
+        data.modeset  = true;
+        data.blocking = true;
+        data.flags    = onlyTest ? 0 : DRM_MODE_PAGE_FLIP_EVENT;
+        ok            = connector->commitState(data);
+
+        if (!ok)
+            connector->commitTainted = true;
+    }
+
+    // the test passed, but kms didn't take it for real. Blit from now on.
+    if (!ok && !onlyTest && backend->shouldBlit() && data.mainFB && !data.blitted)
+        mgpu.zeroCopy.works = false;
+
+    // a ranked scanout modifier was only checked by importing it. If kms won't take it, the allocator stops handing it out
+    if (!ok && data.mainFB && data.mainFB->buffer && !data.blitted && swapchain && swapchain->getAllocator()->type() == AQ_ALLOCATOR_TYPE_GBM &&
+        swapchain->contains(data.mainFB->buffer)) {
+        const auto ATTRS = data.mainFB->buffer->dmabuf();
+        ((CGBMAllocator*)swapchain->getAllocator().get())->rejectScanoutModifier(self.lock(), ATTRS.format, ATTRS.modifier);
+    }
+
+    stats.onCommit(onlyTest, ok);
+
+    if (testKey.has_value())
+        testCacheAdd(*testKey, ok);
+
+    if (onlyTest || !ok)
+        return ok;
+
+    onCommitted(data);
+
+    return true;
+}
+
+CDRMOutput::STestCacheKey Aquamarine::CDRMOutput::testCacheKey(const SDRMConnectorCommitData& data) {
+    const auto& STATE = state->state();
+    const auto& MODE  = data.modeInfo;
+
+    const auto  layerOf = [](SP<CDRMFB> fb) {
+        STestCacheKey::SLayer layer;
+        if (!fb || !fb->buffer)
+            return layer;
+
+        const auto ATTRS = fb->buffer->dmabuf();
+        layer.format     = ATTRS.format;
+        layer.modifier   = ATTRS.modifier;
+        layer.width      = (uint32_t)fb->buffer->size.x;
+        layer.height     = (uint32_t)fb->buffer->size.y;
+        return layer;
+    };
+
+    STestCacheKey key = {
+        .mode = {MODE.clock, MODE.hdisplay, MODE.hsync_start, MODE.hsync_end, MODE.htotal, MODE.hskew, MODE.vdisplay, MODE.vsync_start, MODE.vsync_end, MODE.vtotal, MODE.vscan,
+                 MODE.vrefresh, MODE.flags},
+        .primary = layerOf(data.mainFB),
+        .flags   = data.flags,
+        .enabled = STATE.enabled,
+        .modeset = data.modeset,
+        .vrr     = STATE.adaptiveSync,
+        .ctm     = data.ctm.has_value(),
+        .gamma   = (STATE.committed & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_GAMMA_LUT) != 0,
+        .tainted = connector->commitTainted,
+        .scaled  = STATE.renderSize.x > 0 && STATE.renderSize.y > 0,
+    };
+
+    if (data.cursorFB)
+        key.cursor = layerOf(data.cursorFB);
+
+    for (auto const& o : data.overlays) {
+        auto layer  = layerOf(o.fb);
+        layer.boxes = {(int32_t)o.src.x, (int32_t)o.src.y, (int32_t)o.src.w, (int32_t)o.src.h, (int32_t)o.dst.x, (int32_t)o.dst.y, (int32_t)o.dst.w, (int32_t)o.dst.h};
+        key.overlays.emplace_back(layer);
+    }
+
+    return key;
+}
+
+std::optional<bool> Aquamarine::CDRMOutput::testCacheGet(const STestCacheKey& key) {
+    if (testCacheGeneration != backend->testCacheGeneration.load()) {
+        testCache.clear();
+        testCacheGeneration = backend->testCacheGeneration.load();
+        return std::nullopt;
+    }
+
+    auto it = std::find_if(testCache.begin(), testCache.end(), [&key](const auto& e) { return e.first == key; });
+    if (it == testCache.end())
+        return std::nullopt;
+
+    testCache.splice(testCache.begin(), testCache, it);
+
+    return testCache.front().second;
+}
+
+void Aquamarine::CDRMOutput::testCacheAdd(const STestCacheKey& key, bool result) {
+    constexpr size_t MAX_CACHED_TESTS = 16;
+
+    if (testCacheGeneration != backend->testCacheGeneration.load()) {
+        testCache.clear();
+        testCacheGeneration = backend->testCacheGeneration.load();
+    }
+
+    testCache.emplace_front(key, result);
+
+    while (testCache.size() > MAX_CACHED_TESTS) {
+        testCache.pop_back();
+    }
+}
+
+void Aquamarine::CDRMOutput::onCommitted(const SDRMConnectorCommitData& data) {
+    const auto& STATE     = data.outputState(connector);
+    const auto  COMMITTED = STATE.committed;
+
+    // what's on screen now decides whether other configurations pass
+    if (data.modeset || data.ctm.has_value() ||
+        (COMMITTED & (COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_GAMMA_LUT | COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_ADAPTIVE_SYNC)))
+        backend->testCacheGeneration++;
+
+    // what the next capture has to look at again
+    if (data.mainFB) {
+        if ((COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_DAMAGE) && !STATE.damage.empty() && !data.modeset)
+            captured.damage.add(STATE.damage);
+        else
+            captured.full = true;
+    }
+
+    // a deferred commit was reported to the consumer when it was queued
+    if (!data.state.has_value()) {
+        events.commit.emit();
+        state->onCommit();
+    }
+
+    // until the page-flip lands, pairs up with the kernel's drm_vblank_event
+    if (connector->isPageFlipPending)
+        AQ_TRACE_ASYNC_BEGIN(connector->id, "aq flip conn {}", connector->id);
+
+    lastCommitNoBuffer = !data.mainFB;
+    needsFrame         = false;
+    lastCommitNs       = data.mainFB && !(data.flags & DRM_MODE_PAGE_FLIP_ASYNC) ? monotonicNs() : 0;
+
+    connector->commitTainted = false;
+
+    // disabling is blocking, nothing is on screen anymore
+    if (!enabledState)
+        connector->signalReleasePoints();
+
+    // the vblank history is for the old mode
+    if (data.modeset) {
+        deadline.period     = 0;
+        deadline.lastVblank = 0;
+    }
+
+    if (data.flags & DRM_MODE_PAGE_FLIP_ASYNC) {
+        // for tearing commits, we will send presentation feedback instantly, and rotate
+        // drm framebuffers to properly send backendRelease events.
+        // the last FB should already be gone from KMS because it's been immediately replaced
+
+        // no completion and no vsync, because tearing
+        uint32_t flags = IOutput::AQ_OUTPUT_PRESENT_HW_CLOCK;
+        if (!data.blitted)
+            flags |= IOutput::AQ_OUTPUT_PRESENT_ZEROCOPY;
+
+        timespec presented;
+        clock_gettime(CLOCK_MONOTONIC, &presented);
+
+        connector->output->deliverPresent(IOutput::SPresentEvent{
+            .presented = backend->sessionActive(),
+            .when      = &presented,
+            .seq       = 0, /* unknown sequence for tearing */
+            .refresh   = (int)(connector->refresh ? (1000000000000LL / connector->refresh) : 0),
+            .flags     = flags,
+        });
 
         connector->onPresent();
     }
+}
 
-    return ok;
+SP<CDRMFB> Aquamarine::CDRMOutput::importZeroCopy(SP<IBuffer> buffer, SP<SOutputMode> mode, bool modeset) {
+    static auto NO_ZEROCOPY = envEnabled("AQ_MGPU_NO_ZEROCOPY");
+
+    // legacy can't test
+    if (NO_ZEROCOPY || !backend->atomic)
+        return nullptr;
+
+    const auto ATTRS = buffer->dmabuf();
+    if (!ATTRS.success)
+        return nullptr;
+
+    auto& CACHE = mgpu.zeroCopy;
+
+    if (CACHE.format != ATTRS.format || CACHE.modifier != ATTRS.modifier)
+        CACHE = {.format = ATTRS.format, .modifier = ATTRS.modifier};
+
+    if (CACHE.tested && !CACHE.works)
+        return nullptr;
+
+    // failing to import here says nothing about the buffer's own gpu, don't leave it marked as unimportable
+    const bool WAS_UNIMPORTABLE = buffer->attachments.has(AQ_ATTACHMENT_DRM_KMS_UNIMPORTABLE);
+
+    auto       fb = CDRMFB::create(buffer, backend, nullptr);
+    if (!fb || fb->dead) {
+        if (!WAS_UNIMPORTABLE)
+            buffer->attachments.removeByType(AQ_ATTACHMENT_DRM_KMS_UNIMPORTABLE);
+
+        backend->backend->log(AQ_LOG_DEBUG,
+                              std::format("drm: {} can't import {} with modifier {:x} from another gpu, blitting", name, fourccToName(ATTRS.format), ATTRS.modifier));
+        CACHE.tested = true;
+        CACHE.works  = false;
+        return nullptr;
+    }
+
+    if (CACHE.tested)
+        return fb;
+
+    SDRMConnectorCommitData data;
+    data.mainFB   = fb;
+    data.test     = true;
+    data.modeset  = modeset;
+    data.blocking = true;
+    if (mode->modeInfo.has_value())
+        data.modeInfo = *mode->modeInfo;
+    else
+        data.calculateMode(connector);
+
+    CACHE.tested = true;
+    CACHE.works  = connector->commitState(data);
+
+    backend->backend->log(AQ_LOG_DEBUG,
+                          std::format("drm: {} {} scan out {} with modifier {:x} from another gpu directly", name, CACHE.works ? "can" : "can't", fourccToName(ATTRS.format),
+                                      ATTRS.modifier));
+
+    return CACHE.works ? fb : nullptr;
+}
+
+bool Aquamarine::CDRMOutput::commitAsyncBlit(SP<IBuffer> buffer, SP<IBuffer> target, const CRegion& damage, uint32_t flags, SP<CDRMSyncPoint> releasePoint) {
+    const auto& STATE       = state->state();
+    const auto  COMMITTED   = STATE.committed;
+    const auto  MODE        = STATE.mode ? STATE.mode : STATE.customMode;
+    const bool  IN_FENCE    = (COMMITTED & COutputState::eOutputStateProperties::AQ_OUTPUT_STATE_EXPLICIT_IN_FENCE) || acquireFence >= 0;
+    const int   IN_FENCE_FD = acquireFence >= 0 ? acquireFence : STATE.explicitInFence;
+
+    // the consumer stages its next frame meanwhile, commit exactly what it committed now
+    SDRMConnectorCommitData data;
+    data.flags        = flags;
+    data.releasePoint = releasePoint;
+    data.state        = STATE;
+    if (MODE->modeInfo.has_value())
+        data.modeInfo = *MODE->modeInfo;
+    else
+        data.calculateMode(connector);
+
+    connector->isBlitPending = true;
+
+    // buffer has to stay alive until the blit is done, the callback holds it
+    backend->rendererState.renderer->blitAsync(buffer, target, IN_FENCE ? IN_FENCE_FD : -1, damage,
+                                               [self = self, buffer, target, data, IN_FENCE](CDRMRenderer::SBlitResult result) mutable {
+                                                   auto output = self.lock();
+                                                   if (!output || !output->connector->isBlitPending) {
+                                                       if (result.syncFD.has_value())
+                                                           close(*result.syncFD);
+                                                       return;
+                                                   }
+
+                                                   std::lock_guard<std::recursive_mutex> lg(output->connector->mutex);
+
+                                                   output->connector->isBlitPending = false;
+                                                   output->stats.onBlit(result.cpuNs, result.gpuNs);
+
+                                                   if (result.success) {
+                                                       data.mainFB  = CDRMFB::create(target, output->backend, nullptr);
+                                                       data.blitted = true;
+                                                   }
+
+                                                   if (data.mainFB && !data.mainFB->dead) {
+                                                       static auto NO_EXPLICIT = envEnabled("AQ_MGPU_NO_EXPLICIT");
+                                                       data.explicitInFence    = result.syncFD.has_value() && !NO_EXPLICIT && IN_FENCE ? *result.syncFD : -1;
+
+                                                       if (output->connector->crtc->pendingCursor)
+                                                           data.cursorFB = output->connector->crtc->pendingCursor;
+                                                       else if (output->connector->crtc->cursor)
+                                                           data.cursorFB = output->connector->crtc->cursor->front;
+
+                                                       if (data.cursorFB && (data.cursorFB->dead || data.cursorFB->buffer->dmabuf().modifier == DRM_FORMAT_MOD_INVALID))
+                                                           data.cursorFB = nullptr;
+                                                   }
+
+                                                   // the same kms commit and bookkeeping as a synchronous one, short of the commit event
+                                                   bool OK = data.mainFB && !data.mainFB->dead;
+                                                   if (OK)
+                                                       OK = output->commitPrepared(data);
+                                                   else
+                                                       output->stats.onCommit(false, false);
+
+                                                   if (result.syncFD.has_value())
+                                                       close(*result.syncFD);
+
+                                                   if (OK)
+                                                       return;
+
+                                                   output->backend->backend->log(AQ_LOG_ERROR, "drm: Async blit or its commit failed, dropping the frame");
+                                                   output->mgpu.swapchain->rollback();
+                                                   output->events.present.emit(IOutput::SPresentEvent{.presented = false});
+                                                   output->scheduleFrame(AQ_SCHEDULE_NEEDS_FRAME);
+                                               });
+
+    // the frame is on its way, from the consumer's point of view it's committed
+    events.commit.emit();
+    state->onCommit();
+
+    needsFrame   = false;
+    lastCommitNs = monotonicNs();
+
+    return true;
 }
 
 SP<IBackendImplementation> Aquamarine::CDRMOutput::getBackend() {
@@ -1674,6 +3058,8 @@ SP<IBackendImplementation> Aquamarine::CDRMOutput::getBackend() {
 }
 
 bool Aquamarine::CDRMOutput::setCursor(SP<IBuffer> buffer, const Vector2D& hotspot) {
+    std::lock_guard<std::recursive_mutex> lg(connector->mutex);
+
     if (!connector->crtc)
         return false;
 
@@ -1692,9 +3078,24 @@ bool Aquamarine::CDRMOutput::setCursor(SP<IBuffer> buffer, const Vector2D& hotsp
             return false;
         }
 
-        SP<CDRMFB> fb;
+        SP<CDRMFB>                     fb;
+        std::optional<SCursorCacheKey> cacheKey;
+        bool                           cached = false;
 
         if (backend->primary) {
+            cacheKey = cursorCacheKey(buffer);
+            fb       = cacheKey.has_value() ? cursorCacheGet(*cacheKey) : nullptr;
+            cached   = !!fb;
+
+            if (!fb)
+                fb = uploadCursor(buffer, cacheKey.has_value());
+        }
+
+        if (cached) {
+            TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Cursor image is cached, reusing its fb"));
+        } else if (fb) {
+            TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Backend requires a cursor copy, copied it on the cpu"));
+        } else if (backend->primary) {
             TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Backend requires cursor blit, blitting"));
 
             // TODO: will this not implode on drm_dumb?!
@@ -1720,8 +3121,11 @@ bool Aquamarine::CDRMOutput::setCursor(SP<IBuffer> buffer, const Vector2D& hotsp
                 return false;
             }
 
-            auto NEWAQBUF = mgpu.cursorSwapchain->next(nullptr);
-            if (!backend->rendererState.renderer->blit(buffer, NEWAQBUF).success) {
+            // cached images keep their buffer, the swapchain would hand it out again
+            auto NEWAQBUF = cacheKey.has_value() ?
+                backend->rendererState.allocator->acquire(SAllocatorBufferParams{.size = SIZE, .format = FORMAT, .scanout = true, .cursor = true}, mgpu.cursorSwapchain) :
+                mgpu.cursorSwapchain->next(nullptr);
+            if (!NEWAQBUF || !backend->blit(buffer, NEWAQBUF).success) {
                 backend->backend->log(AQ_LOG_ERROR, "drm: Backend requires blit, but cursor blit failed");
                 return false;
             }
@@ -1735,6 +3139,9 @@ bool Aquamarine::CDRMOutput::setCursor(SP<IBuffer> buffer, const Vector2D& hotsp
             return false;
         }
 
+        if (cacheKey.has_value() && !cached)
+            cursorCacheAdd(*cacheKey, fb);
+
         cursorHotspot = hotspot;
 
         backend->backend->log(AQ_LOG_DEBUG, std::format("drm: Cursor buffer imported into KMS with id {}", fb->id));
@@ -1742,30 +3149,197 @@ bool Aquamarine::CDRMOutput::setCursor(SP<IBuffer> buffer, const Vector2D& hotsp
         connector->crtc->pendingCursor = fb;
 
         cursorVisible = true;
+
+        if (backend->impl->commitCursor(connector))
+            return true;
     }
 
     scheduleFrame(AQ_SCHEDULE_CURSOR_SHAPE);
     return true;
 }
 
+// 32bpp cursors to ARGB8888, a row at a time so the loops vectorize
+// row pitch of what beginDataPtr() maps. Only linear dmabufs are mapped as laid out, others may come back detiled with another pitch: 0, don't copy
+static size_t cursorDataStride(SP<IBuffer> buffer) {
+    if (buffer->type() == eBufferType::BUFFER_TYPE_SHM)
+        return buffer->shm().stride;
+
+    const auto ATTRS = buffer->dmabuf();
+    if (!ATTRS.success || (ATTRS.modifier != DRM_FORMAT_MOD_LINEAR && ATTRS.modifier != DRM_FORMAT_MOD_INVALID))
+        return 0;
+
+    return ATTRS.strides.at(0);
+}
+
+static bool copyCursorPixels(const uint8_t* src, size_t srcStride, uint32_t format, uint8_t* dst, size_t dstStride, size_t width, size_t height) {
+    for (size_t y = 0; y < height; ++y) {
+        const auto IN  = (const uint32_t*)(src + y * srcStride);
+        auto       out = (uint32_t*)(dst + y * dstStride);
+
+        switch (format) {
+            case DRM_FORMAT_ARGB8888: memcpy(out, IN, width * 4); break;
+            case DRM_FORMAT_XRGB8888:
+                for (size_t x = 0; x < width; ++x) {
+                    out[x] = IN[x] | 0xFF000000;
+                }
+                break;
+            case DRM_FORMAT_ABGR8888:
+            case DRM_FORMAT_XBGR8888: {
+                const uint32_t ALPHA = format == DRM_FORMAT_XBGR8888 ? 0xFF000000 : 0;
+                for (size_t x = 0; x < width; ++x) {
+                    out[x] = (IN[x] & 0xFF00FF00) | ((IN[x] & 0xFF) << 16) | ((IN[x] >> 16) & 0xFF) | ALPHA;
+                }
+                break;
+            }
+            default: return false;
+        }
+    }
+
+    return true;
+}
+
+SP<CDRMFB> Aquamarine::CDRMOutput::uploadCursor(SP<IBuffer> buffer, bool standalone) {
+    // past this, a gpu blit beats touching every pixel on the cpu
+    constexpr double MAX_SIZE = 256;
+
+    const bool       SHM    = buffer->type() == eBufferType::BUFFER_TYPE_SHM;
+    const auto       FORMAT = SHM ? buffer->shm().format : buffer->dmabuf().format;
+    const auto       SIZE   = buffer->size;
+
+    if (!backend->dumbAllocator || !(buffer->caps() & eBufferCapability::BUFFER_CAPABILITY_DATAPTR) || !connector->crtc->cursor ||
+        !connector->crtc->cursor->formats.has(DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_LINEAR))
+        return nullptr;
+
+    if (SIZE.x < 1 || SIZE.y < 1 || SIZE.x > MAX_SIZE || SIZE.y > MAX_SIZE ||
+        (FORMAT != DRM_FORMAT_ARGB8888 && FORMAT != DRM_FORMAT_XRGB8888 && FORMAT != DRM_FORMAT_ABGR8888 && FORMAT != DRM_FORMAT_XBGR8888))
+        return nullptr;
+
+    SP<IBuffer> target;
+    if (standalone)
+        target = backend->dumbAllocator->acquire(SAllocatorBufferParams{.size = SIZE, .format = DRM_FORMAT_ARGB8888, .scanout = true, .cursor = true}, nullptr);
+    else {
+        if (!mgpu.dumbCursorSwapchain)
+            mgpu.dumbCursorSwapchain = CSwapchain::create(backend->dumbAllocator, backend.lock());
+
+        if (mgpu.dumbCursorSwapchain->reconfigure(SSwapchainOptions{.length = 2, .size = SIZE, .format = DRM_FORMAT_ARGB8888, .scanout = true, .cursor = true}))
+            target = mgpu.dumbCursorSwapchain->next(nullptr);
+    }
+
+    if (!target) {
+        backend->backend->log(AQ_LOG_ERROR, "drm: Failed to allocate a dumb cursor buffer, falling back to a blit");
+        return nullptr;
+    }
+
+    const size_t W = SIZE.x, H = SIZE.y;
+
+    auto [src, srcFormat, srcLen] = buffer->beginDataPtr(GBM_BO_TRANSFER_READ);
+    auto [dst, dstFormat, dstLen] = target->beginDataPtr(GBM_BO_TRANSFER_WRITE);
+
+    const size_t SRC_STRIDE = cursorDataStride(buffer);
+    const size_t DST_STRIDE = target->dmabuf().strides.at(0);
+
+    const bool   OK = src && dst && SRC_STRIDE >= W * 4 && srcLen >= SRC_STRIDE * (H - 1) + W * 4 && dstLen >= DST_STRIDE * H &&
+        copyCursorPixels(src, SRC_STRIDE, FORMAT, dst, DST_STRIDE, W, H);
+
+    buffer->endDataPtr();
+    target->endDataPtr();
+
+    if (!OK) {
+        TRACE(backend->backend->log(AQ_LOG_TRACE, "drm: Cursor buffer couldn't be copied on the cpu, falling back to a blit"));
+        if (!standalone)
+            mgpu.dumbCursorSwapchain->rollback();
+        return nullptr;
+    }
+
+    return CDRMFB::create(target, backend, nullptr);
+}
+
+std::optional<CDRMOutput::SCursorCacheKey> Aquamarine::CDRMOutput::cursorCacheKey(SP<IBuffer> buffer) {
+    if (!(buffer->caps() & eBufferCapability::BUFFER_CAPABILITY_DATAPTR) || buffer->size.x < 1 || buffer->size.y < 1)
+        return std::nullopt;
+
+    const bool   SHM    = buffer->type() == eBufferType::BUFFER_TYPE_SHM;
+    const auto   FORMAT = SHM ? buffer->shm().format : buffer->dmabuf().format;
+    const size_t ROW    = buffer->size.x * 4, H = buffer->size.y; // cursors are 32bpp, anything else fails the stride check
+
+    auto [data, dataFormat, len] = buffer->beginDataPtr(GBM_BO_TRANSFER_READ);
+
+    const size_t                   STRIDE = cursorDataStride(buffer);
+    std::optional<SCursorCacheKey> key;
+
+    if (data && STRIDE >= ROW && len >= STRIDE * (H - 1) + ROW) {
+        key = SCursorCacheKey{.size = buffer->size, .format = FORMAT};
+        key->pixels.resize(ROW * H);
+
+        for (size_t y = 0; y < H; ++y) {
+            memcpy(key->pixels.data() + y * ROW, data + y * STRIDE, ROW);
+        }
+
+        key->hash = std::hash<std::string_view>{}(std::string_view{(const char*)key->pixels.data(), key->pixels.size()});
+    }
+
+    buffer->endDataPtr();
+
+    return key;
+}
+
+SP<CDRMFB> Aquamarine::CDRMOutput::cursorCacheGet(const SCursorCacheKey& key) {
+    auto it = std::find_if(cursorCache.begin(), cursorCache.end(), [&key](const auto& e) { return e.key == key; });
+    if (it != cursorCache.end() && it->fb->dead) {
+        cursorCache.erase(it);
+        it = cursorCache.end();
+    }
+
+    stats.onCursorCache(it != cursorCache.end());
+
+    if (it == cursorCache.end())
+        return nullptr;
+
+    cursorCache.splice(cursorCache.begin(), cursorCache, it);
+
+    return cursorCache.front().fb;
+}
+
+void Aquamarine::CDRMOutput::cursorCacheAdd(const SCursorCacheKey& key, SP<CDRMFB> fb) {
+    // a few animations' worth. The one on screen is the most recent, so it's never the one to go
+    constexpr size_t MAX_CACHED_CURSORS = 32;
+
+    cursorCache.emplace_front(SCursorCacheEntry{.key = key, .buffer = fb->buffer.lock(), .fb = fb});
+
+    while (cursorCache.size() > MAX_CACHED_CURSORS) {
+        cursorCache.pop_back();
+    }
+}
+
 void Aquamarine::CDRMOutput::moveCursor(const Vector2D& coord, bool skipSchedule) {
+    std::lock_guard<std::recursive_mutex> lg(connector->mutex);
+
     cursorPos = coord;
     // cursorVisible = true;
     backend->impl->moveCursor(connector, skipSchedule);
 }
 
 void Aquamarine::CDRMOutput::scheduleFrame(const scheduleFrameReason reason) {
+    std::lock_guard<std::recursive_mutex> lg(connector->mutex);
+
     TRACE(backend->backend->log(AQ_LOG_TRACE,
                                 std::format("CDRMOutput::scheduleFrame: reason {}, needsFrame {}, isPageFlipPending {}, frameEventScheduled {}", (uint32_t)reason, needsFrame,
                                             connector->isPageFlipPending, connector->frameEventScheduled)));
     needsFrame = true;
 
-    if (connector->isPageFlipPending || connector->frameEventScheduled || !enabledState)
+    if (connector->isPageFlipPending || connector->isBlitPending || connector->frameEventScheduled || !enabledState)
         return;
 
     connector->frameEventScheduled = true;
 
-    backend->backend->addIdleEvent(frameIdle);
+    if (connector->deferFrame())
+        return;
+
+    // the backend's idle queue belongs to the main thread
+    if (threaded.enabled)
+        deliver([this]() { (*frameIdle)(); });
+    else
+        backend->backend->addIdleEvent(frameIdle);
 }
 
 Vector2D Aquamarine::CDRMOutput::cursorPlaneSize() {
@@ -1792,7 +3366,203 @@ std::vector<SDRMFormat> Aquamarine::CDRMOutput::getRenderFormats() {
         backend->log(AQ_LOG_ERROR, "Can't get formats: no crtc");
         return {};
     }
-    return connector->crtc->primary->formats;
+    return connector->crtc->primary->formats.list();
+}
+
+size_t Aquamarine::CDRMOutput::maxLayers() {
+    if (!backend->atomic || backend->primary || !connector->crtc)
+        return 0;
+
+    return connector->crtc->overlays.size();
+}
+
+bool Aquamarine::CDRMOutput::setFrameDeadline(bool enabled, uint64_t budgetNs) {
+    // the deadline timer is dispatched on the main thread
+    if (enabled && threaded.enabled)
+        return false;
+
+    deadline.enabled = enabled;
+    deadline.budget  = budgetNs;
+
+    if (!enabled && deadline.fireAt) {
+        // send the frame it was holding back
+        deadline.fireAt                = 0;
+        connector->frameEventScheduled = false;
+        backend->updateFrameDeadlines();
+        scheduleFrame(AQ_SCHEDULE_UNKNOWN);
+    }
+
+    return true;
+}
+
+void Aquamarine::CDRMOutput::reportRenderTime(uint64_t ns) {
+    // jump up on a slow frame right away, decay slowly so a single fast frame doesn't make us miss the next vblank
+    deadline.learned = ns >= deadline.learned ? ns : deadline.learned - (deadline.learned - ns) / 16;
+}
+
+bool Aquamarine::CDRMOutput::setThreadedCommits(bool enabled) {
+    if (enabled == threaded.enabled)
+        return true;
+
+    int fd = -1;
+
+    if (enabled) {
+        // the blit completes on the main thread's event loop
+        if (backend->shouldBlit()) {
+            backend->backend->log(AQ_LOG_ERROR, std::format("drm: Output {} needs a blit, can't commit it off the main thread", name));
+            return false;
+        }
+
+        fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (fd < 0) {
+            backend->backend->log(AQ_LOG_ERROR, std::format("drm: Failed to create an eventfd for threaded commits on {}", name));
+            return false;
+        }
+
+        setFrameDeadline(false);
+        backend->backend->removeIdleEvent(frameIdle);
+    }
+
+    std::vector<std::function<void(void)>> queued;
+    {
+        std::lock_guard<std::recursive_mutex> lg(connector->mutex);
+        std::lock_guard<std::mutex>           lgt(threaded.mutex);
+        threaded.enabled = enabled;
+        fd               = std::exchange(threaded.fd, fd);
+        if (!enabled)
+            queued.swap(threaded.pending);
+    }
+
+    if (!enabled) {
+        // deliver() checks the flag under threaded.mutex, nothing queues or writes the fd past this point
+        close(fd);
+
+        // hand whatever was still queued to the main thread
+        for (auto const& fn : queued) {
+            fn();
+        }
+    }
+
+    // a frame scheduled through the old path is gone now
+    if (connector->frameEventScheduled) {
+        connector->frameEventScheduled = false;
+        scheduleFrame(AQ_SCHEDULE_UNKNOWN);
+    }
+
+    return true;
+}
+
+int Aquamarine::CDRMOutput::threadedEventFD() {
+    std::lock_guard<std::mutex> lg(threaded.mutex);
+    return threaded.enabled ? threaded.fd : -1;
+}
+
+void Aquamarine::CDRMOutput::dispatchThreadedEvents() {
+    std::vector<std::function<void(void)>> cpy;
+    {
+        std::lock_guard<std::mutex> lg(threaded.mutex);
+        if (threaded.fd < 0)
+            return;
+
+        // clear the eventfd with the queue, a deliver() after the swap wakes us up again
+        uint64_t count = 0;
+        if (read(threaded.fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            backend->backend->log(AQ_LOG_ERROR, std::format("drm: failed to read the threaded eventfd for {}: {}", name, strerror(errno)));
+
+        cpy.swap(threaded.pending);
+    }
+
+    for (auto const& fn : cpy) {
+        fn();
+    }
+}
+
+void Aquamarine::CDRMOutput::deliver(std::function<void(void)> fn) {
+    {
+        // setThreadedCommits flips the flag and drains under the same lock before closing the fd
+        std::lock_guard<std::mutex> lg(threaded.mutex);
+        if (threaded.enabled) {
+            threaded.pending.emplace_back(std::move(fn));
+
+            if (threaded.pending.size() > 1)
+                return; // already woken
+
+            uint64_t one = 1;
+            if (write(threaded.fd, &one, sizeof(one)) != sizeof(one))
+                backend->backend->log(AQ_LOG_ERROR, "drm: Failed to wake the threaded event fd");
+            return;
+        }
+    }
+
+    // not under the lock, listeners may commit and deliver again
+    fn();
+}
+
+void Aquamarine::CDRMOutput::deliverPresent(const SPresentEvent& event) {
+    if (!threaded.enabled) {
+        events.present.emit(event);
+        return;
+    }
+
+    // when points at the caller's stack
+    std::optional<timespec> when;
+    if (event.when)
+        when = *event.when;
+
+    deliver([this, event, when]() mutable {
+        event.when = when.has_value() ? &*when : nullptr;
+        events.present.emit(event);
+    });
+}
+
+void Aquamarine::CDRMOutput::deliverFrame() {
+    deliver([this]() { events.frame.emit(); });
+}
+
+SP<COutputCapture> Aquamarine::CDRMOutput::capture(const Vector2D& scaledSize) {
+    if (!connector->crtc || !connector->crtc->primary->front || !enabledState)
+        return nullptr;
+
+    // with a blit this is the copy on our gpu, which is what's scanned out
+    auto buffer = connector->crtc->primary->front->buffer.lock();
+    if (!buffer)
+        return nullptr;
+
+    const auto ATTRS = buffer->dmabuf();
+    if (!ATTRS.success)
+        return nullptr;
+
+    auto result    = makeShared<COutputCapture>(buffer);
+    result->dmabuf = ATTRS;
+    result->damage = captured.full ? CRegion{CBox{{}, buffer->size}} : captured.damage;
+
+    captured.damage.clear();
+    captured.full = false;
+
+    if (scaledSize.x <= 0 || scaledSize.y <= 0 || !backend->rendererState.renderer)
+        return result;
+
+    if (!captured.swapchain)
+        captured.swapchain = CSwapchain::create(backend->rendererState.allocator, backend.lock());
+
+    // a few buffers, consumers may hold on to one while the next is blitted
+    if (!captured.swapchain->reconfigure(SSwapchainOptions{.length = 3, .size = scaledSize, .format = ATTRS.format})) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("drm: Failed to allocate {} capture buffers for {}", scaledSize, name));
+        return result;
+    }
+
+    auto target = captured.swapchain->next(nullptr);
+    auto blit   = backend->blit(buffer, target);
+    if (!blit.success) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("drm: Failed to blit a {} capture for {}", scaledSize, name));
+        return result;
+    }
+
+    target->lock();
+    result->scaled      = target;
+    result->scaledFence = blit.syncFD.has_value() ? fcntl(*blit.syncFD, F_DUPFD_CLOEXEC, 0) : -1; // the blitter closes its own on the next blit
+
+    return result;
 }
 
 int Aquamarine::CDRMOutput::getConnectorID() {
@@ -1803,10 +3573,16 @@ Aquamarine::CDRMOutput::CDRMOutput(const std::string& name_, Hyprutils::Memory::
     backend(backend_), connector(connector_) {
     name = name_;
 
+    deadline.enabled = envEnabled("AQ_DRM_FRAME_DEADLINE");
+    lfc.enabled      = envEnabled("AQ_DRM_VRR_LFC");
+
     frameIdle = makeShared<std::function<void(void)>>([this]() {
-        connector->frameEventScheduled = false;
-        if (connector->isPageFlipPending)
-            return;
+        {
+            std::lock_guard<std::recursive_mutex> lg(connector->mutex);
+            connector->frameEventScheduled = false;
+            if (connector->isPageFlipPending)
+                return;
+        }
         events.frame.emit();
     });
 }
@@ -1818,10 +3594,17 @@ SP<CDRMFB> Aquamarine::CDRMFB::create(SP<IBuffer> buffer_, Hyprutils::Memory::CW
     if (isNew)
         *isNew = true;
 
-    if (buffer_->attachments.has(AQ_ATTACHMENT_DRM_BUFFER)) {
-        auto at = (CDRMBufferAttachment*)buffer_->attachments.get(AQ_ATTACHMENT_DRM_BUFFER).get();
-        fb      = at->fb;
+    bool attachedElsewhere = false;
+
+    if (auto at = buffer_->attachments.get<CDRMBufferAttachment>(); at) {
+        fb = at->fb;
         TRACE(backend_->log(AQ_LOG_TRACE, std::format("drm: CDRMFB: buffer has drmfb attachment with fb {:x}", (uintptr_t)fb.get())));
+
+        // fb ids are per device. A buffer scanned out on two gpus only keeps the first one attached.
+        if (fb && fb->backend != backend_) {
+            fb                = nullptr;
+            attachedElsewhere = true;
+        }
     }
 
     if (fb) {
@@ -1830,12 +3613,39 @@ SP<CDRMFB> Aquamarine::CDRMFB::create(SP<IBuffer> buffer_, Hyprutils::Memory::CW
         return fb;
     }
 
+    // a buffer that carries another gpu's attachment finds its fb here. Entries are dropped with their IBuffer, so an fb owned by
+    // another live IBuffer isn't shared, and an expired owner only means its destroy was never emitted.
+    const auto KEY = CDRMBackend::fbCacheKey(buffer_->dmabuf());
+    if (KEY) {
+        fb = backend_->fbCacheGet(*KEY);
+
+        if (fb && (fb->buffer.expired() || fb->buffer == buffer_)) {
+            TRACE(backend_->log(AQ_LOG_TRACE, std::format("drm: CDRMFB: reusing cached fb {} for a new buffer", fb->id)));
+
+            if (fb->buffer.expired())
+                fb->rebind(buffer_);
+
+            if (!attachedElsewhere)
+                buffer_->attachments.add(makeShared<CDRMBufferAttachment>(fb));
+
+            if (isNew)
+                *isNew = false;
+            return fb;
+        }
+    }
+
+    const bool CACHE_NEW = KEY && !fb;
+
     fb = SP<CDRMFB>(new CDRMFB(buffer_, backend_));
 
     if (!fb->id)
         return nullptr;
 
-    buffer_->attachments.add(makeShared<CDRMBufferAttachment>(fb));
+    if (!attachedElsewhere)
+        buffer_->attachments.add(makeShared<CDRMBufferAttachment>(fb));
+
+    if (CACHE_NEW)
+        backend_->fbCacheAdd(*KEY, fb);
 
     return fb;
 }
@@ -1881,7 +3691,14 @@ void Aquamarine::CDRMFB::import() {
 
     closeHandles();
 
+    listenForDestroy();
+}
+
+void Aquamarine::CDRMFB::listenForDestroy() {
     listeners.destroyBuffer = buffer->events.destroy.registerListener([this](std::any d) {
+        // a dead buffer's fb would pin its bo until evicted. The cache may hold the last ref to us, keep it until we're done
+        const auto KEEP = cached ? backend->fbCacheRemove(this) : nullptr;
+
         drop();
         dead      = true;
         id        = 0;
@@ -1889,6 +3706,11 @@ void Aquamarine::CDRMFB::import() {
     });
 }
 
+void Aquamarine::CDRMFB::rebind(SP<IBuffer> buffer_) {
+    buffer = buffer_;
+    listenForDestroy();
+}
+
 void Aquamarine::CDRMFB::reimport() {
     drop();
     dropped       = false;
@@ -1992,6 +3814,54 @@ uint32_t Aquamarine::CDRMFB::submitBuffer() {
     return newID;
 }
 
+SP<CDRMSyncPoint> Aquamarine::CDRMSyncPoint::create(Hyprutils::Memory::CWeakPointer<CDRMBackend> backend_, int timelineFD, uint64_t point_) {
+    auto syncPoint = SP<CDRMSyncPoint>(new CDRMSyncPoint());
+
+    syncPoint->backend = backend_;
+    syncPoint->point   = point_;
+
+    if (timelineFD < 0 || drmSyncobjFDToHandle(backend_->gpu->fd, timelineFD, &syncPoint->handle)) {
+        backend_->backend->log(AQ_LOG_ERROR, "drm: Failed to import a syncobj timeline");
+        return nullptr;
+    }
+
+    return syncPoint;
+}
+
+Aquamarine::CDRMSyncPoint::~CDRMSyncPoint() {
+    if (handle && backend)
+        drmSyncobjDestroy(backend->gpu->fd, handle);
+}
+
+int Aquamarine::CDRMSyncPoint::exportSyncFile() {
+    // sync files can only come out of binary syncobjs, move the point's fence over to one
+    uint32_t binary = 0;
+    int      fd     = -1;
+
+    if (drmSyncobjCreate(backend->gpu->fd, 0, &binary))
+        return -1;
+
+    if (drmSyncobjTransfer(backend->gpu->fd, binary, 0, handle, point, 0) || drmSyncobjExportSyncFile(backend->gpu->fd, binary, &fd))
+        fd = -1;
+
+    drmSyncobjDestroy(backend->gpu->fd, binary);
+
+    return fd;
+}
+
+bool Aquamarine::CDRMSyncPoint::signal() {
+    if (drmSyncobjTimelineSignal(backend->gpu->fd, &handle, &point, 1)) {
+        backend->backend->log(AQ_LOG_ERROR, std::format("drm: Failed to signal a syncobj timeline point {}", point));
+        return false;
+    }
+
+    return true;
+}
+
+const COutputState::SInternalState& Aquamarine::SDRMConnectorCommitData::outputState(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector) const {
+    return state.has_value() ? *state : connector->output->state->state();
+}
+
 void Aquamarine::SDRMConnectorCommitData::calculateMode(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector) {
     if (!connector || !connector->output || !connector->output->state)
         return;
@@ -2081,6 +3951,9 @@ SP<CDRMLease> Aquamarine::CDRMLease::create(std::vector<SP<IOutput>> outputs) {
         objects.push_back(drmo->connector->crtc->primary->id);
         if (drmo->connector->crtc->cursor)
             objects.push_back(drmo->connector->crtc->cursor->id);
+        for (auto const& plane : drmo->connector->crtc->overlays) {
+            objects.push_back(plane->id);
+        }
 
         lease->outputs.emplace_back(drmo);
     }
@@ -2097,6 +3970,8 @@ SP<CDRMLease> Aquamarine::CDRMLease::create(std::vector<SP<IOutput>> outputs) {
         o->lease = lease;
     }
 
+    backend->testCacheGeneration++;
+
     lease->leaseFD = leaseFD;
     lease->backend = backend;
 
@@ -4,9 +4,16 @@
 #include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <future>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <sys/eventfd.h>
 #include "Math.hpp"
 #include "Shared.hpp"
 #include "FormatUtils.hpp"
+#include "Tracepoints.hpp"
 #include <xf86drm.h>
 #include <aquamarine/allocator/GBM.hpp>
 
@@ -351,6 +358,20 @@ SP<CDRMRenderer> CDRMRenderer::attempt(Hyprutils::Memory::CSharedPointer<CGBMAll
     renderer->gl.shaderExt.texAttrib = glGetAttribLocation(renderer->gl.shaderExt.program, "texcoord");
     renderer->gl.shaderExt.tex       = glGetUniformLocation(renderer->gl.shaderExt.program, "tex");
 
+    const auto        GLEXTENSIONSPTR = (const char*)glGetString(GL_EXTENSIONS);
+    const std::string GLEXTENSIONS    = GLEXTENSIONSPTR ? GLEXTENSIONSPTR : "";
+
+    if (GLEXTENSIONS.contains("GL_EXT_disjoint_timer_query")) {
+        loadGLProc(&renderer->timerQuery.glGenQueriesEXT, "glGenQueriesEXT");
+        loadGLProc(&renderer->timerQuery.glBeginQueryEXT, "glBeginQueryEXT");
+        loadGLProc(&renderer->timerQuery.glEndQueryEXT, "glEndQueryEXT");
+        loadGLProc(&renderer->timerQuery.glGetQueryObjectuivEXT, "glGetQueryObjectuivEXT");
+        loadGLProc(&renderer->timerQuery.glGetQueryObjectui64vEXT, "glGetQueryObjectui64vEXT");
+
+        renderer->timerQuery.glGenQueriesEXT(1, &renderer->timerQuery.query);
+        renderer->timerQuery.supported = renderer->timerQuery.query != 0;
+    }
+
     renderer->restoreEGL();
 
     backend_->log(AQ_LOG_DEBUG, "CDRMRenderer: success");
@@ -359,6 +380,10 @@ SP<CDRMRenderer> CDRMRenderer::attempt(Hyprutils::Memory::CSharedPointer<CGBMAll
 }
 
 void CDRMRenderer::setEGL() {
+    // the blit thread keeps the context current
+    if (onBlitThread())
+        return;
+
     savedEGLState.display = eglGetCurrentDisplay();
     savedEGLState.context = eglGetCurrentContext();
     savedEGLState.draw    = eglGetCurrentSurface(EGL_DRAW);
@@ -369,6 +394,9 @@ void CDRMRenderer::setEGL() {
 }
 
 void CDRMRenderer::restoreEGL() {
+    if (onBlitThread())
+        return;
+
     EGLDisplay dpy = savedEGLState.display ? savedEGLState.display : egl.display;
 
     // egl can't handle this
@@ -379,6 +407,149 @@ void CDRMRenderer::restoreEGL() {
         backend->log(AQ_LOG_WARNING, "CDRMRenderer: restoreEGL eglMakeCurrent failed");
 }
 
+CDRMRenderer::~CDRMRenderer() {
+    if (!blitThread.thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lk(blitThread.mutex);
+        blitThread.exit = true;
+    }
+    blitThread.cv.notify_all();
+    blitThread.thread.join();
+
+    for (auto const& [id, result] : blitThread.done) {
+        if (result.syncFD.has_value())
+            close(*result.syncFD);
+    }
+
+    if (blitThread.eventFD >= 0)
+        close(blitThread.eventFD);
+}
+
+bool CDRMRenderer::startBlitThread() {
+    blitThread.eventFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (blitThread.eventFD < 0) {
+        backend->log(AQ_LOG_ERROR, "CDRMRenderer: failed to create an eventfd for the blit thread");
+        return false;
+    }
+
+    blitThread.thread = std::thread([this]() {
+        if (!eglMakeCurrent(egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl.context))
+            backend->log(AQ_LOG_ERROR, "CDRMRenderer: blit thread failed to make the context current");
+
+        while (true) {
+            std::function<void()> job;
+
+            {
+                std::unique_lock<std::mutex> lk(blitThread.mutex);
+                blitThread.cv.wait(lk, [this]() { return blitThread.exit || !blitThread.jobs.empty(); });
+
+                if (blitThread.jobs.empty())
+                    break;
+
+                job = std::move(blitThread.jobs.front());
+                blitThread.jobs.pop_front();
+            }
+
+            // the log function is the compositor's, only call it on the main thread
+            std::vector<std::pair<uint32_t, std::string>> logs;
+            threadLogSink = &logs;
+            job();
+            threadLogSink = nullptr;
+
+            bool signal = !logs.empty();
+            {
+                std::lock_guard<std::mutex> lk(blitThread.mutex);
+                blitThread.logs.insert(blitThread.logs.end(), std::make_move_iterator(logs.begin()), std::make_move_iterator(logs.end()));
+                signal = signal || !blitThread.done.empty();
+            }
+
+            uint64_t one = 1;
+            if (signal && write(blitThread.eventFD, &one, sizeof(one)) != sizeof(one))
+                backend->log(AQ_LOG_ERROR, "EGL (blit thread): failed to signal the eventfd");
+        }
+
+        eglMakeCurrent(egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    });
+
+    backend->log(AQ_LOG_DEBUG, "CDRMRenderer: started a blit thread");
+
+    return true;
+}
+
+bool CDRMRenderer::onBlitThread() {
+    return blitThread.thread.joinable() && std::this_thread::get_id() == blitThread.thread.get_id();
+}
+
+bool CDRMRenderer::needsBlitThread() {
+    return blitThread.thread.joinable() && std::this_thread::get_id() != blitThread.thread.get_id();
+}
+
+void CDRMRenderer::runOnBlitThread(std::function<void()> job, bool wait) {
+    if (!wait) {
+        {
+            std::lock_guard<std::mutex> lk(blitThread.mutex);
+            blitThread.jobs.emplace_back(std::move(job));
+        }
+        blitThread.cv.notify_one();
+        return;
+    }
+
+    std::promise<void> promise;
+    auto               future = promise.get_future();
+
+    {
+        std::lock_guard<std::mutex> lk(blitThread.mutex);
+        blitThread.jobs.emplace_back([&job, &promise]() {
+            job();
+            promise.set_value();
+        });
+    }
+    blitThread.cv.notify_one();
+
+    future.wait();
+}
+
+bool CDRMRenderer::asyncBlits() {
+    return blitThread.thread.joinable();
+}
+
+int CDRMRenderer::asyncBlitFD() {
+    return blitThread.eventFD;
+}
+
+void CDRMRenderer::dispatchAsyncBlits() {
+    uint64_t count = 0;
+    if (read(blitThread.eventFD, &count, sizeof(count)) != sizeof(count))
+        return;
+
+    std::vector<std::pair<uint64_t, SBlitResult>> done;
+    std::vector<std::pair<uint32_t, std::string>> logs;
+    {
+        std::lock_guard<std::mutex> lk(blitThread.mutex);
+        done.swap(blitThread.done);
+        logs.swap(blitThread.logs);
+    }
+
+    for (auto const& [level, msg] : logs) {
+        backend->log((eBackendLogLevel)level, msg);
+    }
+
+    for (auto const& [id, result] : done) {
+        auto it = std::find_if(blitThread.pending.begin(), blitThread.pending.end(), [id](const auto& e) { return e.first == id; });
+        if (it == blitThread.pending.end()) {
+            if (result.syncFD.has_value())
+                close(*result.syncFD);
+            continue;
+        }
+
+        auto onDone = std::move(it->second);
+        blitThread.pending.erase(it);
+        onDone(result);
+    }
+}
+
 EGLImageKHR CDRMRenderer::createEGLImage(const SDMABUFAttrs& attrs) {
     std::vector<uint32_t> attribs;
 
@@ -562,6 +733,11 @@ int CDRMRenderer::recreateBlitSync() {
 }
 
 void CDRMRenderer::clearBuffer(IBuffer* buf) {
+    if (needsBlitThread()) {
+        runOnBlitThread([&] { clearBuffer(buf); }, true);
+        return;
+    }
+
     setEGL();
 
     auto   dmabuf = buf->dmabuf();
@@ -607,19 +783,93 @@ void CDRMRenderer::clearBuffer(IBuffer* buf) {
     restoreEGL();
 }
 
-CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, int waitFD) {
+bool CDRMRenderer::canBlit(SP<IBuffer> from, SP<IBuffer> to) {
+    // the source is imported as a texture on the first blit, anything we can't sample fails there
+    return verifyDestinationDMABUF(to->dmabuf());
+}
+
+std::string CDRMRenderer::name() {
+    return "GLES";
+}
+
+CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, int waitFD, const CRegion& damage) {
+    if (needsBlitThread()) {
+        SBlitResult result;
+        runOnBlitThread([&] { result = blit(from, to, waitFD, damage); }, true);
+        return result;
+    }
+
     setEGL();
 
-    if (from->dmabuf().size != to->dmabuf().size) {
-        backend->log(AQ_LOG_ERROR, "EGL (blit): buffer sizes mismatched");
+    auto targets = prepareBlit(from, to);
+    if (!targets) {
+        restoreEGL();
         return {};
     }
 
-    if (waitFD >= 0) {
-        // wait on a provided explicit fence
-        waitOnSync(waitFD);
+    auto result = blitTargets(*targets, waitFD, damage);
+
+    restoreEGL();
+
+    return result;
+}
+
+void CDRMRenderer::blitAsync(SP<IBuffer> from, SP<IBuffer> to, int waitFD, const CRegion& damage, std::function<void(SBlitResult)> onDone) {
+    if (!blitThread.thread.joinable()) {
+        onDone(blit(from, to, waitFD, damage));
+        return;
+    }
+
+    // swapchain buffers come back, only their first blit has to wait for the blit thread to create their GL objects
+    std::optional<SBlitTargets> targets = existingBlitTargets(from, to);
+    if (!targets)
+        runOnBlitThread([&] { targets = prepareBlit(from, to); }, true);
+
+    if (!targets) {
+        onDone({});
+        return;
     }
 
+    // the consumer owns waitFD and may close it once the commit returns
+    const int  WAITFD = waitFD >= 0 ? fcntl(waitFD, F_DUPFD_CLOEXEC, 0) : -1;
+    const auto ID     = blitThread.nextID++;
+    blitThread.pending.emplace_back(ID, onDone);
+
+    // this only touches GL objects, never the buffers. Those are kept alive by onDone until the result is dispatched.
+    runOnBlitThread(
+        [this, ID, WAITFD, damage, targets = *targets]() {
+            auto result = blitTargets(targets, WAITFD, damage);
+
+            if (WAITFD >= 0)
+                close(WAITFD);
+
+            // the next blit closes our sync fd, hand out a dup that onDone owns
+            if (result.syncFD.has_value()) {
+                const int FD  = fcntl(*result.syncFD, F_DUPFD_CLOEXEC, 0);
+                result.syncFD = FD >= 0 ? std::optional<int>{FD} : std::nullopt;
+            }
+
+            // the blit thread signals the eventfd once the job returned
+            std::lock_guard<std::mutex> lk(blitThread.mutex);
+            blitThread.done.emplace_back(ID, result);
+        },
+        false);
+}
+
+std::optional<CDRMRenderer::SBlitTargets> CDRMRenderer::existingBlitTargets(SP<IBuffer> from, SP<IBuffer> to) {
+    const auto FROM = from->attachments.get<CDRMRendererBufferAttachment>();
+    const auto TO   = to->attachments.get<CDRMRendererBufferAttachment>();
+    if (!FROM || !FROM->tex.image || !TO || !TO->eglImage)
+        return std::nullopt;
+
+    const auto TO_DMA = to->dmabuf();
+    if (!verifyDestinationDMABUF(TO_DMA))
+        return std::nullopt;
+
+    return SBlitTargets{.fromTex = FROM->tex, .fbo = TO->fbo, .rbo = TO->rbo, .size = TO_DMA.size, .fromSize = from->dmabuf().size};
+}
+
+std::optional<CDRMRenderer::SBlitTargets> CDRMRenderer::prepareBlit(SP<IBuffer> from, SP<IBuffer> to) {
     // firstly, get a texture from the from buffer
     // if it has an attachment, use that
     // both from and to have the same AQ_ATTACHMENT_DRM_RENDERER_DATA.
@@ -627,19 +877,16 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, i
 
     SGLTex fromTex;
     {
-        auto attachment = from->attachments.get(AQ_ATTACHMENT_DRM_RENDERER_DATA);
-        if (attachment) {
+        if (auto att = from->attachments.get<CDRMRendererBufferAttachment>(); att) {
             TRACE(backend->log(AQ_LOG_TRACE, "EGL (blit): From attachment found"));
-            auto att = (CDRMRendererBufferAttachment*)attachment.get();
-            fromTex  = att->tex;
+            fromTex = att->tex;
         }
 
         if (!fromTex.image) {
             backend->log(AQ_LOG_DEBUG, "EGL (blit): No attachment in from, creating a new image");
             fromTex = glTex(from);
 
-            // should never remove anything, but JIC. We'll leak an EGLImage if this removes anything.
-            from->attachments.removeByType(AQ_ATTACHMENT_DRM_RENDERER_DATA);
+            // should never replace anything, but JIC. We'll leak an EGLImage if this replaces anything.
             from->attachments.add(makeShared<CDRMRendererBufferAttachment>(self, from, nullptr, 0, 0, fromTex));
         }
     }
@@ -657,14 +904,12 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, i
 
     if (!verifyDestinationDMABUF(toDma)) {
         backend->log(AQ_LOG_ERROR, "EGL (blit): failed to blit: destination dmabuf unsupported");
-        return {};
+        return std::nullopt;
     }
 
     {
-        auto attachment = to->attachments.get(AQ_ATTACHMENT_DRM_RENDERER_DATA);
-        if (attachment) {
+        if (auto att = to->attachments.get<CDRMRendererBufferAttachment>(); att) {
             TRACE(backend->log(AQ_LOG_TRACE, "EGL (blit): To attachment found"));
-            auto att = (CDRMRendererBufferAttachment*)attachment.get();
             rboImage = att->eglImage;
             fboID    = att->fbo;
             rboID    = att->rbo;
@@ -676,7 +921,7 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, i
             rboImage = createEGLImage(toDma);
             if (rboImage == EGL_NO_IMAGE_KHR) {
                 backend->log(AQ_LOG_ERROR, std::format("EGL (blit): createEGLImage failed: {}", eglGetError()));
-                return {};
+                return std::nullopt;
             }
 
             GLCALL(glGenRenderbuffers(1, &rboID));
@@ -690,29 +935,90 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, i
 
             if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
                 backend->log(AQ_LOG_ERROR, std::format("EGL (blit): glCheckFramebufferStatus failed: {}", glGetError()));
-                return {};
+                return std::nullopt;
             }
 
-            // should never remove anything, but JIC. We'll leak an RBO and FBO if this removes anything.
-            to->attachments.removeByType(AQ_ATTACHMENT_DRM_RENDERER_DATA);
+            // should never replace anything, but JIC. We'll leak an RBO and FBO if this replaces anything.
             to->attachments.add(makeShared<CDRMRendererBufferAttachment>(self, to, rboImage, fboID, rboID, SGLTex{}));
         }
     }
 
     glFlush();
 
-    TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (blit): rboImage 0x{:x}", (uintptr_t)rboImage)));
+    return SBlitTargets{.fromTex = fromTex, .fbo = fboID, .rbo = rboID, .size = toDma.size, .fromSize = from->dmabuf().size};
+}
 
-    GLCALL(glBindRenderbuffer(GL_RENDERBUFFER, rboID));
-    GLCALL(glBindFramebuffer(GL_FRAMEBUFFER, fboID));
+std::optional<uint64_t> CDRMRenderer::pollTimerQuery() {
+    if (!timerQuery.pending)
+        return std::nullopt;
 
-    TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (blit): fbo {} rbo {}", fboID, rboID)));
+    GLuint available = GL_FALSE;
+    timerQuery.glGetQueryObjectuivEXT(timerQuery.query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available)
+        return std::nullopt;
 
-    glClearColor(0.77F, 0.F, 0.74F, 1.F);
-    glClear(GL_COLOR_BUFFER_BIT);
+    timerQuery.pending = false;
+
+    GLuint64 elapsed = 0;
+    timerQuery.glGetQueryObjectui64vEXT(timerQuery.query, GL_QUERY_RESULT_EXT, &elapsed);
+
+    // the result is garbage if the gpu was reset or changed clocks meanwhile
+    GLint disjoint = GL_FALSE;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint)
+        return std::nullopt;
+
+    return elapsed;
+}
+
+CRegion CDRMRenderer::scaleDamage(const CRegion& damage, const Vector2D& fromSize, const Vector2D& toSize) {
+    if (fromSize == toSize)
+        return damage.copy();
+
+    // a source pixel covers a fraction of a target one, and linear filtering reaches a pixel further
+    const auto SCALE = toSize / fromSize;
+    CRegion    result;
+    for (auto const& r : damage.copy().getRects()) {
+        const double X1 = std::floor((r.x1 - 1) * SCALE.x), Y1 = std::floor((r.y1 - 1) * SCALE.y);
+        const double X2 = std::ceil((r.x2 + 1) * SCALE.x), Y2 = std::ceil((r.y2 + 1) * SCALE.y);
+        result.add(CBox{X1, Y1, X2 - X1, Y2 - Y1});
+    }
+
+    return result;
+}
+
+CDRMRenderer::SBlitResult CDRMRenderer::blitTargets(const SBlitTargets& targets, int waitFD, const CRegion& damage) {
+    const auto BEGIN = std::chrono::steady_clock::now();
+
+    AQ_TRACE_SCOPE("aq blit gpu {}{}{}", drmFD, damage.empty() ? " full" : "", waitFD >= 0 ? " fenced" : "");
+
+    if (waitFD >= 0) {
+        // wait on a provided explicit fence
+        waitOnSync(waitFD);
+    }
+
+    const auto& fromTex = targets.fromTex;
+    const auto  SIZE    = targets.size;
+    const bool  SCALED  = targets.fromSize != SIZE;
+
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (blit): fbo {} rbo {}", targets.fbo, targets.rbo)));
+
+    GLCALL(glBindRenderbuffer(GL_RENDERBUFFER, targets.rbo));
+    GLCALL(glBindFramebuffer(GL_FRAMEBUFFER, targets.fbo));
 
     // done, let's render the texture to the rbo
-    CBox renderBox = {{}, toDma.size};
+    CBox renderBox = {{}, SIZE};
+
+    // the rbo keeps its contents, so only the damaged rects have to be copied.
+    // GL's origin is the first row of the dmabuf, same as the damage, so the rects map directly.
+    std::vector<pixman_box32_t> rects;
+    if (!damage.empty())
+        rects = scaleDamage(damage, targets.fromSize, SIZE).intersect(renderBox).getRects();
+
+    if (rects.empty()) {
+        glClearColor(0.77F, 0.F, 0.74F, 1.F);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
 
     TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (blit): box size {}", renderBox.size())));
 
@@ -724,28 +1030,28 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, i
     auto& SHADER = fromTex.target == GL_TEXTURE_2D ? gl.shader : gl.shaderExt;
 
     // KMS uses flipped y, we have to do FLIPPED_180
-    matrixTranslate(base, toDma.size.x / 2.0, toDma.size.y / 2.0);
+    matrixTranslate(base, SIZE.x / 2.0, SIZE.y / 2.0);
     matrixTransform(base, HYPRUTILS_TRANSFORM_FLIPPED_180);
-    matrixTranslate(base, -toDma.size.x / 2.0, -toDma.size.y / 2.0);
+    matrixTranslate(base, -SIZE.x / 2.0, -SIZE.y / 2.0);
 
     projectBox(mtx, renderBox, HYPRUTILS_TRANSFORM_FLIPPED_180, 0, base);
 
-    matrixProjection(monitorProj, toDma.size.x, toDma.size.y, HYPRUTILS_TRANSFORM_FLIPPED_180);
+    matrixProjection(monitorProj, SIZE.x, SIZE.y, HYPRUTILS_TRANSFORM_FLIPPED_180);
 
     float glMtx[9];
     matrixMultiply(glMtx, monitorProj, mtx);
 
-    GLCALL(glViewport(0, 0, toDma.size.x, toDma.size.y));
+    GLCALL(glViewport(0, 0, SIZE.x, SIZE.y));
 
     GLCALL(glActiveTexture(GL_TEXTURE0));
     GLCALL(glBindTexture(fromTex.target, fromTex.texid));
 
-    GLCALL(glTexParameteri(fromTex.target, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-    GLCALL(glTexParameteri(fromTex.target, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    // the quad covers the target and samples all of the source, so a size mismatch is a scale
+    GLCALL(glTexParameteri(fromTex.target, GL_TEXTURE_MAG_FILTER, SCALED ? GL_LINEAR : GL_NEAREST));
+    GLCALL(glTexParameteri(fromTex.target, GL_TEXTURE_MIN_FILTER, SCALED ? GL_LINEAR : GL_NEAREST));
 
     GLCALL(glUseProgram(SHADER.program));
     GLCALL(glDisable(GL_BLEND));
-    GLCALL(glDisable(GL_SCISSOR_TEST));
 
     matrixTranspose(glMtx, glMtx);
     GLCALL(glUniformMatrix3fv(SHADER.proj, 1, GL_FALSE, glMtx));
@@ -758,7 +1064,29 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, i
     GLCALL(glEnableVertexAttribArray(SHADER.posAttrib));
     GLCALL(glEnableVertexAttribArray(SHADER.texAttrib));
 
-    GLCALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+    const auto GPUNS = pollTimerQuery();
+    const bool TIMED = timerQuery.supported && !timerQuery.pending;
+    if (TIMED)
+        timerQuery.glBeginQueryEXT(GL_TIME_ELAPSED_EXT, timerQuery.query);
+
+    if (rects.empty()) {
+        GLCALL(glDisable(GL_SCISSOR_TEST));
+        GLCALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+    } else {
+        TRACE(backend->log(AQ_LOG_TRACE, std::format("EGL (blit): partial blit of {} rects", rects.size())));
+
+        GLCALL(glEnable(GL_SCISSOR_TEST));
+        for (auto const& r : rects) {
+            GLCALL(glScissor(r.x1, r.y1, r.x2 - r.x1, r.y2 - r.y1));
+            GLCALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+        }
+        GLCALL(glDisable(GL_SCISSOR_TEST));
+    }
+
+    if (TIMED) {
+        timerQuery.glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+        timerQuery.pending = true;
+    }
 
     GLCALL(glDisableVertexAttribArray(SHADER.posAttrib));
     GLCALL(glDisableVertexAttribArray(SHADER.texAttrib));
@@ -776,12 +1104,24 @@ CDRMRenderer::SBlitResult CDRMRenderer::blit(SP<IBuffer> from, SP<IBuffer> to, i
     GLCALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
     GLCALL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
 
-    restoreEGL();
+    // timer queries finish a few blits later, this is the gpu time of whichever one just did
+    if (GPUNS.has_value())
+        AQ_TRACE_COUNTER((int64_t)*GPUNS, "aq blit gpu {} ns", drmFD);
 
-    return {true, explicitFD == -1 ? std::nullopt : std::optional<int>{explicitFD}};
+    return {
+        .success = true,
+        .syncFD  = explicitFD == -1 ? std::nullopt : std::optional<int>{explicitFD},
+        .cpuNs   = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - BEGIN).count(),
+        .gpuNs   = GPUNS,
+    };
 }
 
 void CDRMRenderer::onBufferAttachmentDrop(CDRMRendererBufferAttachment* attachment) {
+    if (needsBlitThread()) {
+        runOnBlitThread([&] { onBufferAttachmentDrop(attachment); }, true);
+        return;
+    }
+
     setEGL();
 
     TRACE(backend->log(AQ_LOG_TRACE,
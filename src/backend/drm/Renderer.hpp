@@ -2,6 +2,7 @@
 
 #include <aquamarine/backend/DRM.hpp>
 #include "FormatUtils.hpp"
+#include "Blitter.hpp"
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
@@ -10,6 +11,11 @@
 #include <optional>
 #include <tuple>
 #include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace Aquamarine {
 
@@ -29,9 +35,10 @@ namespace Aquamarine {
             ;
         }
         virtual eAttachmentType type() {
-            return AQ_ATTACHMENT_DRM_RENDERER_DATA;
+            return TYPE;
         }
 
+        static constexpr eAttachmentType              TYPE     = AQ_ATTACHMENT_DRM_RENDERER_DATA;
         EGLImageKHR                                   eglImage = nullptr;
         GLuint                                        fbo = 0, rbo = 0;
         SGLTex                                        tex;
@@ -40,19 +47,34 @@ namespace Aquamarine {
         Hyprutils::Memory::CWeakPointer<CDRMRenderer> renderer;
     };
 
-    class CDRMRenderer {
+    class CDRMRenderer : public IDRMBlitter {
       public:
+        ~CDRMRenderer();
+
         static Hyprutils::Memory::CSharedPointer<CDRMRenderer> attempt(Hyprutils::Memory::CSharedPointer<CGBMAllocator> allocator_,
                                                                        Hyprutils::Memory::CSharedPointer<CBackend>      backend_);
 
         int                                                    drmFD = -1;
 
-        struct SBlitResult {
-            bool               success = false;
-            std::optional<int> syncFD;
-        };
+        using SBlitResult = SDRMBlitResult;
+
+        // scales and converts as needed. Only the destination's format and modifier have to be renderable
+        virtual bool        canBlit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to);
+        virtual SBlitResult blit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to, int waitFD = -1,
+                                 const Hyprutils::Math::CRegion& damage = {});
+        virtual std::string name();
+
+        // with a blit thread (see startBlitThread), queues the blit there and returns right away. onDone is called from dispatchAsyncBlits()
+        // on the main thread, and owns the returned syncFD. Without one, this blits synchronously.
+        void blitAsync(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to, int waitFD, const Hyprutils::Math::CRegion& damage,
+                       std::function<void(SBlitResult)> onDone);
+
+        // moves the context to a dedicated thread. Every GL call is made there from then on.
+        bool startBlitThread();
+        bool asyncBlits();
+        int  asyncBlitFD(); // readable when async blits are done, -1 without a blit thread
+        void dispatchAsyncBlits();
 
-        SBlitResult blit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to, int waitFD = -1);
         // can't be a SP<> because we call it from buf's ctor...
         void clearBuffer(IBuffer* buf);
 
@@ -101,6 +123,44 @@ namespace Aquamarine {
       private:
         CDRMRenderer() = default;
 
+        struct SBlitTargets {
+            SGLTex                    fromTex;
+            GLuint                    fbo = 0, rbo = 0;
+            Hyprutils::Math::Vector2D size, fromSize; // of the target and the source, they differ for a scaled blit
+        };
+
+        // touches the buffers, so async blits run it with the main thread waiting
+        std::optional<SBlitTargets> prepareBlit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to);
+
+        // prepareBlit() for buffers blitted before, which only reads their attachments and makes no GL calls. Safe on the main thread
+        std::optional<SBlitTargets> existingBlitTargets(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to);
+
+        // only touches GL objects, safe to run while the main thread goes on
+        SBlitResult blitTargets(const SBlitTargets& targets, int waitFD, const Hyprutils::Math::CRegion& damage);
+
+        // damage in the source's coordinates to the target's
+        static Hyprutils::Math::CRegion scaleDamage(const Hyprutils::Math::CRegion& damage, const Hyprutils::Math::Vector2D& fromSize,
+                                                    const Hyprutils::Math::Vector2D& toSize);
+
+        bool        onBlitThread();
+        bool        needsBlitThread();
+        void        runOnBlitThread(std::function<void()> job, bool wait);
+
+        struct {
+            std::thread                                   thread;
+            std::mutex                                    mutex;
+            std::condition_variable                       cv;
+            std::deque<std::function<void()>>             jobs;            // mutex
+            std::vector<std::pair<uint64_t, SBlitResult>> done;            // mutex
+            std::vector<std::pair<uint32_t, std::string>> logs;            // mutex, logged by jobs, flushed by dispatchAsyncBlits()
+            bool                                          exit    = false; // mutex
+            int                                           eventFD = -1;
+
+            // main thread only, these hold the buffers of the blits in flight
+            uint64_t                                                           nextID = 1;
+            std::vector<std::pair<uint64_t, std::function<void(SBlitResult)>>> pending;
+        } blitThread;
+
         EGLImageKHR                                           createEGLImage(const SDMABUFAttrs& attrs);
         std::optional<std::vector<std::pair<uint64_t, bool>>> getModsForFormat(EGLint format);
         bool                                                  initDRMFormats();
@@ -109,6 +169,20 @@ namespace Aquamarine {
         int                                                   recreateBlitSync();
         bool                                                  hasModifiers = false;
 
+        // GL_EXT_disjoint_timer_query. Only one blit is timed at a time, results are picked up by a later blit.
+        struct {
+            bool                            supported                = false;
+            bool                            pending                  = false;
+            GLuint                          query                    = 0;
+            PFNGLGENQUERIESEXTPROC          glGenQueriesEXT          = nullptr;
+            PFNGLBEGINQUERYEXTPROC          glBeginQueryEXT          = nullptr;
+            PFNGLENDQUERYEXTPROC            glEndQueryEXT            = nullptr;
+            PFNGLGETQUERYOBJECTUIVEXTPROC   glGetQueryObjectuivEXT   = nullptr;
+            PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT = nullptr;
+        } timerQuery;
+
+        std::optional<uint64_t>                               pollTimerQuery();
+
         Hyprutils::Memory::CWeakPointer<CBackend>             backend;
     };
 };
\ No newline at end of file
@@ -0,0 +1,564 @@
+#ifdef AQUAMARINE_VULKAN
+
+#include "VulkanBlitter.hpp"
+#include <aquamarine/backend/Backend.hpp>
+#include "FormatUtils.hpp"
+#include "Shared.hpp"
+#include "Tracepoints.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/dma-buf.h>
+#include <xf86drm.h>
+#include <drm_fourcc.h>
+
+using namespace Aquamarine;
+using namespace Hyprutils::Memory;
+using namespace Hyprutils::Math;
+#define SP CSharedPointer
+
+static const std::vector<const char*> DEVICE_EXTENSIONS = {
+    VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,       VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME, VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
+    VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME,    VK_EXT_QUEUE_FAMILY_FOREIGN_EXTENSION_NAME,    VK_EXT_PHYSICAL_DEVICE_DRM_EXTENSION_NAME,
+};
+
+// only copies, so anything with the same texel layout would do. These are the ones swapchains end up with
+static VkFormat vkFormatFor(uint32_t drmFormat) {
+    switch (drmFormat) {
+        case DRM_FORMAT_ARGB8888:
+        case DRM_FORMAT_XRGB8888: return VK_FORMAT_B8G8R8A8_UNORM;
+        case DRM_FORMAT_ABGR8888:
+        case DRM_FORMAT_XBGR8888: return VK_FORMAT_R8G8B8A8_UNORM;
+        case DRM_FORMAT_ARGB2101010:
+        case DRM_FORMAT_XRGB2101010: return VK_FORMAT_A2R10G10B10_UNORM_PACK32;
+        case DRM_FORMAT_ABGR2101010:
+        case DRM_FORMAT_XBGR2101010: return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+static bool hasExtensions(VkPhysicalDevice device, const std::vector<const char*>& wanted) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, extensions.data());
+
+    return std::all_of(wanted.begin(), wanted.end(), [&extensions](const char* name) {
+        return std::any_of(extensions.begin(), extensions.end(), [name](const auto& e) { return strcmp(e.extensionName, name) == 0; });
+    });
+}
+
+// the copy engine doesn't wait on implicit fences, and KMS doesn't know about our semaphores. Move them through the dma-buf by hand
+static int exportSyncFile(SP<IBuffer> buffer) {
+#ifdef DMA_BUF_IOCTL_EXPORT_SYNC_FILE
+    dma_buf_export_sync_file req = {.flags = DMA_BUF_SYNC_READ, .fd = -1};
+    if (drmIoctl(buffer->dmabuf().fds.at(0), DMA_BUF_IOCTL_EXPORT_SYNC_FILE, &req) == 0)
+        return req.fd;
+#endif
+    return -1;
+}
+
+static bool importSyncFile(SP<IBuffer> buffer, int fd) {
+#ifdef DMA_BUF_IOCTL_IMPORT_SYNC_FILE
+    dma_buf_import_sync_file req = {.flags = DMA_BUF_SYNC_WRITE, .fd = fd};
+    return drmIoctl(buffer->dmabuf().fds.at(0), DMA_BUF_IOCTL_IMPORT_SYNC_FILE, &req) == 0;
+#else
+    return false;
+#endif
+}
+
+Aquamarine::CDRMVulkanBlitAttachment::CDRMVulkanBlitAttachment(CWeakPointer<CDRMVulkanBlitter> blitter_, VkImage image_, VkDeviceMemory memory_) :
+    image(image_), memory(memory_), blitter(blitter_) {
+    blitter->attachments.emplace_back(this);
+}
+
+Aquamarine::CDRMVulkanBlitAttachment::~CDRMVulkanBlitAttachment() {
+    // a dead blitter already freed the image along with its device
+    if (blitter)
+        blitter->dropAttachment(this);
+}
+
+SP<CDRMVulkanBlitter> Aquamarine::CDRMVulkanBlitter::create(int drmFD, SP<CBackend> backend_) {
+    auto blitter     = SP<CDRMVulkanBlitter>(new CDRMVulkanBlitter());
+    blitter->self    = blitter;
+    blitter->backend = backend_;
+
+    if (!blitter->init(drmFD))
+        return nullptr;
+
+    return blitter;
+}
+
+bool Aquamarine::CDRMVulkanBlitter::init(int drmFD) {
+#if !defined(DMA_BUF_IOCTL_EXPORT_SYNC_FILE) || !defined(DMA_BUF_IOCTL_IMPORT_SYNC_FILE)
+    backend->log(AQ_LOG_DEBUG, "Vulkan: Built without the dma-buf sync file ioctls, not using the copy blitter");
+    return false;
+#endif
+
+    const VkApplicationInfo    APP  = {.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO, .pApplicationName = "aquamarine", .apiVersion = VK_API_VERSION_1_2};
+    const VkInstanceCreateInfo INFO = {.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO, .pApplicationInfo = &APP};
+
+    if (vkCreateInstance(&INFO, nullptr, &instance) != VK_SUCCESS) {
+        backend->log(AQ_LOG_DEBUG, "Vulkan: Couldn't create an instance, not using the copy blitter");
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(drmFD, &st) != 0)
+        return false;
+
+    uint32_t count = 0;
+    vkEnumeratePhysicalDevices(instance, &count, nullptr);
+    std::vector<VkPhysicalDevice> devices(count);
+    vkEnumeratePhysicalDevices(instance, &count, devices.data());
+
+    // the one behind drmFD, by its node's device number
+    for (auto const& d : devices) {
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(d, &props);
+        if (props.apiVersion < VK_API_VERSION_1_2 || !hasExtensions(d, DEVICE_EXTENSIONS))
+            continue;
+
+        VkPhysicalDeviceDrmPropertiesEXT drmProps = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DRM_PROPERTIES_EXT};
+        VkPhysicalDeviceProperties2      props2   = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &drmProps};
+        vkGetPhysicalDeviceProperties2(d, &props2);
+
+        if ((drmProps.hasPrimary && makedev(drmProps.primaryMajor, drmProps.primaryMinor) == st.st_rdev) ||
+            (drmProps.hasRender && makedev(drmProps.renderMajor, drmProps.renderMinor) == st.st_rdev)) {
+            physical = d;
+            backend->log(AQ_LOG_DEBUG, std::format("Vulkan: Using {} for the copy blitter", props.deviceName));
+            break;
+        }
+    }
+
+    if (!physical) {
+        backend->log(AQ_LOG_DEBUG, std::format("Vulkan: No usable device for drm fd {}, not using the copy blitter", drmFD));
+        return false;
+    }
+
+    vkGetPhysicalDeviceQueueFamilyProperties(physical, &count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical, &count, families.data());
+
+    // a transfer-only family is the copy engine. Without one the copy would run on the graphics queue anyway, GLES does that fine
+    auto family = std::find_if(families.begin(), families.end(), [](const auto& f) {
+        return (f.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(f.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && f.queueCount > 0;
+    });
+
+    if (family == families.end()) {
+        backend->log(AQ_LOG_DEBUG, "Vulkan: The device has no dedicated transfer queue, not using the copy blitter");
+        return false;
+    }
+
+    queueFamily = family - families.begin();
+    granularity = family->minImageTransferGranularity;
+
+    const float                   PRIORITY = 1.F;
+    const VkDeviceQueueCreateInfo QUEUE    = {.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, .queueFamilyIndex = queueFamily, .queueCount = 1, .pQueuePriorities = &PRIORITY};
+    const VkDeviceCreateInfo      DEVICE   = {
+        .sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .queueCreateInfoCount    = 1,
+        .pQueueCreateInfos       = &QUEUE,
+        .enabledExtensionCount   = (uint32_t)DEVICE_EXTENSIONS.size(),
+        .ppEnabledExtensionNames = DEVICE_EXTENSIONS.data(),
+    };
+
+    if (vkCreateDevice(physical, &DEVICE, nullptr, &device) != VK_SUCCESS) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: Couldn't create a device for the copy blitter");
+        return false;
+    }
+
+    vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+    const VkCommandPoolCreateInfo POOL = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, .queueFamilyIndex = queueFamily};
+    if (vkCreateCommandPool(device, &POOL, nullptr, &pool) != VK_SUCCESS) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: Couldn't create a command pool for the copy blitter");
+        return false;
+    }
+
+    vkGetMemoryFdPropertiesKHR = (PFN_vkGetMemoryFdPropertiesKHR)vkGetDeviceProcAddr(device, "vkGetMemoryFdPropertiesKHR");
+    vkImportSemaphoreFdKHR     = (PFN_vkImportSemaphoreFdKHR)vkGetDeviceProcAddr(device, "vkImportSemaphoreFdKHR");
+    vkGetSemaphoreFdKHR        = (PFN_vkGetSemaphoreFdKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreFdKHR");
+
+    if (!vkGetMemoryFdPropertiesKHR || !vkImportSemaphoreFdKHR || !vkGetSemaphoreFdKHR) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: Missing extension entry points, not using the copy blitter");
+        return false;
+    }
+
+    backend->log(AQ_LOG_DEBUG, std::format("Vulkan: Copy blitter ready on queue family {}, granularity {}x{}", queueFamily, granularity.width, granularity.height));
+
+    return true;
+}
+
+Aquamarine::CDRMVulkanBlitter::~CDRMVulkanBlitter() {
+    if (device) {
+        collect(true);
+
+        for (auto const& a : attachments) {
+            vkDestroyImage(device, a->image, nullptr);
+            vkFreeMemory(device, a->memory, nullptr);
+            a->image  = VK_NULL_HANDLE;
+            a->memory = VK_NULL_HANDLE;
+        }
+
+        if (pool)
+            vkDestroyCommandPool(device, pool, nullptr);
+
+        vkDestroyDevice(device, nullptr);
+    }
+
+    if (instance)
+        vkDestroyInstance(instance, nullptr);
+
+    if (lastSyncFD >= 0)
+        close(lastSyncFD);
+}
+
+std::string Aquamarine::CDRMVulkanBlitter::name() {
+    return "Vulkan";
+}
+
+bool Aquamarine::CDRMVulkanBlitter::supports(uint32_t drmFormat, uint64_t modifier) {
+    if (auto it = std::find_if(formats.begin(), formats.end(), [&](const auto& e) { return e.format == drmFormat && e.modifier == modifier; }); it != formats.end())
+        return it->ok;
+
+    const VkFormat FORMAT = vkFormatFor(drmFormat);
+    bool           ok     = false;
+
+    if (FORMAT != VK_FORMAT_UNDEFINED && modifier != DRM_FORMAT_MOD_INVALID) {
+        VkPhysicalDeviceImageDrmFormatModifierInfoEXT modInfo = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_DRM_FORMAT_MODIFIER_INFO_EXT, .drmFormatModifier = modifier, .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+        VkPhysicalDeviceExternalImageFormatInfo extInfo = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO, .pNext = &modInfo, .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT};
+        VkPhysicalDeviceImageFormatInfo2 info = {
+            .sType  = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+            .pNext  = &extInfo,
+            .format = FORMAT,
+            .type   = VK_IMAGE_TYPE_2D,
+            .tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT,
+            .usage  = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        };
+        VkExternalImageFormatProperties extProps = {.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES};
+        VkImageFormatProperties2        props    = {.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2, .pNext = &extProps};
+
+        ok = vkGetPhysicalDeviceImageFormatProperties2(physical, &info, &props) == VK_SUCCESS &&
+            (extProps.externalMemoryProperties.externalMemoryFeatures & VK_EXTERNAL_MEMORY_FEATURE_IMPORTABLE_BIT);
+    }
+
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("Vulkan: {} with modifier 0x{:x} {} be copied", fourccToName(drmFormat), modifier, ok ? "can" : "can't")));
+
+    formats.emplace_back(SFormatSupport{.format = drmFormat, .modifier = modifier, .ok = ok});
+
+    return ok;
+}
+
+bool Aquamarine::CDRMVulkanBlitter::canBlit(SP<IBuffer> from, SP<IBuffer> to) {
+    if (!implicitSync || !from || !to || from->type() != BUFFER_TYPE_DMABUF || to->type() != BUFFER_TYPE_DMABUF)
+        return false;
+
+    const auto FROM = from->dmabuf();
+    const auto TO   = to->dmabuf();
+
+    // disjoint planes (e.g. compression metadata) would need one memory import each, leave those to GLES
+    return FROM.success && TO.success && FROM.size == TO.size && FROM.format == TO.format && FROM.planes == 1 && TO.planes == 1 && supports(FROM.format, FROM.modifier) &&
+        supports(TO.format, TO.modifier);
+}
+
+VkImage Aquamarine::CDRMVulkanBlitter::imageFor(SP<IBuffer> buffer) {
+    if (auto att = buffer->attachments.get<CDRMVulkanBlitAttachment>(); att && att->image && att->blitter.get() == this)
+        return att->image;
+
+    const auto ATTRS = buffer->dmabuf();
+
+    // one plane, canBlit() made sure
+    const VkExternalMemoryImageCreateInfo EXTERN = {.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO, .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT};
+    const VkSubresourceLayout             LAYOUT = {.offset = ATTRS.offsets.at(0), .rowPitch = ATTRS.strides.at(0)};
+    const VkImageDrmFormatModifierExplicitCreateInfoEXT MODIFIER = {
+        .sType                       = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT,
+        .pNext                       = &EXTERN,
+        .drmFormatModifier           = ATTRS.modifier,
+        .drmFormatModifierPlaneCount = 1,
+        .pPlaneLayouts               = &LAYOUT,
+    };
+    const VkImageCreateInfo INFO = {
+        .sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext         = &MODIFIER,
+        .imageType     = VK_IMAGE_TYPE_2D,
+        .format        = vkFormatFor(ATTRS.format),
+        .extent        = {(uint32_t)ATTRS.size.x, (uint32_t)ATTRS.size.y, 1},
+        .mipLevels     = 1,
+        .arrayLayers   = 1,
+        .samples       = VK_SAMPLE_COUNT_1_BIT,
+        .tiling        = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT,
+        .usage         = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    VkImage image = VK_NULL_HANDLE;
+    if (vkCreateImage(device, &INFO, nullptr, &image) != VK_SUCCESS) {
+        backend->log(AQ_LOG_ERROR, std::format("Vulkan: Couldn't create an image for a {} {} dmabuf", ATTRS.size, fourccToName(ATTRS.format)));
+        return VK_NULL_HANDLE;
+    }
+
+    // the import takes the fd
+    const int               FD      = fcntl(ATTRS.fds.at(0), F_DUPFD_CLOEXEC, 0);
+    VkMemoryFdPropertiesKHR fdProps = {.sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR};
+    VkMemoryRequirements    reqs;
+    vkGetImageMemoryRequirements(device, image, &reqs);
+
+    if (FD < 0 || vkGetMemoryFdPropertiesKHR(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT, FD, &fdProps) != VK_SUCCESS ||
+        !(reqs.memoryTypeBits & fdProps.memoryTypeBits)) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: No memory type to import a dmabuf into");
+        if (FD >= 0)
+            close(FD);
+        vkDestroyImage(device, image, nullptr);
+        return VK_NULL_HANDLE;
+    }
+
+    const VkImportMemoryFdInfoKHR       IMPORT    = {.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR, .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT, .fd = FD};
+    const VkMemoryDedicatedAllocateInfo DEDICATED = {.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO, .pNext = &IMPORT, .image = image};
+    const VkMemoryAllocateInfo          ALLOCATE  = {
+        .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext           = &DEDICATED,
+        .allocationSize  = reqs.size,
+        .memoryTypeIndex = (uint32_t)std::countr_zero(reqs.memoryTypeBits & fdProps.memoryTypeBits),
+    };
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (vkAllocateMemory(device, &ALLOCATE, nullptr, &memory) != VK_SUCCESS) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: Couldn't import a dmabuf");
+        close(FD);
+        vkDestroyImage(device, image, nullptr);
+        return VK_NULL_HANDLE;
+    }
+
+    if (vkBindImageMemory(device, image, memory, 0) != VK_SUCCESS) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: Couldn't bind an imported dmabuf");
+        vkFreeMemory(device, memory, nullptr);
+        vkDestroyImage(device, image, nullptr);
+        return VK_NULL_HANDLE;
+    }
+
+    TRACE(backend->log(AQ_LOG_TRACE, std::format("Vulkan: Imported a {} {} dmabuf with modifier 0x{:x}", ATTRS.size, fourccToName(ATTRS.format), ATTRS.modifier)));
+
+    buffer->attachments.add(makeShared<CDRMVulkanBlitAttachment>(self, image, memory));
+
+    return image;
+}
+
+SDRMBlitResult Aquamarine::CDRMVulkanBlitter::blit(SP<IBuffer> from, SP<IBuffer> to, int waitFD, const CRegion& damage) {
+    const auto BEGIN = std::chrono::steady_clock::now();
+
+    AQ_TRACE_SCOPE("aq blit copy{}{}", damage.empty() ? " full" : "", waitFD >= 0 ? " fenced" : "");
+
+    collect(false);
+
+    const auto SRC = imageFor(from);
+    const auto DST = imageFor(to);
+    if (!SRC || !DST)
+        return {};
+
+    // without an explicit fence, the source's writers are in its dma-buf
+    const int WAIT_FD = waitFD >= 0 ? fcntl(waitFD, F_DUPFD_CLOEXEC, 0) : exportSyncFile(from);
+    if (WAIT_FD < 0) {
+        if (waitFD < 0 && errno == ENOTTY) {
+            backend->log(AQ_LOG_DEBUG, "Vulkan: The kernel can't export dma-buf fences, not using the copy blitter");
+            implicitSync = false;
+        }
+        return {};
+    }
+
+    SSubmission                       sub;
+    const VkCommandBufferAllocateInfo CMD = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, .commandPool = pool, .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .commandBufferCount = 1};
+    const VkExportSemaphoreCreateInfo EXPORT     = {.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO, .handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT};
+    const VkSemaphoreCreateInfo       SEMAPHORE  = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    const VkSemaphoreCreateInfo       EXPORTABLE = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &EXPORT};
+    const VkFenceCreateInfo           FENCE      = {.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+
+    if (vkAllocateCommandBuffers(device, &CMD, &sub.cmd) != VK_SUCCESS || vkCreateSemaphore(device, &SEMAPHORE, nullptr, &sub.wait) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &EXPORTABLE, nullptr, &sub.signal) != VK_SUCCESS || vkCreateFence(device, &FENCE, nullptr, &sub.fence) != VK_SUCCESS) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: Couldn't create the objects for a blit");
+        close(WAIT_FD);
+        destroySubmission(sub);
+        return {};
+    }
+
+    // binary semaphores, timeline ones can't be moved as sync files
+    const VkImportSemaphoreFdInfoKHR IMPORT = {.sType      = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+        .semaphore  = sub.wait,
+        .flags      = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT,
+        .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+        .fd         = WAIT_FD};
+    if (vkImportSemaphoreFdKHR(device, &IMPORT) != VK_SUCCESS) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: Couldn't import the blit's wait fence");
+        close(WAIT_FD);
+        destroySubmission(sub);
+        return {};
+    }
+
+    const VkCommandBufferBeginInfo BEGIN_INFO = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+    vkBeginCommandBuffer(sub.cmd, &BEGIN_INFO);
+
+    // both are foreign dmabufs: take them over from whoever had them, and hand them back after. GENERAL keeps the destination's contents for partial copies
+    const VkImageSubresourceRange RANGE = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1};
+    const auto barrier = [&](VkImage image, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout, bool acquire) {
+        return VkImageMemoryBarrier{
+            .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask       = srcAccess,
+            .dstAccessMask       = dstAccess,
+            .oldLayout           = oldLayout,
+            .newLayout           = newLayout,
+            .srcQueueFamilyIndex = acquire ? VK_QUEUE_FAMILY_FOREIGN_EXT : queueFamily,
+            .dstQueueFamilyIndex = acquire ? queueFamily : VK_QUEUE_FAMILY_FOREIGN_EXT,
+            .image               = image,
+            .subresourceRange    = RANGE,
+        };
+    };
+
+    const VkImageMemoryBarrier ACQUIRE[2] = {
+        barrier(SRC, 0, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, true),
+        barrier(DST, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true),
+    };
+    const VkImageMemoryBarrier RELEASE[2] = {
+        barrier(SRC, VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, false),
+        barrier(DST, VK_ACCESS_TRANSFER_WRITE_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, false),
+    };
+
+    vkCmdPipelineBarrier(sub.cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, ACQUIRE);
+
+    // the damaged rects, grown to what the queue can copy. A 0 granularity only takes whole images
+    const auto                  SIZE = from->dmabuf().size;
+    std::vector<VkImageCopy>    regions;
+    std::vector<pixman_box32_t> rects;
+    if (!damage.empty() && granularity.width > 0 && granularity.height > 0)
+        rects = damage.copy().intersect(CBox{{}, SIZE}).getRects();
+
+    const auto addRegion = [&](int32_t x, int32_t y, uint32_t w, uint32_t h) {
+        regions.emplace_back(VkImageCopy{
+            .srcSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1},
+            .srcOffset      = {x, y, 0},
+            .dstSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1},
+            .dstOffset      = {x, y, 0},
+            .extent         = {w, h, 1},
+        });
+    };
+
+    for (auto const& r : rects) {
+        const int32_t GW = granularity.width, GH = granularity.height;
+        const int32_t X1 = r.x1 / GW * GW, Y1 = r.y1 / GH * GH;
+        const int32_t X2 = std::min<int32_t>((r.x2 + GW - 1) / GW * GW, SIZE.x), Y2 = std::min<int32_t>((r.y2 + GH - 1) / GH * GH, SIZE.y);
+        addRegion(X1, Y1, X2 - X1, Y2 - Y1);
+    }
+
+    if (regions.empty())
+        addRegion(0, 0, SIZE.x, SIZE.y);
+
+    vkCmdCopyImage(sub.cmd, SRC, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, DST, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions.size(), regions.data());
+
+    vkCmdPipelineBarrier(sub.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 2, RELEASE);
+
+    vkEndCommandBuffer(sub.cmd);
+
+    const VkPipelineStageFlags WAIT_STAGE = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    const VkSubmitInfo         SUBMIT     = {
+        .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount   = 1,
+        .pWaitSemaphores      = &sub.wait,
+        .pWaitDstStageMask    = &WAIT_STAGE,
+        .commandBufferCount   = 1,
+        .pCommandBuffers      = &sub.cmd,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores    = &sub.signal,
+    };
+
+    if (vkQueueSubmit(queue, 1, &SUBMIT, sub.fence) != VK_SUCCESS) {
+        backend->log(AQ_LOG_ERROR, "Vulkan: Failed to submit a blit");
+        destroySubmission(sub);
+        return {};
+    }
+
+    int                           syncFD = -1;
+    const VkSemaphoreGetFdInfoKHR GET_FD = {
+        .sType      = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+        .semaphore  = sub.signal,
+        .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+    };
+    if (vkGetSemaphoreFdKHR(device, &GET_FD, &syncFD) != VK_SUCCESS)
+        syncFD = -1;
+
+    // the commit may not pass our fence along, so put it where KMS looks for it too. Without it KMS could scan out a half done copy
+    if (syncFD < 0 || !importSyncFile(to, syncFD)) {
+        backend->log(AQ_LOG_ERROR, syncFD < 0 ? "Vulkan: Failed to export the blit's fence" : "Vulkan: Failed to attach the blit's fence to the destination dmabuf");
+
+        // the fallback blit writes to the same buffer, let this one finish first
+        vkWaitForFences(device, 1, &sub.fence, VK_TRUE, UINT64_MAX);
+        destroySubmission(sub);
+        if (syncFD >= 0)
+            close(syncFD);
+        return {};
+    }
+
+    sub.from = from;
+    sub.to   = to;
+    inFlight.emplace_back(std::move(sub));
+
+    if (lastSyncFD >= 0)
+        close(lastSyncFD);
+    lastSyncFD = syncFD;
+
+    return {
+        .success = true,
+        .syncFD  = syncFD,
+        .cpuNs   = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - BEGIN).count(),
+    };
+}
+
+void Aquamarine::CDRMVulkanBlitter::destroySubmission(SSubmission& submission) {
+    if (submission.fence)
+        vkDestroyFence(device, submission.fence, nullptr);
+    if (submission.wait)
+        vkDestroySemaphore(device, submission.wait, nullptr);
+    if (submission.signal)
+        vkDestroySemaphore(device, submission.signal, nullptr);
+    if (submission.cmd)
+        vkFreeCommandBuffers(device, pool, 1, &submission.cmd);
+
+    submission = SSubmission{};
+}
+
+void Aquamarine::CDRMVulkanBlitter::collect(bool wait) {
+    std::erase_if(inFlight, [this, wait](auto& s) {
+        if (wait)
+            vkWaitForFences(device, 1, &s.fence, VK_TRUE, UINT64_MAX);
+        else if (vkGetFenceStatus(device, s.fence) != VK_SUCCESS)
+            return false;
+
+        destroySubmission(s);
+        return true;
+    });
+}
+
+void Aquamarine::CDRMVulkanBlitter::dropAttachment(CDRMVulkanBlitAttachment* attachment) {
+    std::erase(attachments, attachment);
+
+    if (!attachment->image)
+        return;
+
+    // buffers go away on reconfigures, not per frame. Waiting for the copies is simpler than deferring the free
+    if (!inFlight.empty())
+        collect(true);
+
+    vkDestroyImage(device, attachment->image, nullptr);
+    vkFreeMemory(device, attachment->memory, nullptr);
+}
+
+#endif
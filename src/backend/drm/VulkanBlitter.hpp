@@ -0,0 +1,98 @@
+#pragma once
+
+#ifdef AQUAMARINE_VULKAN
+
+#include "Blitter.hpp"
+#include <aquamarine/misc/Attachment.hpp>
+#include <hyprutils/memory/WeakPtr.hpp>
+#include <vulkan/vulkan.h>
+#include <vector>
+
+namespace Aquamarine {
+    class CBackend;
+    class CDRMVulkanBlitter;
+
+    class CDRMVulkanBlitAttachment : public IAttachment {
+      public:
+        CDRMVulkanBlitAttachment(Hyprutils::Memory::CWeakPointer<CDRMVulkanBlitter> blitter_, VkImage image_, VkDeviceMemory memory_);
+        virtual ~CDRMVulkanBlitAttachment();
+        virtual eAttachmentType type() {
+            return TYPE;
+        }
+
+        static constexpr eAttachmentType                   TYPE   = AQ_ATTACHMENT_DRM_VULKAN_DATA;
+        VkImage                                            image  = VK_NULL_HANDLE;
+        VkDeviceMemory                                     memory = VK_NULL_HANDLE;
+
+        Hyprutils::Memory::CWeakPointer<CDRMVulkanBlitter> blitter;
+    };
+
+    /*
+        Copies same-size, same-format dmabufs on a dedicated transfer queue, leaving the gpu's graphics queue to clients.
+        Only used on gpus that have such a queue (most discrete ones, with a copy / DMA engine), everything else stays on GLES.
+        It doesn't scale or convert, CDRMBackend::blit() gives those to the renderer.
+    */
+    class CDRMVulkanBlitter : public IDRMBlitter {
+      public:
+        ~CDRMVulkanBlitter();
+
+        // nullptr if the gpu of drmFD has no dedicated transfer queue or lacks an extension we need
+        static Hyprutils::Memory::CSharedPointer<CDRMVulkanBlitter> create(int drmFD, Hyprutils::Memory::CSharedPointer<CBackend> backend_);
+
+        virtual bool                                                canBlit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to);
+        virtual SDRMBlitResult                                      blit(Hyprutils::Memory::CSharedPointer<IBuffer> from, Hyprutils::Memory::CSharedPointer<IBuffer> to,
+                                                                         int waitFD = -1, const Hyprutils::Math::CRegion& damage = {});
+        virtual std::string                                         name();
+
+        Hyprutils::Memory::CWeakPointer<CDRMVulkanBlitter>          self;
+
+      private:
+        CDRMVulkanBlitter() = default;
+
+        bool    init(int drmFD);
+        bool    supports(uint32_t drmFormat, uint64_t modifier);
+        VkImage imageFor(Hyprutils::Memory::CSharedPointer<IBuffer> buffer); // imports the dmabuf on first use
+        void    collect(bool wait);                                          // frees the submissions that are done
+        void    dropAttachment(CDRMVulkanBlitAttachment* attachment);
+
+        struct SSubmission {
+            VkCommandBuffer                            cmd    = VK_NULL_HANDLE;
+            VkFence                                    fence  = VK_NULL_HANDLE;
+            VkSemaphore                                wait   = VK_NULL_HANDLE;
+            VkSemaphore                                signal = VK_NULL_HANDLE;
+            Hyprutils::Memory::CSharedPointer<IBuffer> from, to; // kept until the copy is done
+        };
+
+        void destroySubmission(SSubmission& submission);
+
+        struct SFormatSupport {
+            uint32_t format   = 0;
+            uint64_t modifier = 0;
+            bool     ok       = false;
+        };
+
+        VkInstance                                instance    = VK_NULL_HANDLE;
+        VkPhysicalDevice                          physical    = VK_NULL_HANDLE;
+        VkDevice                                  device      = VK_NULL_HANDLE;
+        VkQueue                                   queue       = VK_NULL_HANDLE;
+        uint32_t                                  queueFamily = 0;
+        VkExtent3D                                granularity = {1, 1, 1}; // of copies on the queue
+        VkCommandPool                             pool        = VK_NULL_HANDLE;
+
+        PFN_vkGetMemoryFdPropertiesKHR            vkGetMemoryFdPropertiesKHR = nullptr;
+        PFN_vkImportSemaphoreFdKHR                vkImportSemaphoreFdKHR     = nullptr;
+        PFN_vkGetSemaphoreFdKHR                   vkGetSemaphoreFdKHR        = nullptr;
+
+        std::vector<SSubmission>                  inFlight;
+        std::vector<SFormatSupport>               formats;     // one entry per format / modifier asked about
+        std::vector<CDRMVulkanBlitAttachment*>    attachments; // freed with the device if their buffers outlive us
+        int                                       lastSyncFD   = -1;
+        bool                                      implicitSync = true; // the kernel can export / import dma-buf fences
+
+        Hyprutils::Memory::CWeakPointer<CBackend> backend;
+
+        friend class CDRMVulkanBlitAttachment;
+    };
+};
+
+#endif
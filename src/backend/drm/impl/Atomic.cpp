@@ -1,9 +1,12 @@
 #include <aquamarine/backend/drm/Atomic.hpp>
 #include <cstring>
+#include <algorithm>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <sys/mman.h>
 #include "Shared.hpp"
+#include "FormatUtils.hpp"
+#include "Tracepoints.hpp"
 #include "aquamarine/output/Output.hpp"
 
 using namespace Aquamarine;
@@ -55,26 +58,49 @@ void Aquamarine::CDRMAtomicRequest::planeProps(Hyprutils::Memory::CSharedPointer
         return;
     }
 
+    planeProps(plane, fb, crtc, CBox{{}, fb->buffer->size}, CBox{pos, fb->buffer->size});
+}
+
+void Aquamarine::CDRMAtomicRequest::planeProps(Hyprutils::Memory::CSharedPointer<SDRMPlane> plane, Hyprutils::Memory::CSharedPointer<CDRMFB> fb, uint32_t crtc,
+                                               const Hyprutils::Math::CBox& src, const Hyprutils::Math::CBox& dst) {
+    if (failed)
+        return;
+
+    if (!fb || !crtc) {
+        planeProps(plane, nullptr, 0, dst.pos());
+        return;
+    }
+
     TRACE(backend->log(AQ_LOG_TRACE,
                        std::format("atomic planeProps: prop blobs: src_x {}, src_y {}, src_w {}, src_h {}, crtc_w {}, crtc_h {}, fb_id {}, crtc_id {}, crtc_x {}, crtc_y {}",
                                    plane->props.src_x, plane->props.src_y, plane->props.src_w, plane->props.src_h, plane->props.crtc_w, plane->props.crtc_h, plane->props.fb_id,
                                    plane->props.crtc_id, plane->props.crtc_x, plane->props.crtc_y)));
 
     // src_ are 16.16 fixed point (lol)
-    add(plane->id, plane->props.src_x, 0);
-    add(plane->id, plane->props.src_y, 0);
-    add(plane->id, plane->props.src_w, ((uint64_t)fb->buffer->size.x) << 16);
-    add(plane->id, plane->props.src_h, ((uint64_t)fb->buffer->size.y) << 16);
-    add(plane->id, plane->props.crtc_w, (uint32_t)fb->buffer->size.x);
-    add(plane->id, plane->props.crtc_h, (uint32_t)fb->buffer->size.y);
+    add(plane->id, plane->props.src_x, ((uint64_t)src.x) << 16);
+    add(plane->id, plane->props.src_y, ((uint64_t)src.y) << 16);
+    add(plane->id, plane->props.src_w, ((uint64_t)src.w) << 16);
+    add(plane->id, plane->props.src_h, ((uint64_t)src.h) << 16);
+    add(plane->id, plane->props.crtc_w, (uint32_t)dst.w);
+    add(plane->id, plane->props.crtc_h, (uint32_t)dst.h);
     add(plane->id, plane->props.fb_id, fb->id);
     add(plane->id, plane->props.crtc_id, crtc);
-    add(plane->id, plane->props.crtc_x, (uint64_t)pos.x);
-    add(plane->id, plane->props.crtc_y, (uint64_t)pos.y);
+    add(plane->id, plane->props.crtc_x, (uint64_t)dst.x);
+    add(plane->id, plane->props.crtc_y, (uint64_t)dst.y);
+}
+
+void Aquamarine::CDRMAtomicRequest::primaryPlaneProps(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, Hyprutils::Memory::CSharedPointer<CDRMFB> fb,
+                                                      const COutputState::SInternalState& state) {
+    // a render size is scaled to the whole mode by the plane, drivers without a scaler fail the test
+    const auto& MODE = state.mode ? state.mode : state.customMode;
+    if (fb && state.renderSize.x > 0 && state.renderSize.y > 0 && MODE)
+        planeProps(connector->crtc->primary, fb, connector->crtc->id, CBox{{}, fb->buffer->size}, CBox{{}, MODE->pixelSize});
+    else
+        planeProps(connector->crtc->primary, fb, connector->crtc->id, {});
 }
 
 void Aquamarine::CDRMAtomicRequest::addConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
-    const auto& STATE  = connector->output->state->state();
+    const auto& STATE  = data.outputState(connector);
     const bool  enable = STATE.enabled && data.mainFB;
 
     TRACE(backend->log(AQ_LOG_TRACE,
@@ -115,10 +141,11 @@ void Aquamarine::CDRMAtomicRequest::addConnector(Hyprutils::Memory::CSharedPoint
         if (connector->crtc->props.vrr_enabled)
             add(connector->crtc->id, connector->crtc->props.vrr_enabled, (uint64_t)STATE.adaptiveSync);
 
-        planeProps(connector->crtc->primary, data.mainFB, connector->crtc->id, {});
+        primaryPlaneProps(connector, data.mainFB, STATE);
 
-        if (connector->output->supportsExplicit && STATE.explicitInFence >= 0)
-            add(connector->crtc->primary->id, connector->crtc->primary->props.in_fence_fd, STATE.explicitInFence);
+        const int IN_FENCE = data.explicitInFence.value_or(STATE.explicitInFence);
+        if (connector->output->supportsExplicit && IN_FENCE >= 0)
+            add(connector->crtc->primary->id, connector->crtc->primary->props.in_fence_fd, IN_FENCE);
 
         if (connector->crtc->primary->props.fb_damage_clips)
             add(connector->crtc->primary->id, connector->crtc->primary->props.fb_damage_clips, data.atomic.fbDamage);
@@ -130,15 +157,36 @@ void Aquamarine::CDRMAtomicRequest::addConnector(Hyprutils::Memory::CSharedPoint
                 planeProps(connector->crtc->cursor, data.cursorFB, connector->crtc->id, connector->output->cursorPos - connector->output->cursorHotspot);
         }
 
+        for (auto const& plane : connector->crtc->overlays) {
+            auto it = std::find_if(data.overlays.begin(), data.overlays.end(), [plane](const auto& e) { return e.plane == plane; });
+            if (it == data.overlays.end())
+                planeProps(plane, nullptr, 0, {});
+            else
+                planeProps(plane, it->fb, connector->crtc->id, it->src, it->dst);
+        }
+
     } else {
         planeProps(connector->crtc->primary, nullptr, 0, {});
         if (connector->crtc->cursor)
             planeProps(connector->crtc->cursor, nullptr, 0, {});
+        for (auto const& plane : connector->crtc->overlays) {
+            planeProps(plane, nullptr, 0, {});
+        }
     }
 
     conn = connector;
 }
 
+void Aquamarine::CDRMAtomicRequest::addCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, Hyprutils::Memory::CSharedPointer<CDRMFB> fb) {
+    if (!connector->output->cursorVisible)
+        planeProps(connector->crtc->cursor, nullptr, 0, {});
+    else
+        planeProps(connector->crtc->cursor, fb, connector->crtc->id, connector->output->cursorPos - connector->output->cursorHotspot);
+
+    conn       = connector;
+    cursorOnly = true;
+}
+
 bool Aquamarine::CDRMAtomicRequest::commit(uint32_t flagssss) {
     static auto flagsToStr = [](uint32_t flags) {
         std::string result;
@@ -162,10 +210,15 @@ bool Aquamarine::CDRMAtomicRequest::commit(uint32_t flagssss) {
         return false;
     }
 
-    if (!conn)
+    // the page-flip event needs a connector to go to, requests touching the whole device (reset, restore) don't ask for one
+    if (!conn && (flagssss & DRM_MODE_PAGE_FLIP_EVENT))
         return false;
 
-    if (auto ret = drmModeAtomicCommit(backend->gpu->fd, req, flagssss, &conn->pendingPageFlip); ret) {
+    AQ_TRACE_SCOPE("aq atomic commit conn {} {}", conn ? conn->id : 0, flagsToStr(flagssss));
+
+    void* pageFlip = conn ? (cursorOnly ? &conn->pendingCursorFlip : &conn->pendingPageFlip) : nullptr;
+
+    if (auto ret = drmModeAtomicCommit(backend->gpu->fd, req, flagssss, pageFlip); ret) {
         backend->log((flagssss & DRM_MODE_ATOMIC_TEST_ONLY) ? AQ_LOG_DEBUG : AQ_LOG_ERROR,
                      std::format("atomic drm request: failed to commit: {}, flags: {}", strerror(-ret), flagsToStr(flagssss)));
         return false;
@@ -183,42 +236,53 @@ void Aquamarine::CDRMAtomicRequest::destroyBlob(uint32_t id) {
 }
 
 void Aquamarine::CDRMAtomicRequest::commitBlob(uint32_t* current, uint32_t next) {
-    if (*current == next)
-        return;
-    destroyBlob(*current);
+    // next holds its own ref, even when it's the current blob
+    backend->blobRelease(*current);
     *current = next;
 }
 
 void Aquamarine::CDRMAtomicRequest::rollbackBlob(uint32_t* current, uint32_t next) {
-    if (*current == next)
-        return;
-    destroyBlob(next);
+    backend->blobRelease(next);
 }
 
-void Aquamarine::CDRMAtomicRequest::rollback(SDRMConnectorCommitData& data) {
-    if (!conn)
+void Aquamarine::CDRMAtomicRequest::rollback(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
+    if (!connector)
         return;
 
-    conn->crtc->atomic.ownModeID = true;
-    if (data.atomic.blobbed)
-        rollbackBlob(&conn->crtc->atomic.modeID, data.atomic.modeBlob);
-    rollbackBlob(&conn->crtc->atomic.gammaLut, data.atomic.gammaLut);
-    rollbackBlob(&conn->crtc->atomic.ctm, data.atomic.ctmBlob);
+    connector->crtc->atomic.ownModeID = true;
+    // taken in prepareConnector, whether or not the request got as far as adding it
+    if (data.atomic.modeTaken)
+        rollbackBlob(&connector->crtc->atomic.modeID, data.atomic.modeBlob);
+    rollbackBlob(&connector->crtc->atomic.gammaLut, data.atomic.gammaLut);
+    rollbackBlob(&connector->crtc->atomic.ctm, data.atomic.ctmBlob);
     destroyBlob(data.atomic.fbDamage);
+
+    // a retry prepares the same data again
+    data.atomic.modeTaken = data.atomic.blobbed = data.atomic.gammad = data.atomic.ctmd = false;
+    data.atomic.modeBlob = data.atomic.gammaLut = data.atomic.ctmBlob = data.atomic.fbDamage = 0;
 }
 
-void Aquamarine::CDRMAtomicRequest::apply(SDRMConnectorCommitData& data) {
-    if (!conn)
+void Aquamarine::CDRMAtomicRequest::apply(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
+    if (!connector)
         return;
 
-    if (!conn->crtc->atomic.ownModeID)
-        conn->crtc->atomic.modeID = 0;
+    if (!connector->crtc->atomic.ownModeID)
+        connector->crtc->atomic.modeID = 0;
 
-    conn->crtc->atomic.ownModeID = true;
+    connector->crtc->atomic.ownModeID = true;
     if (data.atomic.blobbed)
-        commitBlob(&conn->crtc->atomic.modeID, data.atomic.modeBlob);
-    commitBlob(&conn->crtc->atomic.gammaLut, data.atomic.gammaLut);
-    commitBlob(&conn->crtc->atomic.ctm, data.atomic.ctmBlob);
+        commitBlob(&connector->crtc->atomic.modeID, data.atomic.modeBlob);
+    // the kernel keeps the old blob when the commit didn't set one
+    if (data.atomic.gammad)
+        commitBlob(&connector->crtc->atomic.gammaLut, data.atomic.gammaLut);
+    if (data.atomic.ctmd)
+        commitBlob(&connector->crtc->atomic.ctm, data.atomic.ctmBlob);
+
+    if (!data.test && connector->output) {
+        const auto& STATE            = data.outputState(connector);
+        connector->output->vrrActive = connector->crtc->props.vrr_enabled && STATE.enabled && data.mainFB && STATE.adaptiveSync;
+    }
+
     destroyBlob(data.atomic.fbDamage);
 }
 
@@ -227,7 +291,7 @@ Aquamarine::CDRMAtomicImpl::CDRMAtomicImpl(Hyprutils::Memory::CSharedPointer<CDR
 }
 
 bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
-    const auto& STATE  = connector->output->state->state();
+    const auto& STATE  = data.outputState(connector);
     const bool  enable = STATE.enabled;
     const auto& MODE   = STATE.mode ? STATE.mode : STATE.customMode;
 
@@ -235,11 +299,14 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
         if (!enable)
             data.atomic.modeBlob = 0;
         else {
-            if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, (drmModeModeInfo*)&data.modeInfo, sizeof(drmModeModeInfo), &data.atomic.modeBlob)) {
+            data.atomic.modeBlob = connector->backend->blobGet(&data.modeInfo, sizeof(drmModeModeInfo));
+            if (!data.atomic.modeBlob) {
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a modeset blob");
                 return false;
             }
 
+            data.atomic.modeTaken = true;
+
             TRACE(connector->backend->log(AQ_LOG_TRACE,
                                           std::format("Connector blob id {}: clock {}, {}x{}, vrefresh {}, name: {}", data.atomic.modeBlob, data.modeInfo.clock,
                                                       data.modeInfo.hdisplay, data.modeInfo.vdisplay, data.modeInfo.vrefresh, data.modeInfo.name)));
@@ -263,10 +330,10 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
                 lut.at(i).reserved = 0;
             }
 
-            if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, lut.data(), lut.size() * sizeof(drm_color_lut), &data.atomic.gammaLut)) {
+            data.atomic.gammaLut = connector->backend->blobGet(lut.data(), lut.size() * sizeof(drm_color_lut));
+            if (!data.atomic.gammaLut)
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a gamma blob");
-                data.atomic.gammaLut = 0;
-            } else
+            else
                 data.atomic.gammad = true;
         }
     }
@@ -287,10 +354,10 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
                 ctm.matrix[i] = doubleToS3132Fixed(data.ctm->getMatrix()[i]);
             }
 
-            if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, &ctm, sizeof(drm_color_ctm), &data.atomic.ctmBlob)) {
+            data.atomic.ctmBlob = connector->backend->blobGet(&ctm, sizeof(drm_color_ctm));
+            if (!data.atomic.ctmBlob)
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a ctm blob");
-                data.atomic.ctmBlob = 0;
-            } else
+            else
                 data.atomic.ctmd = true;
         }
     }
@@ -299,9 +366,34 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
         if (STATE.damage.empty())
             data.atomic.fbDamage = 0;
         else {
-            TRACE(connector->backend->backend->log(AQ_LOG_TRACE, std::format("atomic drm: clipping damage to pixel size {}", MODE->pixelSize)));
-            std::vector<pixman_box32_t> rects = STATE.damage.copy().intersect(CBox{{}, MODE->pixelSize}).getRects();
-            if (drmModeCreatePropertyBlob(connector->backend->gpu->fd, rects.data(), sizeof(pixman_box32_t) * rects.size(), &data.atomic.fbDamage)) {
+            // damage is in buffer coordinates, which a render size makes smaller than the mode
+            const auto SIZE = STATE.renderSize.x > 0 && STATE.renderSize.y > 0 ? STATE.renderSize : MODE->pixelSize;
+
+            TRACE(connector->backend->backend->log(AQ_LOG_TRACE, std::format("atomic drm: clipping damage to pixel size {}", SIZE)));
+
+            // drivers merge long clip lists anyway, past a handful of rects the bounding box is just as good
+            constexpr size_t            MAX_DAMAGE_RECTS = 8;
+
+            const int32_t               W = (int32_t)SIZE.x, H = (int32_t)SIZE.y;
+            std::vector<pixman_box32_t> rects;
+            pixman_box32_t              extents = {W, H, 0, 0};
+
+            for (auto r : STATE.damage.getRects()) {
+                r.x1 = std::clamp(r.x1, 0, W);
+                r.y1 = std::clamp(r.y1, 0, H);
+                r.x2 = std::clamp(r.x2, 0, W);
+                r.y2 = std::clamp(r.y2, 0, H);
+                if (r.x1 >= r.x2 || r.y1 >= r.y2)
+                    continue;
+
+                extents = {std::min(extents.x1, r.x1), std::min(extents.y1, r.y1), std::max(extents.x2, r.x2), std::max(extents.y2, r.y2)};
+                rects.emplace_back(r);
+            }
+
+            if (rects.size() > MAX_DAMAGE_RECTS)
+                rects = {extents};
+
+            if (!rects.empty() && drmModeCreatePropertyBlob(connector->backend->gpu->fd, rects.data(), sizeof(pixman_box32_t) * rects.size(), &data.atomic.fbDamage)) {
                 connector->backend->backend->log(AQ_LOG_ERROR, "atomic drm: failed to create a damage blob");
                 return false;
             }
@@ -311,11 +403,91 @@ bool Aquamarine::CDRMAtomicImpl::prepareConnector(Hyprutils::Memory::CSharedPoin
     return true;
 }
 
+static bool planeSupports(SP<SDRMPlane> plane, const SDMABUFAttrs& attrs) {
+    return plane->formats.has(attrs.format, attrs.modifier);
+}
+
+bool Aquamarine::CDRMAtomicImpl::testOverlays(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
+    CDRMAtomicRequest request(backend);
+
+    request.addConnector(connector, data);
+
+    return request.commit(DRM_MODE_ATOMIC_TEST_ONLY | (data.modeset ? DRM_MODE_ATOMIC_ALLOW_MODESET : 0));
+}
+
+bool Aquamarine::CDRMAtomicImpl::assignOverlays(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
+    if (data.overlays.empty()) {
+        connector->atomic.overlayPlanes.clear();
+        return true;
+    }
+
+    const auto& OVERLAYS = connector->crtc->overlays;
+
+    // the previous assignment is almost always still valid, try it first
+    auto& LAST = connector->atomic.overlayPlanes;
+    if (LAST.size() == data.overlays.size()) {
+        bool usable = true;
+        for (size_t i = 0; i < LAST.size(); ++i) {
+            if (!LAST.at(i) || !planeSupports(LAST.at(i).lock(), data.overlays.at(i).fb->buffer->dmabuf())) {
+                usable = false;
+                break;
+            }
+
+            data.overlays.at(i).plane = LAST.at(i).lock();
+        }
+
+        if (usable && testOverlays(connector, data))
+            return true;
+
+        for (auto& o : data.overlays) {
+            o.plane.reset();
+        }
+    }
+
+    // greedy: give each layer, bottom to top, the first free plane that the kernel accepts it on
+    for (auto& o : data.overlays) {
+        const auto ATTRS = o.fb->buffer->dmabuf();
+
+        for (auto const& plane : OVERLAYS) {
+            if (std::find_if(data.overlays.begin(), data.overlays.end(), [plane](const auto& e) { return e.plane == plane; }) != data.overlays.end())
+                continue;
+
+            if (!planeSupports(plane, ATTRS))
+                continue;
+
+            o.plane = plane;
+
+            if (testOverlays(connector, data))
+                break;
+
+            o.plane.reset();
+        }
+
+        if (!o.plane) {
+            TRACE(connector->backend->log(AQ_LOG_TRACE, std::format("atomic drm: no overlay plane accepts a layer with format {}", fourccToName(ATTRS.format))));
+            LAST.clear();
+            return false;
+        }
+    }
+
+    LAST.clear();
+    for (auto const& o : data.overlays) {
+        LAST.emplace_back(o.plane);
+    }
+
+    return true;
+}
+
 bool Aquamarine::CDRMAtomicImpl::commit(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
-    if (!prepareConnector(connector, data))
+    CDRMAtomicRequest request(backend);
+
+    // it may have taken blobs before failing
+    if (!prepareConnector(connector, data)) {
+        request.rollback(connector, data);
         return false;
+    }
 
-    CDRMAtomicRequest request(backend);
+    const bool overlaysAssigned = assignOverlays(connector, data);
 
     request.addConnector(connector, data);
 
@@ -324,21 +496,85 @@ bool Aquamarine::CDRMAtomicImpl::commit(Hyprutils::Memory::CSharedPointer<SDRMCo
         flags |= DRM_MODE_ATOMIC_TEST_ONLY;
     if (data.modeset)
         flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
-    if (!data.blocking && !data.test)
+    // if a cursor-only commit is still in flight, a nonblocking commit would fail with EBUSY. Stall until it lands instead.
+    if (!data.blocking && !data.test && !connector->isCursorFlipPending)
         flags |= DRM_MODE_ATOMIC_NONBLOCK;
 
-    const bool ok = request.commit(flags);
+    const bool ok = overlaysAssigned && request.commit(flags);
 
     if (ok) {
-        request.apply(data);
-        if (!data.test && data.mainFB && connector->output->state->state().enabled && (flags & DRM_MODE_PAGE_FLIP_EVENT))
+        request.apply(connector, data);
+        if (!data.test && data.mainFB && data.outputState(connector).enabled && (flags & DRM_MODE_PAGE_FLIP_EVENT))
             connector->isPageFlipPending = true;
     } else
-        request.rollback(data);
+        request.rollback(connector, data);
 
     return ok;
 }
 
+bool Aquamarine::CDRMAtomicImpl::commitBatch(std::vector<SDRMBatchCommit>& batch) {
+    if (batch.empty())
+        return false;
+
+    size_t prepared = 0;
+    for (; prepared < batch.size(); ++prepared) {
+        if (!prepareConnector(batch.at(prepared).connector, *batch.at(prepared).data))
+            break;
+    }
+
+    bool ok = prepared == batch.size();
+
+    for (size_t i = 0; i < prepared && ok; ++i) {
+        ok = assignOverlays(batch.at(i).connector, *batch.at(i).data);
+    }
+
+    CDRMAtomicRequest request(backend);
+
+    // the flags have to work for every connector in the request
+    uint32_t flags    = 0;
+    bool     test     = true;
+    bool     blocking = false;
+
+    for (size_t i = 0; i < prepared && ok; ++i) {
+        const auto& b = batch.at(i);
+
+        request.addConnector(b.connector, *b.data);
+
+        flags |= b.data->flags;
+        if (b.data->modeset)
+            flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+
+        test     = test && b.data->test;
+        blocking = blocking || b.data->blocking || b.connector->isCursorFlipPending;
+    }
+
+    if (test)
+        flags |= DRM_MODE_ATOMIC_TEST_ONLY;
+    else if (!blocking)
+        flags |= DRM_MODE_ATOMIC_NONBLOCK;
+
+    ok = ok && request.commit(flags);
+
+    // the connector that failed to prepare, if any, may have taken blobs too
+    const size_t TOUCHED = std::min(prepared + 1, batch.size());
+    for (size_t i = 0; i < TOUCHED; ++i) {
+        if (ok)
+            request.apply(batch.at(i).connector, *batch.at(i).data);
+        else
+            request.rollback(batch.at(i).connector, *batch.at(i).data);
+    }
+
+    if (!ok || test)
+        return ok;
+
+    for (auto const& b : batch) {
+        if (b.data->mainFB && b.data->outputState(b.connector).enabled && (b.data->flags & DRM_MODE_PAGE_FLIP_EVENT))
+            b.connector->isPageFlipPending = true;
+    }
+
+    return true;
+}
+
 bool Aquamarine::CDRMAtomicImpl::reset() {
     CDRMAtomicRequest request(backend);
 
@@ -358,14 +594,123 @@ bool Aquamarine::CDRMAtomicImpl::reset() {
     return request.commit(DRM_MODE_ATOMIC_ALLOW_MODESET);
 }
 
+bool Aquamarine::CDRMAtomicImpl::restore() {
+    CDRMAtomicRequest     request(backend);
+    std::vector<uint32_t> usedCRTCs, usedPlanes;
+
+    for (auto const& conn : backend->connectors) {
+        if (!conn->output || !conn->crtc || !conn->committedCRTC) {
+            request.add(conn->id, conn->props.crtc_id, 0);
+            continue;
+        }
+
+        // the crtc went to another connector, or the fb / mode blob are gone
+        const auto FB = conn->crtc->primary->front;
+        if (conn->committedCRTC != conn->crtc->id || !FB || FB->dead || !conn->crtc->atomic.modeID)
+            return false;
+
+        // overlay positions aren't kept around, let the caller modeset and the next frame place them again
+        for (auto const& plane : conn->crtc->overlays) {
+            if (plane->front)
+                return false;
+        }
+
+        const auto& STATE = conn->output->state->state();
+
+        request.add(conn->id, conn->props.crtc_id, conn->crtc->id);
+        if (conn->props.link_status)
+            request.add(conn->id, conn->props.link_status, DRM_MODE_LINK_STATUS_GOOD);
+        if (conn->props.content_type)
+            request.add(conn->id, conn->props.content_type, DRM_MODE_CONTENT_TYPE_GRAPHICS);
+
+        request.add(conn->crtc->id, conn->crtc->props.mode_id, conn->crtc->atomic.modeID);
+        request.add(conn->crtc->id, conn->crtc->props.active, 1);
+        if (conn->crtc->props.gamma_lut)
+            request.add(conn->crtc->id, conn->crtc->props.gamma_lut, conn->crtc->atomic.gammaLut);
+        if (conn->crtc->props.ctm)
+            request.add(conn->crtc->id, conn->crtc->props.ctm, conn->crtc->atomic.ctm);
+        if (conn->crtc->props.vrr_enabled)
+            request.add(conn->crtc->id, conn->crtc->props.vrr_enabled, (uint64_t)STATE.adaptiveSync);
+
+        // same src / dst as the commit that put FB up
+        request.primaryPlaneProps(conn, FB, STATE);
+        usedPlanes.emplace_back(conn->crtc->primary->id);
+
+        if (conn->crtc->cursor && conn->output->cursorVisible && conn->crtc->cursor->front && !conn->crtc->cursor->front->dead) {
+            request.planeProps(conn->crtc->cursor, conn->crtc->cursor->front, conn->crtc->id, conn->output->cursorPos - conn->output->cursorHotspot);
+            usedPlanes.emplace_back(conn->crtc->cursor->id);
+        }
+
+        usedCRTCs.emplace_back(conn->crtc->id);
+    }
+
+    for (auto const& crtc : backend->crtcs) {
+        if (std::find(usedCRTCs.begin(), usedCRTCs.end(), crtc->id) != usedCRTCs.end())
+            continue;
+
+        request.add(crtc->id, crtc->props.mode_id, 0);
+        request.add(crtc->id, crtc->props.active, 0);
+    }
+
+    for (auto const& plane : backend->planes) {
+        if (std::find(usedPlanes.begin(), usedPlanes.end(), plane->id) != usedPlanes.end())
+            continue;
+
+        request.planeProps(plane, nullptr, 0, {});
+    }
+
+    if (!request.commit(DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_ATOMIC_TEST_ONLY))
+        return false;
+
+    return request.commit(DRM_MODE_ATOMIC_ALLOW_MODESET);
+}
+
 bool Aquamarine::CDRMAtomicImpl::moveCursor(SP<SDRMConnector> connector, bool skipSchedule) {
     if (!connector->output->cursorVisible || !connector->output->state->state().enabled || !connector->crtc || !connector->crtc->cursor)
         return true;
 
     if (!skipSchedule) {
         TRACE(connector->backend->log(AQ_LOG_TRACE, "atomic moveCursor"));
-        connector->output->scheduleFrame(IOutput::AQ_SCHEDULE_CURSOR_MOVE);
+        if (!commitCursor(connector))
+            connector->output->scheduleFrame(IOutput::AQ_SCHEDULE_CURSOR_MOVE);
     }
 
     return true;
 }
+
+bool Aquamarine::CDRMAtomicImpl::commitCursor(SP<SDRMConnector> connector) {
+    if (!connector->crtc || !connector->crtc->cursor || !connector->output->enabledState || !backend->sessionActive())
+        return false;
+
+    auto fb = connector->crtc->pendingCursor ? connector->crtc->pendingCursor : connector->crtc->cursor->front;
+    if (connector->output->cursorVisible && (!fb || fb->dead))
+        return false;
+
+    // the crtc is busy, the next page-flip will pick this up.
+    if (connector->isPageFlipPending || connector->isCursorFlipPending) {
+        connector->cursorCommitDeferred = true;
+        return true;
+    }
+
+    CDRMAtomicRequest request(backend);
+
+    request.addCursor(connector, fb);
+
+    if (!request.commit(DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT))
+        return false;
+
+    connector->isCursorFlipPending  = true;
+    connector->cursorCommitDeferred = false;
+
+    if (connector->output->cursorVisible && fb != connector->crtc->cursor->front) {
+        // keep the old fb around until the commit lands
+        connector->crtc->cursor->last  = connector->crtc->cursor->front;
+        connector->crtc->cursor->front = fb;
+        connector->crtc->cursor->back  = fb;
+        fb->buffer->lockedByBackend    = true;
+    }
+
+    connector->crtc->pendingCursor.reset();
+
+    return true;
+}
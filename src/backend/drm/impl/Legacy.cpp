@@ -14,18 +14,101 @@ Aquamarine::CDRMLegacyImpl::CDRMLegacyImpl(Hyprutils::Memory::CSharedPointer<CDR
     ;
 }
 
+bool Aquamarine::CDRMLegacyImpl::commitBatch(std::vector<SDRMBatchCommit>& batch) {
+    // legacy has no way to commit several crtcs at once
+    return false;
+}
+
 bool Aquamarine::CDRMLegacyImpl::moveCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, bool skipSchedule) {
     if (!connector->output->cursorVisible || !connector->output->state->state().enabled || !connector->crtc || !connector->crtc->cursor)
         return true;
 
-    if (!skipSchedule)
+    if (!skipSchedule && !commitCursor(connector))
         connector->output->scheduleFrame(IOutput::AQ_SCHEDULE_CURSOR_MOVE);
 
     return true;
 }
 
+bool Aquamarine::CDRMLegacyImpl::commitCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector) {
+    if (!connector->crtc || !connector->crtc->cursor || !connector->output->enabledState || !backend->sessionActive())
+        return false;
+
+    if (!connector->output->cursorVisible)
+        return hideCursor(connector);
+
+    // new shapes go through commitInternal
+    if (connector->crtc->pendingCursor)
+        return false;
+
+    // shown again with the same shape, put it back first
+    if (connector->crtc->legacy.cursorHidden) {
+        const auto& FB = connector->crtc->cursor->front;
+        return FB && !FB->dead && setCursorFB(connector, FB);
+    }
+
+    const Vector2D cursorPos = connector->output->cursorPos;
+
+    if (int ret = drmModeMoveCursor(connector->backend->gpu->fd, connector->crtc->id, (int)cursorPos.x, (int)cursorPos.y); ret) {
+        connector->backend->backend->log(AQ_LOG_ERROR, std::format("legacy drm: drmModeMoveCursor failed: {}", strerror(-ret)));
+        return false;
+    }
+
+    return true;
+}
+
+bool Aquamarine::CDRMLegacyImpl::setCursorFB(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, Hyprutils::Memory::CSharedPointer<CDRMFB> fb) {
+    uint32_t boHandle = 0;
+    auto     attrs    = fb->buffer->dmabuf();
+
+    if (int ret = drmPrimeFDToHandle(connector->backend->gpu->fd, attrs.fds.at(0), &boHandle); ret) {
+        connector->backend->backend->log(AQ_LOG_ERROR, std::format("legacy drm: drmPrimeFDToHandle failed: {}", strerror(-ret)));
+        return false;
+    }
+
+    connector->backend->backend->log(AQ_LOG_DEBUG,
+                                     std::format("legacy drm: cursor fb: {} with bo handle {} from fd {}, size {}", connector->backend->gpu->fd, boHandle, attrs.fds.at(0),
+                                                 fb->buffer->size));
+
+    Vector2D                cursorPos = connector->output->cursorPos;
+
+    struct drm_mode_cursor2 request = {
+        .flags   = DRM_MODE_CURSOR_BO | DRM_MODE_CURSOR_MOVE,
+        .crtc_id = connector->crtc->id,
+        .x       = (int32_t)cursorPos.x,
+        .y       = (int32_t)cursorPos.y,
+        .width   = (uint32_t)fb->buffer->size.x,
+        .height  = (uint32_t)fb->buffer->size.y,
+        .handle  = boHandle,
+        .hot_x   = (int32_t)connector->output->cursorHotspot.x,
+        .hot_y   = (int32_t)connector->output->cursorHotspot.y,
+    };
+
+    int ret = drmIoctl(connector->backend->gpu->fd, DRM_IOCTL_MODE_CURSOR2, &request);
+
+    if (boHandle && drmCloseBufferHandle(connector->backend->gpu->fd, boHandle))
+        connector->backend->backend->log(AQ_LOG_ERROR, "legacy drm: drmCloseBufferHandle in cursor failed");
+
+    if (ret) {
+        connector->backend->backend->log(AQ_LOG_ERROR, std::format("legacy drm: cursor drmIoctl failed: {}", strerror(errno)));
+        return false;
+    }
+
+    connector->crtc->legacy.cursorHidden = false;
+    return true;
+}
+
+bool Aquamarine::CDRMLegacyImpl::hideCursor(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector) {
+    if (drmModeSetCursor(connector->backend->gpu->fd, connector->crtc->id, 0, 0, 0)) {
+        connector->backend->backend->log(AQ_LOG_ERROR, "legacy drm: cursor null failed");
+        return false;
+    }
+
+    connector->crtc->legacy.cursorHidden = true;
+    return true;
+}
+
 bool Aquamarine::CDRMLegacyImpl::commitInternal(Hyprutils::Memory::CSharedPointer<SDRMConnector> connector, SDRMConnectorCommitData& data) {
-    const auto& STATE = connector->output->state->state();
+    const auto& STATE = data.outputState(connector);
     SP<CDRMFB>  mainFB;
     bool        enable = STATE.enabled;
 
@@ -86,43 +169,10 @@ bool Aquamarine::CDRMLegacyImpl::commitInternal(Hyprutils::Memory::CSharedPointe
     // TODO: gamma
 
     if (data.cursorFB && connector->crtc->cursor && connector->output->cursorVisible && enable) {
-        uint32_t boHandle = 0;
-        auto     attrs    = data.cursorFB->buffer->dmabuf();
-
-        if (int ret = drmPrimeFDToHandle(connector->backend->gpu->fd, attrs.fds.at(0), &boHandle); ret) {
-            connector->backend->backend->log(AQ_LOG_ERROR, std::format("legacy drm: drmPrimeFDToHandle failed: {}", strerror(-ret)));
+        if (!setCursorFB(connector, data.cursorFB))
             return false;
-        }
-
-        connector->backend->backend->log(AQ_LOG_DEBUG,
-                                         std::format("legacy drm: cursor fb: {} with bo handle {} from fd {}, size {}", connector->backend->gpu->fd, boHandle,
-                                                     data.cursorFB->buffer->dmabuf().fds.at(0), data.cursorFB->buffer->size));
-
-        Vector2D                cursorPos = connector->output->cursorPos;
-
-        struct drm_mode_cursor2 request = {
-            .flags   = DRM_MODE_CURSOR_BO | DRM_MODE_CURSOR_MOVE,
-            .crtc_id = connector->crtc->id,
-            .x       = (int32_t)cursorPos.x,
-            .y       = (int32_t)cursorPos.y,
-            .width   = (uint32_t)data.cursorFB->buffer->size.x,
-            .height  = (uint32_t)data.cursorFB->buffer->size.y,
-            .handle  = boHandle,
-            .hot_x   = (int32_t)connector->output->cursorHotspot.x,
-            .hot_y   = (int32_t)connector->output->cursorHotspot.y,
-        };
-
-        int ret = drmIoctl(connector->backend->gpu->fd, DRM_IOCTL_MODE_CURSOR2, &request);
-
-        if (boHandle && drmCloseBufferHandle(connector->backend->gpu->fd, boHandle))
-            connector->backend->backend->log(AQ_LOG_ERROR, "legacy drm: drmCloseBufferHandle in cursor failed");
-
-        if (ret) {
-            connector->backend->backend->log(AQ_LOG_ERROR, std::format("legacy drm: cursor drmIoctl failed: {}", strerror(errno)));
-            return false;
-        }
-    } else if (drmModeSetCursor(connector->backend->gpu->fd, connector->crtc->id, 0, 0, 0))
-        connector->backend->backend->log(AQ_LOG_ERROR, "legacy drm: cursor null failed");
+    } else
+        hideCursor(connector);
 
     if (!enable)
         return true;
@@ -151,6 +201,11 @@ bool Aquamarine::CDRMLegacyImpl::commit(Hyprutils::Memory::CSharedPointer<SDRMCo
     return commitInternal(connector, data);
 }
 
+bool Aquamarine::CDRMLegacyImpl::restore() {
+    // would be one drmModeSetCrtc per crtc anyway, same as a modeset
+    return false;
+}
+
 bool Aquamarine::CDRMLegacyImpl::reset() {
     bool ok = true;
     for (auto const& connector : backend->connectors) {
@@ -2,11 +2,19 @@
 
 #include <iostream>
 #include <format>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
 #include <signal.h>
 
 namespace Aquamarine {
     bool envEnabled(const std::string& env);
     bool isTrace();
+
+    // while set, CBackend::log() calls made on this thread are collected here instead of reaching the log function.
+    // Helper threads use it, the owner of the backend flushes the lines afterwards.
+    extern thread_local std::vector<std::pair<uint32_t, std::string>>* threadLogSink;
 };
 
 #define RASSERT(expr, reason, ...)                                                                                                                                                 \
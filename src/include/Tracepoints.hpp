@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <format>
+#include <string>
+
+/*
+    Structured trace events, written to ftrace's trace_marker in the atrace format. Perfetto and trace-cmd show them on the same timeline
+    as the kernel's drm tracepoints. Only built with -DAQUAMARINE_TRACEPOINTS, and only formatted while a trace_marker could be opened.
+*/
+
+namespace Aquamarine {
+    bool tracepointsEnabled();
+    void tracepointWrite(const std::string& event);
+    void tracepointBegin(const std::string& name);
+    void tracepointEnd();
+    void tracepointCounter(const std::string& name, int64_t value);
+    void tracepointAsyncBegin(const std::string& name, uint64_t cookie);
+    void tracepointAsyncEnd(const std::string& name, uint64_t cookie);
+
+    // a slice from construction to destruction, on the calling thread
+    class CTracepointScope {
+      public:
+        template <typename F>
+        CTracepointScope(F&& name) {
+            if (!tracepointsEnabled())
+                return;
+
+            active = true;
+            tracepointBegin(name());
+        }
+
+        ~CTracepointScope() {
+            if (active)
+                tracepointEnd();
+        }
+
+        CTracepointScope(const CTracepointScope&)            = delete;
+        CTracepointScope& operator=(const CTracepointScope&) = delete;
+
+      private:
+        bool active = false;
+    };
+};
+
+#ifdef AQUAMARINE_TRACEPOINTS
+
+#define AQ_TRACEPOINT_CONCAT_INNER(a, b) a##b
+#define AQ_TRACEPOINT_CONCAT(a, b)       AQ_TRACEPOINT_CONCAT_INNER(a, b)
+
+#define AQ_TRACE_SCOPE(fmt, ...)                                                                                                                                                   \
+    Aquamarine::CTracepointScope AQ_TRACEPOINT_CONCAT(aqTracepointScope, __LINE__)([&]() { return std::format(fmt, ##__VA_ARGS__); })
+
+#define AQ_TRACE_COUNTER(value, fmt, ...)                                                                                                                                          \
+    {                                                                                                                                                                              \
+        if (Aquamarine::tracepointsEnabled())                                                                                                                                      \
+            Aquamarine::tracepointCounter(std::format(fmt, ##__VA_ARGS__), value);                                                                                                 \
+    }
+
+#define AQ_TRACE_ASYNC_BEGIN(cookie, fmt, ...)                                                                                                                                     \
+    {                                                                                                                                                                              \
+        if (Aquamarine::tracepointsEnabled())                                                                                                                                      \
+            Aquamarine::tracepointAsyncBegin(std::format(fmt, ##__VA_ARGS__), cookie);                                                                                             \
+    }
+
+#define AQ_TRACE_ASYNC_END(cookie, fmt, ...)                                                                                                                                       \
+    {                                                                                                                                                                              \
+        if (Aquamarine::tracepointsEnabled())                                                                                                                                      \
+            Aquamarine::tracepointAsyncEnd(std::format(fmt, ##__VA_ARGS__), cookie);                                                                                               \
+    }
+
+#else
+
+#define AQ_TRACE_SCOPE(fmt, ...)
+#define AQ_TRACE_COUNTER(value, fmt, ...)      {}
+#define AQ_TRACE_ASYNC_BEGIN(cookie, fmt, ...) {}
+#define AQ_TRACE_ASYNC_END(cookie, fmt, ...)   {}
+
+#endif
@@ -1,37 +1,61 @@
 #include <aquamarine/misc/Attachment.hpp>
+#include <atomic>
 
 using namespace Aquamarine;
 using namespace Hyprutils::Memory;
 #define SP CSharedPointer
 
 bool Aquamarine::CAttachmentManager::has(eAttachmentType type) {
-    for (auto const& a : attachments) {
-        if (a->type() == type)
-            return true;
-    }
-    return false;
+    return rawGet(type);
 }
 
 SP<IAttachment> Aquamarine::CAttachmentManager::get(eAttachmentType type) {
-    for (auto const& a : attachments) {
-        if (a->type() == type)
-            return a;
-    }
-    return nullptr;
+    if (type >= attachments.size())
+        return nullptr;
+    return attachments[type];
+}
+
+IAttachment* Aquamarine::CAttachmentManager::rawGet(eAttachmentType type) {
+    if (type >= attachments.size())
+        return nullptr;
+    return attachments[type].get();
 }
 
 void Aquamarine::CAttachmentManager::add(SP<IAttachment> attachment) {
-    attachments.emplace_back(attachment);
+    if (!attachment)
+        return;
+
+    const auto TYPE = attachment->type();
+
+    if (TYPE >= attachments.size())
+        attachments.resize(TYPE + 1);
+
+    // the old one is destroyed after the slot is updated
+    auto old          = attachments[TYPE];
+    attachments[TYPE] = attachment;
 }
 
 void Aquamarine::CAttachmentManager::remove(SP<IAttachment> attachment) {
-    std::erase(attachments, attachment);
+    if (!attachment || get(attachment->type()) != attachment)
+        return;
+
+    removeByType(attachment->type());
 }
 
 void Aquamarine::CAttachmentManager::removeByType(eAttachmentType type) {
-    std::erase_if(attachments, [type](const auto& e) { return e->type() == type; });
+    if (type >= attachments.size())
+        return;
+
+    auto old = attachments[type];
+    attachments[type].reset();
 }
 
 void Aquamarine::CAttachmentManager::clear() {
+    auto old = std::move(attachments);
     attachments.clear();
 }
+
+eAttachmentType Aquamarine::CAttachmentManager::registerType() {
+    static std::atomic<uint32_t> next = AQ_ATTACHMENT_CUSTOM;
+    return (eAttachmentType)next++;
+}
@@ -1,7 +1,25 @@
 #include <aquamarine/output/Output.hpp>
+#include <aquamarine/allocator/Swapchain.hpp>
+#include <algorithm>
+#include <bit>
+#include <unistd.h>
 
 using namespace Aquamarine;
 
+Aquamarine::COutputCapture::COutputCapture(Hyprutils::Memory::CSharedPointer<IBuffer> buffer_) : buffer(buffer_) {
+    buffer->lock();
+}
+
+Aquamarine::COutputCapture::~COutputCapture() {
+    buffer->unlock();
+
+    if (scaled)
+        scaled->unlock();
+
+    if (scaledFence >= 0)
+        close(scaledFence);
+}
+
 Aquamarine::IOutput::~IOutput() {
     events.destroy.emit();
 }
@@ -39,10 +57,124 @@ size_t Aquamarine::IOutput::getGammaSize() {
     return 0;
 }
 
+size_t Aquamarine::IOutput::maxLayers() {
+    return 0;
+}
+
 bool Aquamarine::IOutput::destroy() {
     return false;
 }
 
+bool Aquamarine::IOutput::setFrameDeadline(bool enabled, uint64_t budgetNs) {
+    return false;
+}
+
+void Aquamarine::IOutput::reportRenderTime(uint64_t ns) {
+    ;
+}
+
+bool Aquamarine::IOutput::setThreadedCommits(bool enabled) {
+    return !enabled;
+}
+
+Hyprutils::Memory::CSharedPointer<COutputCapture> Aquamarine::IOutput::capture(const Hyprutils::Math::Vector2D& scaledSize) {
+    return nullptr;
+}
+
+int Aquamarine::IOutput::threadedEventFD() {
+    return -1;
+}
+
+void Aquamarine::IOutput::dispatchThreadedEvents() {
+    ;
+}
+
+void Aquamarine::IOutput::swapchainFeedback(bool late) {
+    if (!swapchain)
+        return;
+
+    const auto LENGTH = swapchain->currentOptions().length;
+    if (swapchain->onFrameFeedback(late))
+        stats.onSwapchainDepth(LENGTH, swapchain->currentOptions().length);
+}
+
+Aquamarine::SOutputStats Aquamarine::COutputStats::snapshot() const {
+    SOutputStats result = {
+        .commits           = commits.load(std::memory_order_relaxed),
+        .failedCommits     = failedCommits.load(std::memory_order_relaxed),
+        .failedTests       = failedTests.load(std::memory_order_relaxed),
+        .modesetRetries    = modesetRetries.load(std::memory_order_relaxed),
+        .presents          = presents.load(std::memory_order_relaxed),
+        .missedVblanks     = missedVblanks.load(std::memory_order_relaxed),
+        .blits             = blits.load(std::memory_order_relaxed),
+        .blitCPUNs         = blitCPUNs.load(std::memory_order_relaxed),
+        .blitGPUNs         = blitGPUNs.load(std::memory_order_relaxed),
+        .testCacheHits     = testCacheHits.load(std::memory_order_relaxed),
+        .testCacheMisses   = testCacheMisses.load(std::memory_order_relaxed),
+        .repeatedFrames    = repeatedFrames.load(std::memory_order_relaxed),
+        .cursorCacheHits   = cursorCacheHits.load(std::memory_order_relaxed),
+        .cursorCacheMisses = cursorCacheMisses.load(std::memory_order_relaxed),
+        .swapchainGrows    = swapchainGrows.load(std::memory_order_relaxed),
+        .swapchainShrinks  = swapchainShrinks.load(std::memory_order_relaxed),
+        .swapchainLength   = swapchainLength.load(std::memory_order_relaxed),
+    };
+
+    for (size_t i = 0; i < presentLatency.size(); ++i) {
+        result.presentLatency.at(i) = presentLatency.at(i).load(std::memory_order_relaxed);
+    }
+
+    return result;
+}
+
+void Aquamarine::COutputStats::onCommit(bool test, bool ok) {
+    if (test) {
+        if (!ok)
+            failedTests.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    commits.fetch_add(1, std::memory_order_relaxed);
+    if (!ok)
+        failedCommits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Aquamarine::COutputStats::onModesetRetry() {
+    modesetRetries.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Aquamarine::COutputStats::onPresent(uint64_t latencyNs, uint64_t missed) {
+    presents.fetch_add(1, std::memory_order_relaxed);
+    missedVblanks.fetch_add(missed, std::memory_order_relaxed);
+
+    // 0: under 1ms, 1: under 2ms, ... 6: under 64ms, 7: the rest
+    const size_t BUCKET = std::min<size_t>(std::bit_width(latencyNs / 1000000), presentLatency.size() - 1);
+    presentLatency.at(BUCKET).fetch_add(1, std::memory_order_relaxed);
+}
+
+void Aquamarine::COutputStats::onBlit(uint64_t cpuNs, std::optional<uint64_t> gpuNs) {
+    blits.fetch_add(1, std::memory_order_relaxed);
+    blitCPUNs.fetch_add(cpuNs, std::memory_order_relaxed);
+    if (gpuNs.has_value())
+        blitGPUNs.fetch_add(*gpuNs, std::memory_order_relaxed);
+}
+
+void Aquamarine::COutputStats::onTestCache(bool hit) {
+    (hit ? testCacheHits : testCacheMisses).fetch_add(1, std::memory_order_relaxed);
+}
+
+void Aquamarine::COutputStats::onRepeatedFrame() {
+    repeatedFrames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Aquamarine::COutputStats::onCursorCache(bool hit) {
+    (hit ? cursorCacheHits : cursorCacheMisses).fetch_add(1, std::memory_order_relaxed);
+}
+
+void Aquamarine::COutputStats::onSwapchainDepth(size_t oldLength, size_t newLength) {
+    (newLength > oldLength ? swapchainGrows : swapchainShrinks).fetch_add(1, std::memory_order_relaxed);
+    swapchainLength.store(newLength, std::memory_order_relaxed);
+}
+
 const Aquamarine::COutputState::SInternalState& Aquamarine::COutputState::state() {
     return internalState;
 }
@@ -112,6 +244,18 @@ void Aquamarine::COutputState::resetExplicitFences() {
     // fences are now used, let's reset them to not confuse ourselves later.
     internalState.explicitInFence  = -1;
     internalState.explicitOutFence = -1;
+    internalState.acquirePoint     = {};
+    internalState.releasePoint     = {};
+}
+
+void Aquamarine::COutputState::setAcquirePoint(int32_t timelineFD, uint64_t point) {
+    internalState.acquirePoint = {.timelineFD = timelineFD, .point = point};
+    internalState.committed |= AQ_OUTPUT_STATE_ACQUIRE_POINT;
+}
+
+void Aquamarine::COutputState::setReleasePoint(int32_t timelineFD, uint64_t point) {
+    internalState.releasePoint = {.timelineFD = timelineFD, .point = point};
+    internalState.committed |= AQ_OUTPUT_STATE_RELEASE_POINT;
 }
 
 void Aquamarine::COutputState::setCTM(const Hyprutils::Math::Mat3x3& ctm) {
@@ -119,6 +263,16 @@ void Aquamarine::COutputState::setCTM(const Hyprutils::Math::Mat3x3& ctm) {
     internalState.committed |= AQ_OUTPUT_STATE_CTM;
 }
 
+void Aquamarine::COutputState::setLayers(const std::vector<SOutputLayer>& layers) {
+    internalState.layers = layers;
+    internalState.committed |= AQ_OUTPUT_STATE_LAYERS;
+}
+
+void Aquamarine::COutputState::setRenderSize(const Hyprutils::Math::Vector2D& size) {
+    internalState.renderSize = size;
+    internalState.committed |= AQ_OUTPUT_STATE_RENDER_SIZE;
+}
+
 void Aquamarine::COutputState::onCommit() {
     internalState.committed = 0;
     internalState.damage.clear();
@@ -11,3 +11,5 @@ static bool trace = []() -> bool { return Aquamarine::envEnabled("AQ_TRACE"); }(
 bool        Aquamarine::isTrace() {
     return trace;
 }
+
+thread_local std::vector<std::pair<uint32_t, std::string>>* Aquamarine::threadLogSink = nullptr;
@@ -0,0 +1,48 @@
+#include "Tracepoints.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+
+static int markerFD = []() -> int {
+#ifdef AQUAMARINE_TRACEPOINTS
+    // tracefs moved out of debugfs, older setups only have the latter
+    for (const char* path : {"/sys/kernel/tracing/trace_marker", "/sys/kernel/debug/tracing/trace_marker"}) {
+        if (int fd = open(path, O_WRONLY | O_CLOEXEC); fd >= 0)
+            return fd;
+    }
+#endif
+    return -1;
+}();
+
+static const pid_t pid = getpid();
+
+bool Aquamarine::tracepointsEnabled() {
+    return markerFD >= 0;
+}
+
+void Aquamarine::tracepointWrite(const std::string& event) {
+    if (markerFD < 0)
+        return;
+
+    // one write is one event. There's nowhere to report a failed one, and losing it is harmless
+    [[maybe_unused]] const auto WRITTEN = write(markerFD, event.c_str(), event.size());
+}
+
+void Aquamarine::tracepointBegin(const std::string& name) {
+    tracepointWrite(std::format("B|{}|{}", pid, name));
+}
+
+void Aquamarine::tracepointEnd() {
+    tracepointWrite(std::format("E|{}", pid));
+}
+
+void Aquamarine::tracepointCounter(const std::string& name, int64_t value) {
+    tracepointWrite(std::format("C|{}|{}|{}", pid, name, value));
+}
+
+void Aquamarine::tracepointAsyncBegin(const std::string& name, uint64_t cookie) {
+    tracepointWrite(std::format("S|{}|{}|{}", pid, name, cookie));
+}
+
+void Aquamarine::tracepointAsyncEnd(const std::string& name, uint64_t cookie) {
+    tracepointWrite(std::format("F|{}|{}|{}", pid, name, cookie));
+}
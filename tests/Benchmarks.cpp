@@ -0,0 +1,663 @@
+#include <aquamarine/backend/Backend.hpp>
+#include <aquamarine/backend/DRM.hpp>
+#include <aquamarine/output/Output.hpp>
+#include <aquamarine/allocator/GBM.hpp>
+#include <aquamarine/allocator/DRMDumb.hpp>
+#include <aquamarine/allocator/Swapchain.hpp>
+#include <aquamarine/allocator/BufferPool.hpp>
+#include <aquamarine/misc/Attachment.hpp>
+#include <aquamarine/misc/Signal.hpp>
+#include <aquamarine/input/Input.hpp>
+#include "backend/drm/Renderer.hpp" // internal, for the mgpu blit
+#include <algorithm>
+#include <any>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/*
+    Microbenchmarks for the allocation and commit hot paths.
+
+    benchmarks [--json] [--drm] [--iterations N] [--filter STR] [--render-node PATH] [--card PATH] [--verbose]
+
+    By default this runs on the headless backend with a GBM allocator on --render-node, so it needs a gpu but no session.
+    --drm runs on the DRM backend instead (needs a session) and adds the KMS import and test-only commit benchmarks.
+    --json prints a single JSON object, for tracking results between releases.
+    A few results are checked along the way, e.g. that scaled blits and captures work. The run exits with 1 if one of them failed.
+*/
+
+using namespace Hyprutils::Memory;
+using namespace Hyprutils::Signal;
+using namespace Hyprutils::Math;
+#define SP CSharedPointer
+
+struct {
+    bool        json       = false;
+    bool        drm        = false;
+    bool        verbose    = false;
+    size_t      iterations = 1000;
+    std::string filter;
+    std::string renderNode = "/dev/dri/renderD128";
+    std::string card       = "/dev/dri/card0";
+} options;
+
+struct SResult {
+    std::string name;
+    size_t      iterations = 0;
+    double      minNs = 0, medianNs = 0, p99Ns = 0, meanNs = 0;
+};
+
+std::vector<SResult>                             results;
+std::vector<std::pair<std::string, std::string>> skipped, failed;
+
+static void aqLog(Aquamarine::eBackendLogLevel level, std::string msg) {
+    if (!options.verbose && level != Aquamarine::eBackendLogLevel::AQ_LOG_CRITICAL)
+        return;
+
+    std::cerr << "[AQ] " << msg << "\n";
+}
+
+static bool wanted(const std::string& name) {
+    return options.filter.empty() || name.contains(options.filter);
+}
+
+static void skip(const std::string& name, const std::string& reason) {
+    if (!wanted(name))
+        return;
+
+    skipped.emplace_back(name, reason);
+
+    if (!options.json)
+        std::cout << std::format("{:<40} skipped: {}\n", name, reason);
+}
+
+// for what is checked along the way, any failure fails the run
+static void fail(const std::string& name, const std::string& reason) {
+    failed.emplace_back(name, reason);
+
+    if (!options.json)
+        std::cout << std::format("{:<40} FAILED: {}\n", name, reason);
+}
+
+static void addResult(const std::string& name, std::vector<double>& samples) {
+    if (samples.empty()) {
+        skip(name, "no samples");
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for (auto const& s : samples) {
+        sum += s;
+    }
+
+    SResult result = {
+        .name       = name,
+        .iterations = samples.size(),
+        .minNs      = samples.front(),
+        .medianNs   = samples.at(samples.size() / 2),
+        .p99Ns      = samples.at(std::min(samples.size() - 1, samples.size() * 99 / 100)),
+        .meanNs     = sum / samples.size(),
+    };
+
+    if (!options.json)
+        std::cout << std::format("{:<40} {:>8} iters  min {:>12.0f}ns  median {:>12.0f}ns  p99 {:>12.0f}ns  mean {:>12.0f}ns\n", result.name, result.iterations, result.minNs,
+                                 result.medianNs, result.p99Ns, result.meanNs);
+
+    results.emplace_back(result);
+}
+
+// times fn, setup runs untimed before every iteration
+static void bench(const std::string& name, size_t iterations, const std::function<void()>& fn, const std::function<void()>& setup = {}) {
+    if (!wanted(name))
+        return;
+
+    const size_t WARMUP = std::min<size_t>(iterations / 10 + 1, 100);
+    for (size_t i = 0; i < WARMUP; ++i) {
+        if (setup)
+            setup();
+        fn();
+    }
+
+    std::vector<double> samples;
+    samples.reserve(iterations);
+
+    for (size_t i = 0; i < iterations; ++i) {
+        if (setup)
+            setup();
+
+        const auto BEGIN = std::chrono::steady_clock::now();
+        fn();
+        samples.emplace_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - BEGIN).count());
+    }
+
+    addResult(name, samples);
+}
+
+// false if nothing fired within timeoutMs
+static bool dispatchOnce(const std::vector<SP<Aquamarine::SPollFD>>& fds, int timeoutMs) {
+    std::vector<pollfd> pfds;
+    for (auto const& f : fds) {
+        pfds.emplace_back(pollfd{.fd = f->fd, .events = POLLIN, .revents = 0});
+    }
+
+    if (poll(pfds.data(), pfds.size(), timeoutMs) <= 0)
+        return false;
+
+    for (size_t i = 0; i < pfds.size(); ++i) {
+        if (pfds.at(i).revents & POLLIN)
+            fds.at(i)->onSignal();
+    }
+
+    return true;
+}
+
+class CBenchAttachment : public Aquamarine::IAttachment {
+  public:
+    virtual Aquamarine::eAttachmentType type() {
+        return TYPE;
+    }
+
+    static inline const Aquamarine::eAttachmentType TYPE = Aquamarine::CAttachmentManager::registerType();
+};
+
+static void benchAttachments() {
+    Aquamarine::CAttachmentManager manager;
+    manager.add(makeShared<CBenchAttachment>());
+
+    volatile bool sink = false;
+
+    bench("attachments/has", options.iterations * 100, [&] { sink = manager.has(CBenchAttachment::TYPE); });
+    bench("attachments/get<T>", options.iterations * 100, [&] { sink = manager.get<CBenchAttachment>() != nullptr; });
+    bench("attachments/get-miss", options.iterations * 100, [&] { sink = manager.has(Aquamarine::AQ_ATTACHMENT_DRM_RENDERER_DATA); });
+    bench("attachments/add-remove", options.iterations, [&] {
+        auto a = makeShared<CBenchAttachment>();
+        manager.add(a);
+        manager.remove(a);
+    });
+}
+
+static void benchSignals() {
+    using SMoveEvent = Aquamarine::IPointer::SMoveEvent;
+
+    Aquamarine::CTypedSignal<SMoveEvent> typed, untyped;
+    volatile double                      sink = 0;
+
+    auto                                 typedListener = typed.listen([&](const SMoveEvent& e) { sink = e.delta.x; });
+    auto                                 anyListener   = untyped.registerListener([&](std::any d) { sink = std::any_cast<SMoveEvent>(d).delta.x; });
+
+    const SMoveEvent                     EVENT = {.timeMs = 1, .delta = {1, 1}, .unaccel = {1, 1}};
+
+    bench("signals/emit-typed", options.iterations * 100, [&] { typed.emit(EVENT); });
+    bench("signals/emit-any", options.iterations * 100, [&] { untyped.emit(EVENT); });
+
+    // a CSignal-style listener on a signal that only had typed ones so far
+    bool gotAny       = false;
+    auto lateListener = typed.registerListener([&](std::any d) { gotAny = std::any_cast<SMoveEvent>(d).delta.x == EVENT.delta.x; });
+    typed.emit(EVENT);
+    if (!gotAny)
+        fail("signals/any-listener", "a registerListener() handler wasn't called");
+}
+
+static void benchFormats() {
+    // about what a modern primary plane reports
+    std::vector<Aquamarine::SDRMFormat> formats;
+    for (uint32_t f = 0; f < 64; ++f) {
+        auto& fmt = formats.emplace_back(Aquamarine::SDRMFormat{.drmFormat = DRM_FORMAT_XRGB8888 + f});
+        for (uint64_t m = 0; m < 16; ++m) {
+            fmt.modifiers.emplace_back(DRM_FORMAT_MOD_LINEAR + m);
+        }
+    }
+
+    const Aquamarine::CDRMFormatTable TABLE{formats};
+    const uint32_t                    LAST = formats.back().drmFormat;
+    volatile bool                     sink = false;
+
+    bench("formats/linear-lookup", options.iterations * 100, [&] {
+        auto it = std::find_if(formats.begin(), formats.end(), [LAST](const auto& e) { return e.drmFormat == LAST; });
+        sink    = it != formats.end() && std::find(it->modifiers.begin(), it->modifiers.end(), DRM_FORMAT_MOD_LINEAR + 15) != it->modifiers.end();
+    });
+    bench("formats/table-lookup", options.iterations * 100, [&] { sink = TABLE.has(LAST, DRM_FORMAT_MOD_LINEAR + 15); });
+    bench("formats/build", options.iterations, [&] { Aquamarine::CDRMFormatTable table{formats}; });
+    bench("formats/intersect", options.iterations, [&] { auto both = TABLE.intersect(TABLE); });
+}
+
+static void benchAllocator(const std::string& prefix, SP<Aquamarine::IAllocator> allocator, SP<Aquamarine::CSwapchain> swapchain, const Vector2D& size) {
+    const Aquamarine::SAllocatorBufferParams PARAMS = {.size = size, .format = DRM_FORMAT_INVALID};
+    const std::string                        NAME   = std::format("{}/acquire-free/{}x{}", prefix, (int)size.x, (int)size.y);
+
+    if (!allocator->acquire(PARAMS, swapchain)) {
+        skip(NAME, "allocation failed");
+        return;
+    }
+
+    // the pool would hand the same buffer back, measure the allocator itself
+    auto pool = allocator->getPool();
+    if (pool)
+        pool->setMaxBytes(0);
+
+    bench(NAME, options.iterations, [&] { auto buf = allocator->acquire(PARAMS, swapchain); });
+
+    if (!pool)
+        return;
+
+    pool->setMaxBytes(128 * 1024 * 1024);
+    pool->clear();
+
+    bench(std::format("{}/pooled-acquire/{}x{}", prefix, (int)size.x, (int)size.y), options.iterations, [&] {
+        auto buf = pool->acquire(PARAMS, swapchain);
+        pool->recycle(buf, PARAMS, swapchain);
+    });
+
+    pool->clear();
+}
+
+static void benchSwapchain(SP<Aquamarine::IAllocator> allocator, SP<Aquamarine::IBackendImplementation> impl) {
+    auto swapchain = Aquamarine::CSwapchain::create(allocator, impl);
+
+    if (!swapchain->reconfigure(Aquamarine::SSwapchainOptions{.length = 3, .size = {1920, 1080}})) {
+        skip("swapchain/next", "reconfigure failed");
+        return;
+    }
+
+    bench("swapchain/next", options.iterations * 10, [&] { auto buf = swapchain->next(nullptr); });
+
+    // one waiting in a mailbox (locked) and one being scanned out (the backend's), only the third may be drawn into
+    if (wanted("swapchain/next-skips-busy")) {
+        auto queued = swapchain->next(nullptr), flipping = swapchain->next(nullptr);
+        queued->lock();
+        flipping->lockedByBackend = true;
+
+        for (size_t i = 0; i < 6; ++i) {
+            auto buf = swapchain->next(nullptr);
+            if (buf == queued || buf == flipping) {
+                fail("swapchain/next-skips-busy", "next() handed out a buffer that's queued or scanned out");
+                break;
+            }
+        }
+
+        queued->unlock();
+        flipping->lockedByBackend = false;
+    }
+
+    int                      age = 0;
+    Hyprutils::Math::CRegion damage;
+    bench("swapchain/next-with-damage", options.iterations * 10, [&] {
+        auto buf = swapchain->next(&age, &damage);
+        swapchain->addDamage(CBox{0, 0, 100, 100});
+    });
+
+    // alternates sizes, like an interactive resize. Dropped buffers go through the allocator's pool.
+    bool flip = false;
+    bench("swapchain/reconfigure-resize", options.iterations / 10 + 1, [&] {
+        flip = !flip;
+        swapchain->reconfigure(Aquamarine::SSwapchainOptions{.length = 3, .size = flip ? Vector2D{2560, 1440} : Vector2D{1920, 1080}});
+    });
+
+    bench("swapchain/reconfigure-noop", options.iterations, [&] { swapchain->reconfigure(swapchain->currentOptions()); });
+}
+
+static void benchBlit(SP<Aquamarine::CGBMAllocator> allocator, SP<Aquamarine::CBackend> backend, SP<Aquamarine::IBackendImplementation> impl) {
+    auto renderer = Aquamarine::CDRMRenderer::attempt(allocator, backend);
+    if (!renderer) {
+        skip("blit", "no renderer");
+        return;
+    }
+
+    renderer->self = renderer;
+
+    for (auto const& size : {Vector2D{1920, 1080}, Vector2D{2560, 1440}, Vector2D{3840, 2160}}) {
+        const std::string NAME = std::format("blit/{}x{}", (int)size.x, (int)size.y);
+
+        if (!wanted(NAME))
+            continue;
+
+        auto source = Aquamarine::CSwapchain::create(allocator, impl);
+        auto target = Aquamarine::CSwapchain::create(allocator, impl);
+        if (!source->reconfigure({.length = 1, .size = size}) || !target->reconfigure({.length = 2, .size = size, .scanout = true, .multigpu = true})) {
+            skip(NAME, "buffer allocation failed");
+            continue;
+        }
+
+        auto from = source->next(nullptr);
+        bool ok   = true;
+
+        bench(NAME, options.iterations / 10 + 1, [&] {
+            // the sync fd stays the renderer's, it closes it on the next blit
+            ok = ok && renderer->blit(from, target->next(nullptr)).success;
+        });
+
+        if (!ok)
+            skip(NAME, "some blits failed, results are not meaningful");
+
+        auto to = target->next(nullptr);
+        bench(std::format("{}/partial-256x256", NAME), options.iterations / 10 + 1, [&] { renderer->blit(from, to, -1, CRegion{CBox{0, 0, 256, 256}}); });
+
+        // downscaled, as for a capture
+        const std::string SCALED_NAME = std::format("{}/scaled-half", NAME);
+        if (!wanted(SCALED_NAME))
+            continue;
+
+        auto scaled = Aquamarine::CSwapchain::create(allocator, impl);
+
+        if (!scaled->reconfigure({.length = 2, .size = size / 2.0, .multigpu = true})) {
+            skip(SCALED_NAME, "buffer allocation failed");
+            continue;
+        }
+
+        if (!renderer->blit(from, scaled->next(nullptr)).success) {
+            fail(SCALED_NAME, "the scaled blit failed");
+            continue;
+        }
+
+        bench(SCALED_NAME, options.iterations / 10 + 1, [&] { renderer->blit(from, scaled->next(nullptr)); });
+        bench(std::format("{}/partial-256x256", SCALED_NAME), options.iterations / 10 + 1,
+              [&] { renderer->blit(from, scaled->next(nullptr), -1, CRegion{CBox{0, 0, 256, 256}}); });
+    }
+}
+
+static void benchHeadlessFrameLoop(SP<Aquamarine::CBackend> backend, SP<Aquamarine::IBackendImplementation> headless) {
+    if (!wanted("headless/frame"))
+        return;
+
+    SP<Aquamarine::IOutput> output;
+    auto                    newOutput = backend->events.newOutput.registerListener([&](std::any data) { output = std::any_cast<SP<Aquamarine::IOutput>>(data); });
+
+    if (!headless->createOutput("AQ-BENCH") || !output) {
+        skip("headless/frame", "no output");
+        return;
+    }
+
+    // fast enough that the virtual vblank doesn't hide the cost we're after
+    output->state->setEnabled(true);
+    output->state->setCustomMode(makeShared<Aquamarine::SOutputMode>(Aquamarine::SOutputMode{.pixelSize = {1920, 1080}, .refreshRate = 1000 * 1000 /* mHz */}));
+    output->state->setFormat(DRM_FORMAT_RGBA8888);
+
+    if (!output->swapchain->reconfigure({.length = 3, .size = {1920, 1080}, .format = DRM_FORMAT_RGBA8888}) || !output->commit()) {
+        skip("headless/frame", "output setup failed");
+        output->destroy();
+        return;
+    }
+
+    std::vector<double> cpu, intervals;
+    auto                last = std::chrono::steady_clock::now();
+
+    auto                frame = output->events.frame.registerListener([&](std::any data) {
+        const auto BEGIN = std::chrono::steady_clock::now();
+        intervals.emplace_back(std::chrono::duration<double, std::nano>(BEGIN - last).count());
+        last = BEGIN;
+
+        output->state->setBuffer(output->swapchain->next(nullptr));
+        output->commit();
+
+        cpu.emplace_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - BEGIN).count());
+    });
+
+    const auto FDS = backend->getPollFDs();
+
+    output->scheduleFrame();
+    while (cpu.size() < options.iterations) {
+        if (!dispatchOnce(FDS, 1000)) {
+            skip("headless/frame", "no frames are coming");
+            output->destroy();
+            return;
+        }
+    }
+
+    // the first one waited on setup
+    if (!intervals.empty())
+        intervals.erase(intervals.begin());
+
+    addResult("headless/frame-cpu", cpu);
+    addResult("headless/frame-interval-1000hz", intervals);
+
+    output->destroy();
+}
+
+static void benchDRM(SP<Aquamarine::CBackend> backend, SP<Aquamarine::IBackendImplementation> impl, const std::vector<SP<Aquamarine::IOutput>>& outputs) {
+    auto drm = (Aquamarine::CDRMBackend*)impl.get();
+
+    SP<Aquamarine::IOutput> output;
+    for (auto const& o : outputs) {
+        if (o->getBackend() == impl && o->preferredMode()) {
+            output = o;
+            break;
+        }
+    }
+
+    if (!output) {
+        skip("drm", "no connected output");
+        return;
+    }
+
+    const auto MODE = output->preferredMode();
+
+    output->state->setEnabled(true);
+    output->state->setMode(MODE);
+    output->state->setFormat(DRM_FORMAT_XRGB8888);
+
+    if (!output->swapchain->reconfigure({.length = 3, .size = MODE->pixelSize, .format = DRM_FORMAT_XRGB8888, .scanout = true, .scanoutOutput = output})) {
+        skip("drm", "swapchain reconfigure failed");
+        return;
+    }
+
+    auto buf = output->swapchain->next(nullptr);
+
+    bench("drm/fb-import-cached", options.iterations * 10, [&] { auto fb = Aquamarine::CDRMFB::create(buf, drm->self); });
+
+    SP<Aquamarine::IBuffer> fresh;
+    bench(
+        "drm/fb-import-new", options.iterations / 10 + 1, [&] { auto fb = Aquamarine::CDRMFB::create(fresh, drm->self); },
+        [&] {
+            // fresh buffers every time, the previous one is freed here, untimed
+            fresh = backend->primaryAllocator->acquire({.size = MODE->pixelSize, .format = DRM_FORMAT_XRGB8888, .scanout = true}, output->swapchain);
+        });
+    fresh.reset();
+
+    // the pending state is a modeset for the first test, and stays one: tests don't apply it
+    output->state->setBuffer(buf);
+    bench("drm/test-commit-modeset", options.iterations / 10 + 1, [&] { output->test(); });
+
+    if (!output->commit()) {
+        skip("drm/test-commit-flip", "enabling the output failed");
+        return;
+    }
+
+    // wait for the modeset's page-flip
+    const auto FDS = backend->getPollFDs();
+    for (size_t i = 0; i < 10; ++i) {
+        dispatchOnce(FDS, 100);
+    }
+
+    bench("drm/test-commit-flip", options.iterations / 10 + 1, [&] {
+        output->state->setBuffer(output->swapchain->next(nullptr));
+        output->test();
+    });
+
+    // back to back: the first flips, the second waits in the mailbox. Neither may come back from next() to be drawn into.
+    if (wanted("drm/mailbox-next")) {
+        output->state->setPresentationMode(Aquamarine::AQ_OUTPUT_PRESENTATION_MAILBOX);
+
+        std::vector<SP<Aquamarine::IBuffer>> committed;
+        for (size_t i = 0; i < 2; ++i) {
+            auto next = output->swapchain->next(nullptr);
+            output->state->setBuffer(next);
+            if (!output->commit()) {
+                fail("drm/mailbox-next", std::format("mailbox commit {} failed", i));
+                break;
+            }
+            committed.emplace_back(next);
+        }
+
+        if (committed.size() == 2 && std::find(committed.begin(), committed.end(), output->swapchain->next(nullptr)) != committed.end())
+            fail("drm/mailbox-next", "next() handed out the queued or the flipping buffer");
+
+        // flip the queued frame too
+        for (size_t i = 0; i < 10; ++i) {
+            dispatchOnce(FDS, 100);
+        }
+
+        output->state->setPresentationMode(Aquamarine::AQ_OUTPUT_PRESENTATION_VSYNC);
+    }
+
+    // the frame on screen, and a half size copy of it as a screencast would ask for
+    const auto HALF = MODE->pixelSize / 2.0;
+    if (wanted("drm/capture-scaled")) {
+        auto capture = output->capture(HALF);
+        if (!capture)
+            fail("drm/capture-scaled", "no capture of an enabled output");
+        else if (!capture->scaled)
+            fail("drm/capture-scaled", "no scaled copy");
+        else if (capture->scaled->size != HALF)
+            fail("drm/capture-scaled", std::format("the scaled copy is {}, asked for {}", capture->scaled->size, HALF));
+        else {
+            capture.reset();
+            bench("drm/capture-scaled", options.iterations / 10 + 1, [&] { auto c = output->capture(HALF); });
+        }
+    }
+}
+
+static void printJSON() {
+    std::cout << std::format("{{\"version\": \"{}\", \"backend\": \"{}\", \"results\": [", AQUAMARINE_VERSION, options.drm ? "drm" : "headless");
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results.at(i);
+        std::cout << std::format("{}{{\"name\": \"{}\", \"iterations\": {}, \"min_ns\": {:.0f}, \"median_ns\": {:.0f}, \"p99_ns\": {:.0f}, \"mean_ns\": {:.0f}}}", i ? ", " : "",
+                                 r.name, r.iterations, r.minNs, r.medianNs, r.p99Ns, r.meanNs);
+    }
+
+    std::cout << "], \"skipped\": [";
+
+    for (size_t i = 0; i < skipped.size(); ++i) {
+        std::cout << std::format("{}{{\"name\": \"{}\", \"reason\": \"{}\"}}", i ? ", " : "", skipped.at(i).first, skipped.at(i).second);
+    }
+
+    std::cout << "], \"failed\": [";
+
+    for (size_t i = 0; i < failed.size(); ++i) {
+        std::cout << std::format("{}{{\"name\": \"{}\", \"reason\": \"{}\"}}", i ? ", " : "", failed.at(i).first, failed.at(i).second);
+    }
+
+    std::cout << "]}\n";
+}
+
+int main(int argc, char** argv, char** envp) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string ARG     = argv[i];
+        const bool        HAS_VAL = i + 1 < argc;
+
+        if (ARG == "--json")
+            options.json = true;
+        else if (ARG == "--drm")
+            options.drm = true;
+        else if (ARG == "--verbose")
+            options.verbose = true;
+        else if (ARG == "--iterations" && HAS_VAL)
+            options.iterations = std::max(1UL, std::stoul(argv[++i]));
+        else if (ARG == "--filter" && HAS_VAL)
+            options.filter = argv[++i];
+        else if (ARG == "--render-node" && HAS_VAL)
+            options.renderNode = argv[++i];
+        else if (ARG == "--card" && HAS_VAL)
+            options.card = argv[++i];
+        else {
+            std::cerr << "usage: benchmarks [--json] [--drm] [--iterations N] [--filter STR] [--render-node PATH] [--card PATH] [--verbose]\n";
+            return 1;
+        }
+    }
+
+    Aquamarine::SBackendOptions backendOptions;
+    backendOptions.logFunction = aqLog;
+
+    std::vector<Aquamarine::SBackendImplementationOptions> implementations;
+    Aquamarine::SBackendImplementationOptions              headlessOptions;
+    headlessOptions.backendType        = Aquamarine::eBackendType::AQ_BACKEND_HEADLESS;
+    headlessOptions.backendRequestMode = Aquamarine::eBackendRequestMode::AQ_BACKEND_REQUEST_MANDATORY;
+    implementations.emplace_back(headlessOptions);
+
+    if (options.drm) {
+        Aquamarine::SBackendImplementationOptions drmOptions;
+        drmOptions.backendType        = Aquamarine::eBackendType::AQ_BACKEND_DRM;
+        drmOptions.backendRequestMode = Aquamarine::eBackendRequestMode::AQ_BACKEND_REQUEST_MANDATORY;
+        implementations.emplace_back(drmOptions);
+    }
+
+    auto aqBackend = Aquamarine::CBackend::create(implementations, backendOptions);
+    if (!aqBackend) {
+        std::cerr << "Failed to create the aq backend\n";
+        return 1;
+    }
+
+    const int RENDERFD = open(options.renderNode.c_str(), O_RDWR | O_CLOEXEC);
+    if (RENDERFD < 0) {
+        std::cerr << std::format("Failed to open {}: {}\n", options.renderNode, strerror(errno));
+        return 1;
+    }
+
+    auto gbm = Aquamarine::CGBMAllocator::create(RENDERFD, aqBackend);
+    if (!gbm) {
+        std::cerr << "Failed to create a gbm allocator\n";
+        return 1;
+    }
+
+    // headless has no gpu of its own to create one on
+    if (!options.drm)
+        aqBackend->primaryAllocator = gbm;
+
+    std::vector<SP<Aquamarine::IOutput>> outputs;
+    auto newOutput = aqBackend->events.newOutput.registerListener([&](std::any data) { outputs.emplace_back(std::any_cast<SP<Aquamarine::IOutput>>(data)); });
+
+    if (!aqBackend->start()) {
+        std::cerr << "Failed to start the aq backend\n";
+        return 1;
+    }
+
+    newOutput.reset();
+
+    SP<Aquamarine::IBackendImplementation> headless, drm;
+    for (auto const& i : aqBackend->getImplementations()) {
+        if (i->type() == Aquamarine::eBackendType::AQ_BACKEND_HEADLESS)
+            headless = i;
+        else if (i->type() == Aquamarine::eBackendType::AQ_BACKEND_DRM && !drm)
+            drm = i;
+    }
+
+    benchAttachments();
+    benchSignals();
+    benchFormats();
+
+    benchAllocator("gbm", gbm, Aquamarine::CSwapchain::create(gbm, headless), {1920, 1080});
+    benchAllocator("gbm", gbm, Aquamarine::CSwapchain::create(gbm, headless), {3840, 2160});
+
+    // dumb buffers need a primary node
+    const int                         CARDFD = drm ? drm->drmFD() : open(options.card.c_str(), O_RDWR | O_CLOEXEC);
+    SP<Aquamarine::CDRMDumbAllocator> dumb;
+    if (CARDFD >= 0)
+        dumb = Aquamarine::CDRMDumbAllocator::create(CARDFD, aqBackend);
+
+    if (dumb) {
+        benchAllocator("dumb", dumb, Aquamarine::CSwapchain::create(dumb, headless), {256, 256});
+        benchAllocator("dumb", dumb, Aquamarine::CSwapchain::create(dumb, headless), {1920, 1080});
+    } else
+        skip("dumb", std::format("no dumb allocator on {}", options.card));
+
+    benchSwapchain(gbm, headless);
+    benchBlit(gbm, aqBackend, headless);
+    benchHeadlessFrameLoop(aqBackend, headless);
+
+    if (drm)
+        benchDRM(aqBackend, drm, outputs);
+
+    if (options.json)
+        printJSON();
+
+    return failed.empty() ? 0 : 1;
+}